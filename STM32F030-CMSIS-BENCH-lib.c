@@ -0,0 +1,281 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-BENCH-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Micro-benchmarks of the library kernels, timed on the target with SysTick
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    "make BENCHMARKS=1" adds this runner. A benchmark is a function doing one operation,
+//    defined with BENCH( name ) anywhere in the program; the macro places a descriptor
+//    in the .bench section, which the linker script keeps between __bench_start and
+//    __bench_end, so the runner finds every benchmark without a central list.
+//
+//      BENCH( fmt_hex8 )
+//      {
+//        FMT_hex( BENCH_text, 0x89ABCDEF, 8 );
+//      }
+//
+//    Each benchmark is run BENCH_RUNS times, every run timed alone with SysTick_cycles()
+//    and interrupts masked. The cost of the timing itself (two SysTick_cycles calls and
+//    the indirect call) is measured the same way on an empty function and its minimum
+//    is taken off every sample. Interrupts are enabled between runs so SysTick keeps
+//    counting; a single run must stay below SysTick_cyclesMs / 2 cycles (0.5 ms) for
+//    the masked read to be exact.
+//
+//    The console command "bench" starts a pass; BENCH_run() in the main loop runs one
+//    benchmark per call and sends its line (decimal core clock cycles):
+//      BENCH runs <runs> overhead <cycles>
+//      B <name> <min> <median> <max>
+//      BENCH end <benchmarks>
+//    tools/bench.py collects them and compares the medians with a stored baseline.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_BENCH_LIB_C
+#define __STM32F030_CMSIS_BENCH_LIB_C
+
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-USART-TXQ-lib.c"
+#include "STM32F030-CMSIS-FMT-lib.c"
+#include "STM32F030-CMSIS-CRC-lib.c"
+#include "STM32F030-CMSIS-RING-lib.c"
+#include "STM32F030-CMSIS-IMG-lib.c"
+#include "STM32F030-CMSIS-BITPACK-lib.c"
+
+
+#define BENCH_RUNS        15              // Odd, so the median is one sample
+#define BENCH_LINE_SIZE   48
+
+
+typedef struct
+{
+  const char *name;
+  void      ( *fn )( void );
+} BENCH_t;
+
+// Define a benchmark. The body follows the macro like a function body.
+#define BENCH( name )                                                              \
+  static void BENCH_##name( void );                                                \
+  __attribute__(( section( ".bench" ), used ))                                     \
+  static const BENCH_t BENCH_entry_##name = { #name, BENCH_##name };              \
+  static void BENCH_##name( void )
+
+
+extern const BENCH_t __bench_start[], __bench_end[];    // From the linker script
+
+int16_t  BENCH_line = -1;                 // Next report line, -1 = idle
+uint32_t BENCH_overhead;                  // Cycles of the timing itself
+
+
+//  static void
+//  BENCH_nothing( void )
+//  The empty benchmark, for the overhead.
+static void
+BENCH_nothing( void )
+{
+}
+
+
+//  static void
+//  BENCH_measure( void ( *fn )( void ), uint32_t *samples )
+//  Time BENCH_RUNS calls of fn into samples, sorted ascending. Overhead not removed.
+static void
+BENCH_measure( void ( *fn )( void ), uint32_t *samples )
+{
+  uint32_t t0, t1, s;
+  uint8_t  x;
+
+  for( uint8_t n = 0; n < BENCH_RUNS; n++ )
+  {
+    __disable_irq();
+    t0 = SysTick_cycles();
+    fn();
+    t1 = SysTick_cycles();
+    __enable_irq();                       // Let the SysTick handler count the millisecond
+
+    // Insertion sort as the samples come in
+    s = t1 - t0;
+    for( x = n; x && samples[ x - 1 ] > s; x-- )
+      samples[ x ] = samples[ x - 1 ];
+    samples[ x ] = s;
+  }
+}
+
+
+//  void
+//  BENCH_start( void )
+//  Start a pass over all benchmarks (see BENCH_run). Measures the overhead first.
+void
+BENCH_start( void )
+{
+  uint32_t samples[ BENCH_RUNS ];
+
+  BENCH_measure( BENCH_nothing, samples );
+  BENCH_overhead = samples[ 0 ];
+  BENCH_line     = 0;
+}
+
+
+//  static uint8_t
+//  BENCH_putu( char *buf, uint32_t value )
+//  Append " value" in decimal. Returns the characters written.
+static uint8_t
+BENCH_putu( char *buf, uint32_t value )
+{
+  uint8_t n = 1;
+
+  buf[ 0 ] = ' ';
+  utoa( value, buf + 1, 10 );
+  while( buf[ n ] )
+    n++;
+  return n;
+}
+
+
+//  static uint8_t
+//  BENCH_puts( char *buf, const char *s )
+//  Append s, at most BENCH_LINE_SIZE / 2 characters. Returns the characters written.
+static uint8_t
+BENCH_puts( char *buf, const char *s )
+{
+  uint8_t n = 0;
+
+  for( ; s[ n ] && n < BENCH_LINE_SIZE / 2; n++ )
+    buf[ n ] = s[ n ];
+  return n;
+}
+
+
+//  static uint32_t
+//  BENCH_net( uint32_t cycles )
+//  A sample without the overhead.
+static uint32_t
+BENCH_net( uint32_t cycles )
+{
+  return cycles > BENCH_overhead ? cycles - BENCH_overhead : 0;
+}
+
+
+//  void
+//  BENCH_run( void )
+//  Call from the main loop: runs the next benchmark and sends its line when the bulk
+//  queue has room.
+void
+BENCH_run( void )
+{
+  char           line[ BENCH_LINE_SIZE ];
+  uint8_t        n     = 0;
+  uint16_t       count = __bench_end - __bench_start;
+  uint32_t       samples[ BENCH_RUNS ];
+  const BENCH_t *bench;
+
+  if( BENCH_line < 0 || TXQ_bulkFree() < BENCH_LINE_SIZE )
+    return;
+
+  if( BENCH_line == 0 )
+  {
+    n += BENCH_puts( line + n, "BENCH runs" );
+    n += BENCH_putu( line + n, BENCH_RUNS );
+    n += BENCH_puts( line + n, " overhead" );
+    n += BENCH_putu( line + n, BENCH_overhead );
+  }
+  else if( BENCH_line <= count )
+  {
+    bench = &__bench_start[ BENCH_line - 1 ];
+    BENCH_measure( bench->fn, samples );
+    n += BENCH_puts( line + n, "B " );
+    n += BENCH_puts( line + n, bench->name );
+    n += BENCH_putu( line + n, BENCH_net( samples[ 0 ] ) );
+    n += BENCH_putu( line + n, BENCH_net( samples[ BENCH_RUNS / 2 ] ) );
+    n += BENCH_putu( line + n, BENCH_net( samples[ BENCH_RUNS - 1 ] ) );
+  }
+  else
+  {
+    n += BENCH_puts( line + n, "BENCH end" );
+    n += BENCH_putu( line + n, count );
+    BENCH_line = -2;                      // -1 after the increment
+  }
+  BENCH_line++;
+  line[ n++ ] = '\n';
+  TXQ_bulk( line, n );
+}
+
+
+//  ------------------------------------------------------------------------------------------
+//  Benchmarks of the library kernels. Build with and without ASM_KERNELS to compare the
+//  C and Thumb-1 twins.
+//  ------------------------------------------------------------------------------------------
+
+#define BENCH_DATA_SIZE   64
+
+static uint32_t          BENCH_data[ BENCH_DATA_SIZE / 4 ] = { 0x01234567, 0x89ABCDEF, 0xDEADBEEF };
+static uint32_t          BENCH_copy[ BENCH_DATA_SIZE / 4 ];
+static char              BENCH_text[ 8 ];
+static uint16_t          BENCH_channels[ 16 ];
+static volatile uint32_t BENCH_sink;      // Results go here so they are not optimized out
+RING_DEFINE( BENCH_ring, BENCH_DATA_SIZE );
+
+
+BENCH( fmt_hex8 )
+{
+  FMT_hex( BENCH_text, 0x89ABCDEF, 8 );
+}
+
+
+BENCH( crc16_64 )
+{
+  BENCH_sink = CRC16_update( CRC16_INIT, BENCH_data, BENCH_DATA_SIZE );
+}
+
+
+BENCH( crc32_dma_64 )
+{
+  RCC->AHBENR |= RCC_AHBENR_CRCEN;
+  CRC->CR = CRC_CR_RESET;
+  IMG_crcWords( BENCH_data, BENCH_DATA_SIZE / 4 );
+  BENCH_sink = CRC->DR;
+}
+
+
+BENCH( ring_put_get_64 )
+{
+  for( uint8_t x = 0; x < BENCH_DATA_SIZE; x++ )
+    RING_put( &BENCH_ring, x );
+  for( uint8_t x = 0; x < BENCH_DATA_SIZE; x++ )
+    BENCH_sink = RING_get( &BENCH_ring );
+}
+
+
+BENCH( ring_write_read_64 )
+{
+  RING_write( &BENCH_ring, BENCH_data, BENCH_DATA_SIZE );
+  RING_read( &BENCH_ring, BENCH_copy, BENCH_DATA_SIZE );
+}
+
+
+BENCH( ring_copy_64 )
+{
+  RING_copy( (uint8_t *)BENCH_copy, (const uint8_t *)BENCH_data, BENCH_DATA_SIZE );
+}
+
+
+BENCH( unpack11_sbus )
+{
+  BITPACK_unpack11( (const uint8_t *)BENCH_data, BENCH_channels, 2 );
+}
+
+
+BENCH( pack11_sbus )
+{
+  BITPACK_pack11( BENCH_channels, (uint8_t *)BENCH_copy, 2 );
+}
+
+
+BENCH( memcpy_64 )
+{
+  memcpy( BENCH_copy, BENCH_data, BENCH_DATA_SIZE );
+}
+
+
+#endif /* __STM32F030_CMSIS_BENCH_LIB_C */
@@ -0,0 +1,338 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-BERT-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Bit error rate test of the USART1 link with PRBS-7/15/31 patterns
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Qualifies a cable, level shifter or baud setting. On request the port switches to the
+//    test baud rate for a number of seconds and carries a pseudo random bit sequence
+//    instead of console text and frames: the device sends the pattern (through the bulk
+//    TX DMA), checks the pattern it receives (from the RX DMA ring), or both. Afterwards
+//    it switches back and reports the counts. tools/bert.py is the other end.
+//
+//    Patterns (ITU-T O.150 polynomials, not inverted), sent LSB first like the USART:
+//      PRBS-7    x^7 + x^6 + 1       PRBS-15   x^15 + x^14 + 1     PRBS-31   x^31 + x^28 + 1
+//    The generator holds the last n bits of the sequence and makes 8 bits (4 for PRBS-7)
+//    per shift, so a byte costs a few instructions rather than a loop over its bits.
+//
+//    The checker loads its generator from the received bytes, verifies BERT_VERIFY more
+//    bytes and then compares every byte with the prediction, counting bit and byte
+//    errors. More than BERT_LOSS_BITS bit errors in a block of BERT_BLOCK bytes (a lost
+//    or inserted byte shifts the pattern) counts as a resync and the checker hunts again.
+//    Framing and noise errors come from the USART error interrupt.
+//
+//    Over DMX_TYPE_BERT frames (little endian):
+//      request  0x01 order:u8 mode:u8 baud:u32 seconds:u16   start; mode bit 0 send,
+//                                                            bit 1 check
+//               0x02                                         repeat the last result
+//      reply    0x01 order mode baud seconds                 accepted, at the old baud
+//               0x00                                         rejected (bad arguments, busy)
+//      result   0x02 sent:u32 checked:u32 bitErrors:u32 byteErrors:u32 framing:u32
+//               noise:u32 resyncs:u16 lost:u16 synced:u8
+//
+//    The switch to the test baud rate and back, with the settle times around it, is done
+//    by STM32F030-CMSIS-LEND-lib.c; counting runs in its RUN phase. Meanwhile BERT_run()
+//    returns 1 and the main loop must leave the port alone (no DMX_poll, no other output):
+//
+//      if( BERT_run() ) continue;
+//      void USART1_IRQHandler( void ) { ...; BERT_usartIsr(); }
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_BERT_LIB_C
+#define __STM32F030_CMSIS_BERT_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-USART-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+#include "STM32F030-CMSIS-LEND-lib.c"
+
+
+#define BERT_SEND         0x01            // Mode bits
+#define BERT_CHECK        0x02
+#define BERT_VERIFY       4               // Bytes that must match before the checker locks
+#define BERT_BLOCK        64              // Bytes per sync loss block
+#define BERT_LOSS_BITS    64              // Bit errors in a block that mean sync is lost
+#define BERT_CHUNK        32              // Bytes generated per TXQ_bulk call
+
+
+typedef struct
+{
+  uint32_t state;                         // Last order bits, oldest in bit 0
+  uint8_t  order;                         // n of x^n + x^m + 1
+  uint8_t  tap;                           // n - m
+  uint8_t  step;                          // Bits per shift
+} BERT_prbs_t;
+
+typedef struct
+{
+  uint32_t sent;                          // Bytes queued
+  uint32_t checked;                       // Bytes compared while in sync
+  uint32_t bitErrors;
+  uint32_t byteErrors;
+  uint32_t framing;
+  uint32_t noise;
+  uint16_t resyncs;                       // Sync losses after the first lock
+  uint16_t lost;                          // RX ring overruns (bytes dropped by the device)
+  uint8_t  synced;                        // Checker locked at least once
+} BERT_result_t;
+
+
+BERT_result_t BERT_result;
+BERT_prbs_t   BERT_tx;
+BERT_prbs_t   BERT_rx;
+uint8_t       BERT_rxLoaded;              // Hunting: bytes loaded / verified so far
+uint8_t       BERT_rxLocked;
+uint8_t       BERT_blockBytes;
+uint16_t      BERT_blockBits;             // Bit errors in the current block
+
+LEND_t        BERT_lend;                  // Test baud rate, length and phase
+uint8_t       BERT_mode;
+uint8_t       BERT_order;
+uint16_t      BERT_overruns;              // DMX_reader.overruns when counting started
+
+static const uint8_t BERT_ones[ 16 ] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+
+//  static void
+//  BERT_prbsInit( BERT_prbs_t *p, uint8_t order )
+//  Seed a generator with all ones.
+static void
+BERT_prbsInit( BERT_prbs_t *p, uint8_t order )
+{
+  p->order = order;
+  p->tap   = order == 31 ? 3 : 1;
+  p->step  = order == 7 ? 4 : 8;
+  p->state = 0xFFFFFFFF >> ( 32 - order );
+}
+
+
+//  static uint8_t
+//  BERT_prbsShift( BERT_prbs_t *p, uint8_t in, uint8_t load )
+//  Advance by 8 bits and return them, first bit in bit 0. With load the bits are taken
+//  from in (to synchronize to a received stream) instead of being generated.
+static uint8_t
+BERT_prbsShift( BERT_prbs_t *p, uint8_t in, uint8_t load )
+{
+  uint32_t r = p->state, mask = ( 1 << p->step ) - 1, bits, out = 0;
+
+  for( uint8_t x = 0; x < 8; x += p->step )
+  {
+    // s[k+j] = s[k+j-n] ^ s[k+j-m]: bit j and bit j + n - m of the state
+    bits = load ? ( in >> x ) & mask : ( r ^ ( r >> p->tap ) ) & mask;
+    r    = ( r >> p->step ) | ( bits << ( p->order - p->step ) );
+    out |= bits << x;
+  }
+  p->state = r;
+  return out;
+}
+
+
+//  static void
+//  BERT_check( uint8_t c )
+//  Checker: hunt for the pattern in the received bytes or compare one byte with it.
+static void
+BERT_check( uint8_t c )
+{
+  uint8_t diff, errors;
+
+  if( !BERT_rxLocked )
+  {
+    if( BERT_rxLoaded < ( BERT_order + 7 ) / 8 )
+    {
+      BERT_prbsShift( &BERT_rx, c, 1 );
+      BERT_rxLoaded++;
+    }
+    else if( BERT_prbsShift( &BERT_rx, 0, 0 ) != c || !BERT_rx.state )
+    {
+      BERT_prbsShift( &BERT_rx, c, 1 );   // Start over from this byte
+      BERT_rxLoaded = 1;
+    }
+    else if( ++BERT_rxLoaded >= ( BERT_order + 7 ) / 8 + BERT_VERIFY )
+    {
+      if( BERT_result.synced )
+        BERT_result.resyncs++;
+      BERT_result.synced = BERT_rxLocked = 1;
+      BERT_blockBytes    = BERT_blockBits = 0;
+    }
+    return;
+  }
+
+  diff = c ^ BERT_prbsShift( &BERT_rx, 0, 0 );
+  BERT_result.checked++;
+  if( diff )
+  {
+    errors = BERT_ones[ diff & 15 ] + BERT_ones[ diff >> 4 ];
+    BERT_result.bitErrors += errors;
+    BERT_result.byteErrors++;
+    BERT_blockBits += errors;
+  }
+  if( ++BERT_blockBytes >= BERT_BLOCK )
+  {
+    if( BERT_blockBits > BERT_LOSS_BITS )
+      BERT_rxLocked = BERT_rxLoaded = 0;
+    BERT_blockBytes = BERT_blockBits = 0;
+  }
+}
+
+
+//  static void
+//  BERT_receive( uint8_t check )
+//  Take all received bytes off the DMX reader; check them or throw them away.
+static void
+BERT_receive( uint8_t check )
+{
+  const uint8_t *data;
+  uint16_t       count;
+
+  while( ( count = RXF_span( &DMX_reader, &data ) ) )
+  {
+    if( check )
+      for( uint16_t x = 0; x < count; x++ )
+        BERT_check( data[ x ] );
+    RXF_consume( &DMX_reader, count );
+  }
+}
+
+
+//  static void
+//  BERT_send( void )
+//  Top up the bulk queue with the pattern.
+static void
+BERT_send( void )
+{
+  uint8_t buf[ BERT_CHUNK ];
+
+  while( TXQ_bulkFree() >= BERT_CHUNK )
+  {
+    for( uint8_t x = 0; x < BERT_CHUNK; x++ )
+      buf[ x ] = BERT_prbsShift( &BERT_tx, 0, 0 );
+    BERT_result.sent += TXQ_bulk( buf, BERT_CHUNK );
+  }
+}
+
+
+//  static uint8_t
+//  BERT_sendResult( void )
+//  Queue the result frame. Returns 0 if the bulk queue had no room.
+static uint8_t
+BERT_sendResult( void )
+{
+  uint8_t  payload[ 30 ], n = 1;
+  uint32_t values[] = { BERT_result.sent, BERT_result.checked, BERT_result.bitErrors,
+                        BERT_result.byteErrors, BERT_result.framing, BERT_result.noise,
+                        BERT_result.resyncs, BERT_result.lost };
+
+  payload[ 0 ] = 0x02;
+  for( uint8_t x = 0; x < 8; x++ )
+    for( uint8_t y = 0; y < ( x < 6 ? 4 : 2 ); y++ )
+      payload[ n++ ] = values[ x ] >> ( 8 * y );
+  payload[ n++ ] = BERT_result.synced;
+  return DMX_sendBulk( DMX_TYPE_BERT, payload, n );
+}
+
+
+//  void
+//  BERT_request( const uint8_t *payload, uint8_t len )
+//  Handle a DMX_TYPE_BERT frame.
+void
+BERT_request( const uint8_t *payload, uint8_t len )
+{
+  uint8_t reply = 0x00;
+
+  if( len == 1 && payload[ 0 ] == 0x02 && BERT_lend.phase == LEND_IDLE )
+  {
+    BERT_sendResult();
+    return;
+  }
+  if( len == 9 && payload[ 0 ] == 0x01 && LEND_args( &BERT_lend, &payload[ 3 ] ) )
+  {
+    BERT_order = payload[ 1 ];
+    BERT_mode  = payload[ 2 ] & ( BERT_SEND | BERT_CHECK );
+    if( ( BERT_order == 7 || BERT_order == 15 || BERT_order == 31 ) && BERT_mode )
+    {
+      BERT_result = (BERT_result_t){ 0 };
+      BERT_prbsInit( &BERT_tx, BERT_order );
+      BERT_prbsInit( &BERT_rx, BERT_order );
+      BERT_rxLoaded = BERT_rxLocked = 0;
+      LEND_start( &BERT_lend );
+      DMX_sendFrame( DMX_TYPE_BERT, payload, len );
+      return;
+    }
+  }
+  DMX_sendFrame( DMX_TYPE_BERT, &reply, 1 );
+}
+
+
+//  uint8_t
+//  BERT_run( void )
+//  Call from the main loop. Returns 1 while a test owns the port; the caller must then
+//  skip DMX_poll and everything that writes to the TX queue.
+uint8_t
+BERT_run( void )
+{
+  switch( LEND_run( &BERT_lend ) )
+  {
+    case LEND_OFF:
+      return 0;
+
+    case LEND_WAIT:
+      return 1;
+
+    case LEND_SWITCHED:
+      USART_USART->ICR  = USART_ICR_FECF | USART_ICR_NCF;
+      USART_USART->CR3 |= USART_CR3_EIE;
+      break;
+
+    case LEND_START:
+      BERT_receive( 0 );                  // What arrived while the host switched
+      BERT_overruns = DMX_reader.overruns;
+      break;
+
+    case LEND_STOP:
+      BERT_result.lost  = DMX_reader.overruns - BERT_overruns;
+      USART_USART->CR3 &= ~USART_CR3_EIE;
+      break;
+
+    case LEND_RESULT:
+      if( BERT_sendResult() )
+      {
+        LEND_end( &BERT_lend );
+        return 0;
+      }
+      break;
+  }
+
+  if( ( BERT_mode & BERT_SEND ) &&
+      ( BERT_lend.phase == LEND_SETTLE || BERT_lend.phase == LEND_RUN ) )
+    BERT_send();
+  BERT_receive( ( BERT_mode & BERT_CHECK ) && BERT_lend.phase == LEND_RUN );
+  return 1;
+}
+
+
+//  void
+//  BERT_usartIsr( void )
+//  USART1 interrupt service: count framing and noise errors during a test.
+void
+BERT_usartIsr( void )
+{
+  uint32_t isr = USART_USART->ISR;
+
+  if( !( USART_USART->CR3 & USART_CR3_EIE ) )
+    return;
+  if( isr & USART_ISR_FE )
+  {
+    if( BERT_lend.phase == LEND_RUN )
+      BERT_result.framing++;
+    USART_USART->ICR = USART_ICR_FECF;
+  }
+  if( isr & USART_ISR_NE )
+  {
+    if( BERT_lend.phase == LEND_RUN )
+      BERT_result.noise++;
+    USART_USART->ICR = USART_ICR_NCF;
+  }
+}
+
+
+#endif /* __STM32F030_CMSIS_BERT_LIB_C */
@@ -0,0 +1,142 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-BITPACK-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Branch-free packing of 10, 11 and 12-bit channel values into byte streams
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Channel protocols pack fixed-width values back to back, least significant bit first
+//    (SBUS: 16 channels x 11 bits in 22 bytes). Eight channels of B bits always fill
+//    exactly B bytes, so data is processed in groups of eight channels and every bit
+//    position inside a group is a compile-time constant:
+//
+//      channel k    starts at bit k*B         -> byte k*B/8, shift k*B%8
+//      byte    j    starts inside channel 8j/B, and also takes the low bits of channel
+//                   8j/B + 1 if that channel starts before bit 8j+8
+//
+//    BITPACK_GET and BITPACK_BYTE expand to straight-line shift/or/mask code with no loops
+//    or data dependent branches. Unpacking gathers the two or three bytes a channel spans
+//    into a 32-bit word and extracts the field from it. Packing builds each output byte
+//    from the one or two channels overlapping it. The conditions in the macros are
+//    constant and fold away; they also keep every access inside the group.
+//
+//    Channel values must be unsigned and are masked to B bits when packing.
+//
+//      SBUS:  BITPACK_unpack11( &frame[ 1 ], channels, 2 );   // 16 channels
+//
+//    BITPACK_unpack11 selects BITPACK_unpack11_c or, when built with ASM_KERNELS, the
+//    Thumb-1 twin BITPACK_unpack11_asm from kernels_cortexm0.s.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_BITPACK_LIB_C
+#define __STM32F030_CMSIS_BITPACK_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#ifdef ASM_KERNELS
+  void BITPACK_unpack11_asm( const uint8_t *in, uint16_t *ch, uint8_t groups );
+  #define BITPACK_unpack11 BITPACK_unpack11_asm
+#else
+  #define BITPACK_unpack11 BITPACK_unpack11_c
+#endif
+
+
+#define BITPACK_MASK( bits )        ( ( 1UL << (bits) ) - 1 )
+
+// First byte and bit shift of channel k
+#define BITPACK_POS( bits, k )      ( (k) * (bits) / 8 )
+#define BITPACK_SHIFT( bits, k )    ( (k) * (bits) % 8 )
+
+// Value of channel k (0..7) of the group at p
+#define BITPACK_GET( p, bits, k )                                                        \
+  ( ( ( (uint32_t)(p)[ BITPACK_POS( bits, k ) ] |                                       \
+        ( (uint32_t)(p)[ BITPACK_POS( bits, k ) + 1 ] << 8 ) |                          \
+        ( BITPACK_SHIFT( bits, k ) + (bits) > 16 ?                                      \
+          (uint32_t)(p)[ BITPACK_POS( bits, k ) + 2 ] << 16 : 0 ) )                     \
+      >> BITPACK_SHIFT( bits, k ) ) & BITPACK_MASK( bits ) )
+
+// First channel overlapping byte j, and its offset into that channel
+#define BITPACK_CH( bits, j )       ( (j) * 8 / (bits) )
+#define BITPACK_OFS( bits, j )      ( (j) * 8 - BITPACK_CH( bits, j ) * (bits) )
+
+// Byte j (0..bits-1) of the group built from the channels at c
+#define BITPACK_BYTE( c, bits, j )                                                       \
+  (uint8_t)( ( ( (c)[ BITPACK_CH( bits, j ) ] & BITPACK_MASK( bits ) )                   \
+               >> BITPACK_OFS( bits, j ) ) |                                             \
+             ( ( BITPACK_CH( bits, j ) + 1 ) * (bits) < (j) * 8 + 8 ?                    \
+               ( (uint32_t)( (c)[ BITPACK_CH( bits, j ) + 1 ] & BITPACK_MASK( bits ) )   \
+                 << ( ( BITPACK_CH( bits, j ) + 1 ) * (bits) - (j) * 8 ) ) : 0 ) )
+
+#define BITPACK_UNPACK8( p, c, bits )                                                    \
+  do {                                                                                   \
+    (c)[ 0 ] = BITPACK_GET( p, bits, 0 );  (c)[ 1 ] = BITPACK_GET( p, bits, 1 );         \
+    (c)[ 2 ] = BITPACK_GET( p, bits, 2 );  (c)[ 3 ] = BITPACK_GET( p, bits, 3 );         \
+    (c)[ 4 ] = BITPACK_GET( p, bits, 4 );  (c)[ 5 ] = BITPACK_GET( p, bits, 5 );         \
+    (c)[ 6 ] = BITPACK_GET( p, bits, 6 );  (c)[ 7 ] = BITPACK_GET( p, bits, 7 );         \
+  } while( 0 )
+
+// A group has exactly bits bytes. Bytes 10 and 11 exist only for wider channels; the
+// "% (bits)" keeps the index of the dead statement in range when they do not.
+#define BITPACK_PACK8( c, p, bits )                                                      \
+  do {                                                                                   \
+    (p)[ 0 ] = BITPACK_BYTE( c, bits, 0 );  (p)[ 1 ] = BITPACK_BYTE( c, bits, 1 );       \
+    (p)[ 2 ] = BITPACK_BYTE( c, bits, 2 );  (p)[ 3 ] = BITPACK_BYTE( c, bits, 3 );       \
+    (p)[ 4 ] = BITPACK_BYTE( c, bits, 4 );  (p)[ 5 ] = BITPACK_BYTE( c, bits, 5 );       \
+    (p)[ 6 ] = BITPACK_BYTE( c, bits, 6 );  (p)[ 7 ] = BITPACK_BYTE( c, bits, 7 );       \
+    (p)[ 8 ] = BITPACK_BYTE( c, bits, 8 );  (p)[ 9 ] = BITPACK_BYTE( c, bits, 9 );       \
+    if( (bits) > 10 ) (p)[ 10 % (bits) ] = BITPACK_BYTE( c, bits, 10 % (bits) );         \
+    if( (bits) > 11 ) (p)[ 11 % (bits) ] = BITPACK_BYTE( c, bits, 11 % (bits) );         \
+  } while( 0 )
+
+
+//  void
+//  BITPACK_unpack10/11/12( const uint8_t *in, uint16_t *ch, uint8_t groups )
+//  Unpack groups * 8 channels from groups * B bytes at in.
+void
+BITPACK_unpack10( const uint8_t *in, uint16_t *ch, uint8_t groups )
+{
+  for( ; groups; groups--, in += 10, ch += 8 )
+    BITPACK_UNPACK8( in, ch, 10 );
+}
+
+void
+BITPACK_unpack11_c( const uint8_t *in, uint16_t *ch, uint8_t groups )
+{
+  for( ; groups; groups--, in += 11, ch += 8 )
+    BITPACK_UNPACK8( in, ch, 11 );
+}
+
+void
+BITPACK_unpack12( const uint8_t *in, uint16_t *ch, uint8_t groups )
+{
+  for( ; groups; groups--, in += 12, ch += 8 )
+    BITPACK_UNPACK8( in, ch, 12 );
+}
+
+
+//  void
+//  BITPACK_pack10/11/12( const uint16_t *ch, uint8_t *out, uint8_t groups )
+//  Pack groups * 8 channels into groups * B bytes at out.
+void
+BITPACK_pack10( const uint16_t *ch, uint8_t *out, uint8_t groups )
+{
+  for( ; groups; groups--, out += 10, ch += 8 )
+    BITPACK_PACK8( ch, out, 10 );
+}
+
+void
+BITPACK_pack11( const uint16_t *ch, uint8_t *out, uint8_t groups )
+{
+  for( ; groups; groups--, out += 11, ch += 8 )
+    BITPACK_PACK8( ch, out, 11 );
+}
+
+void
+BITPACK_pack12( const uint16_t *ch, uint8_t *out, uint8_t groups )
+{
+  for( ; groups; groups--, out += 12, ch += 8 )
+    BITPACK_PACK8( ch, out, 12 );
+}
+
+
+#endif /* __STM32F030_CMSIS_BITPACK_LIB_C */
@@ -0,0 +1,379 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-CFG-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Versioned runtime configuration in flash, described by a compile-time schema
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    The application lists its settings once, before including this file:
+//
+//      #define CFG_VERSION 1
+//      #define CFG_FIELDS( X )  X( 1, uint32_t, baud, 112500, 1200, CLOCK_hz / 16 )
+//                               X( 2, uint16_t, ledMs, 500, 10, 60000 )
+//
+//    Each entry is ( id, type, name, default, min, max ), type an unsigned integer of up
+//    to 4 bytes. The list expands into the struct CFG_t, its defaults, a field directory
+//    (id, size, offset) and a range check; min and max may be run time expressions.
+//    Fields are read straight from flash through CFG, so an access is one pointer load
+//    and a constant offset:
+//
+//      USART_init( USART1, CFG->baud );
+//
+//    Field ids must never be reused for a different meaning. Fields may be added,
+//    removed or resized, and CFG_VERSION bumped, freely.
+//
+//    Storage: two flash pages (CONFIG in the linker script). Page A holds the active
+//    configuration, page B is where a new one is built:
+//
+//      header     magic:u32 version:u16 dataLen:u16 count:u8 0xFF crc:u16
+//      data       CFG_t as stored by the firmware that wrote it
+//      directory  count x ( id:u8 size:u8 offset:u16 ), at the next 4 byte boundary
+//
+//    The CRC (CRC-16) covers data and directory; the header is written last, so a page
+//    is either complete or invalid.
+//
+//    Migration: at boot, if page A was written with another schema (version or
+//    directory differs), each current field is looked up by id in A's own directory and
+//    copied if its size is unchanged and the value is in range, otherwise it takes its
+//    default. A page of the current schema with a value out of range is rebuilt the
+//    same way, so a bad setting cannot outlive a reset. The new layout is
+//    streamed into B half-word by half-word straight from A, so no RAM copy of the
+//    configuration is made. B is then copied to A and erased. A valid B found at boot
+//    means this was interrupted, and the copy is repeated. Changing a field at runtime
+//    (CFG_set) uses the same path.
+//
+//    Flash operations block (FLASH_eraseWait/FLASH_programWait), a change takes about
+//    100 ms. FLASH_init must be called before CFG_init.
+//
+//    The host reads and writes fields by id with DMX_TYPE_CFG frames (tools/cfg.py):
+//    id:u8 reads, id:u8 + value sets; the reply is id:u8 + value, or id:u8 alone if the
+//    id is unknown, the value is out of range or could not be stored.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_CFG_LIB_C
+#define __STM32F030_CMSIS_CFG_LIB_C
+
+#include <stddef.h>
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-CRC-lib.c"
+#include "STM32F030-CMSIS-FLASH-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+
+#if !defined( CFG_FIELDS ) || !defined( CFG_VERSION )
+  #error "Define CFG_VERSION and CFG_FIELDS before including STM32F030-CMSIS-CFG-lib.c"
+#endif
+
+
+#define CFG_MAGIC         0x31474643UL    // "CFG1"
+#define CFG_DATA_OFFSET   12
+#define CFG_PAGE_A        ( (uint32_t)_sconfig )
+#define CFG_PAGE_B        ( (uint32_t)_sconfig + FLASH_PAGE_SIZE )
+
+
+#define CFG_MEMBER( id, type, name, value, min, max )   type name;
+#define CFG_DEFAULT( id, type, name, value, min, max )  .name = (value),
+#define CFG_ENTRY( id, type, name, value, min, max )    \
+  { (id), sizeof( type ), offsetof( CFG_t, name ) },
+#define CFG_RANGE( id, type, name, value, min, max )    \
+  case (id): return number >= (min) && number <= (max);
+
+typedef struct
+{
+  CFG_FIELDS( CFG_MEMBER )
+} CFG_t;
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t dataLen;
+  uint8_t  count;
+  uint8_t  reserved;
+  uint16_t crc;
+} CFG_header_t;
+
+typedef struct
+{
+  uint8_t  id;
+  uint8_t  size;
+  uint16_t offset;
+} CFG_field_t;
+
+
+extern const uint8_t _sconfig[];      // From the linker script
+
+static const CFG_t       CFG_defaults = { CFG_FIELDS( CFG_DEFAULT ) };
+static const CFG_field_t CFG_schema[] = { CFG_FIELDS( CFG_ENTRY ) };
+
+#define CFG_COUNT       ( sizeof( CFG_schema ) / sizeof( CFG_schema[ 0 ] ) )
+#define CFG_DIR_OFFSET  ( CFG_DATA_OFFSET + ( ( sizeof( CFG_t ) + 3 ) & ~3 ) )
+
+_Static_assert( CFG_DIR_OFFSET + CFG_COUNT * sizeof( CFG_field_t ) <= FLASH_PAGE_SIZE,
+                "configuration does not fit a flash page" );
+
+const CFG_t *CFG = &CFG_defaults;     // Active configuration (flash page A once valid)
+
+
+//  static const CFG_field_t *
+//  CFG_directory( uint32_t page )
+//  Field directory of a stored configuration.
+static const CFG_field_t *
+CFG_directory( uint32_t page )
+{
+  const CFG_header_t *hdr = (const CFG_header_t *)page;
+
+  return (const CFG_field_t *)( page + CFG_DATA_OFFSET + ( ( hdr->dataLen + 3 ) & ~3 ) );
+}
+
+
+//  static uint8_t
+//  CFG_inRange( const CFG_field_t *field, const uint8_t *src )
+//  Returns 1 if the value at src (field->size bytes, little endian) is within the
+//  field's min and max.
+static uint8_t
+CFG_inRange( const CFG_field_t *field, const uint8_t *src )
+{
+  uint32_t number = 0;
+
+  for( uint8_t x = field->size; x--; )
+    number = ( number << 8 ) | src[ x ];
+  switch( field->id )
+  {
+    CFG_FIELDS( CFG_RANGE )
+  }
+  return 0;
+}
+
+
+//  static uint8_t
+//  CFG_valid( uint32_t page )
+//  Returns 1 if the page holds a complete configuration (of any schema).
+static uint8_t
+CFG_valid( uint32_t page )
+{
+  const CFG_header_t *hdr = (const CFG_header_t *)page;
+  uint32_t            end;
+
+  if( hdr->magic != CFG_MAGIC || hdr->dataLen > FLASH_PAGE_SIZE )
+    return 0;
+  end = (uint32_t)( CFG_directory( page ) + hdr->count );
+  if( end > page + FLASH_PAGE_SIZE )
+    return 0;
+  return CRC16_update( CRC16_INIT, (const void *)( page + CFG_DATA_OFFSET ),
+                       end - page - CFG_DATA_OFFSET ) == hdr->crc;
+}
+
+
+//  static uint8_t
+//  CFG_current( uint32_t page )
+//  Returns 1 if a valid page was written with this firmware's schema.
+static uint8_t
+CFG_current( uint32_t page )
+{
+  const CFG_header_t *hdr = (const CFG_header_t *)page;
+  const CFG_field_t  *dir = CFG_directory( page );
+
+  if( hdr->version != CFG_VERSION || hdr->dataLen != sizeof( CFG_t ) ||
+      hdr->count != CFG_COUNT )
+    return 0;
+  for( uint8_t x = 0; x < CFG_COUNT; x++ )
+    if( dir[ x ].id != CFG_schema[ x ].id || dir[ x ].size != CFG_schema[ x ].size ||
+        dir[ x ].offset != CFG_schema[ x ].offset )
+      return 0;
+  return 1;
+}
+
+
+//  static uint8_t
+//  CFG_inRangeAll( uint32_t page )
+//  Returns 1 if every field of a page with the current schema is in range.
+static uint8_t
+CFG_inRangeAll( uint32_t page )
+{
+  for( uint8_t x = 0; x < CFG_COUNT; x++ )
+    if( !CFG_inRange( &CFG_schema[ x ],
+                      (const uint8_t *)( page + CFG_DATA_OFFSET + CFG_schema[ x ].offset ) ) )
+      return 0;
+  return 1;
+}
+
+
+//  static const uint8_t *
+//  CFG_source( uint32_t page, const CFG_field_t *field )
+//  Where the value of field comes from: page (a valid stored configuration, or 0) if it
+//  has the same id and size there and the value is in range, else the default.
+static const uint8_t *
+CFG_source( uint32_t page, const CFG_field_t *field )
+{
+  const CFG_header_t *hdr;
+  const CFG_field_t  *dir;
+  const uint8_t      *src;
+
+  if( page )
+  {
+    hdr = (const CFG_header_t *)page;
+    dir = CFG_directory( page );
+    for( uint8_t x = 0; x < hdr->count; x++ )
+      if( dir[ x ].id == field->id && dir[ x ].size == field->size &&
+          dir[ x ].offset + dir[ x ].size <= hdr->dataLen )
+      {
+        src = (const uint8_t *)( page + CFG_DATA_OFFSET + dir[ x ].offset );
+        if( CFG_inRange( field, src ) )
+          return src;
+        break;
+      }
+  }
+  return (const uint8_t *)&CFG_defaults + field->offset;
+}
+
+
+//  static int8_t
+//  CFG_build( uint32_t from, uint8_t id, const uint8_t *value )
+//  Write a configuration with the current schema into page B, taking each field from
+//  value (field id only), the page at from (0 = none) or the defaults. Returns 0 or -1.
+static int8_t
+CFG_build( uint32_t from, uint8_t id, const uint8_t *value )
+{
+  CFG_header_t   hdr;
+  const uint8_t *src;
+  uint8_t        pair[ 2 ];
+
+  if( FLASH_eraseWait( CFG_PAGE_B ) < 0 )
+    return -1;
+
+  // Data, one half-word at a time. Padding stays 0xFF.
+  for( uint16_t pos = 0; pos < sizeof( CFG_t ); pos += 2 )
+  {
+    pair[ 0 ] = pair[ 1 ] = 0xFF;
+    for( uint8_t x = 0; x < CFG_COUNT; x++ )
+    {
+      const CFG_field_t *field = &CFG_schema[ x ];
+
+      src = field->id == id ? value : CFG_source( from, field );
+      for( uint8_t k = 0; k < 2; k++ )
+        if( pos + k >= field->offset && pos + k < field->offset + field->size )
+          pair[ k ] = src[ pos + k - field->offset ];
+    }
+    if( ( pair[ 0 ] != 0xFF || pair[ 1 ] != 0xFF ) &&
+        FLASH_programWait( CFG_PAGE_B + CFG_DATA_OFFSET + pos, pair, 2 ) < 0 )
+      return -1;
+  }
+
+  if( FLASH_programWait( CFG_PAGE_B + CFG_DIR_OFFSET, CFG_schema, sizeof( CFG_schema ) ) < 0 )
+    return -1;
+
+  hdr.magic    = CFG_MAGIC;
+  hdr.version  = CFG_VERSION;
+  hdr.dataLen  = sizeof( CFG_t );
+  hdr.count    = CFG_COUNT;
+  hdr.reserved = 0xFF;
+  hdr.crc      = CRC16_update( CRC16_INIT, (const void *)( CFG_PAGE_B + CFG_DATA_OFFSET ),
+                               CFG_DIR_OFFSET - CFG_DATA_OFFSET + sizeof( CFG_schema ) );
+  return FLASH_programWait( CFG_PAGE_B, &hdr, sizeof( hdr ) );
+}
+
+
+//  static int8_t
+//  CFG_commit( void )
+//  Copy the configuration in page B to page A and erase B. Returns 0 or -1.
+static int8_t
+CFG_commit( void )
+{
+  const CFG_header_t *hdr = (const CFG_header_t *)CFG_PAGE_B;
+  uint16_t            len;
+
+  len = (uint32_t)( CFG_directory( CFG_PAGE_B ) + hdr->count ) - CFG_PAGE_B;
+
+  if( FLASH_eraseWait( CFG_PAGE_A ) < 0 ||
+      FLASH_programWait( CFG_PAGE_A, (const void *)CFG_PAGE_B, ( len + 1 ) & ~1 ) < 0 ||
+      !CFG_valid( CFG_PAGE_A ) )
+    return -1;
+  return FLASH_eraseWait( CFG_PAGE_B );
+}
+
+
+//  int8_t
+//  CFG_init( void )
+//  Finish an interrupted change, migrate an older layout (or replace values out of
+//  range) or write the defaults, and point CFG at the stored configuration. Returns 0,
+//  or -1 if flash failed (CFG then points at the defaults).
+int8_t
+CFG_init( void )
+{
+  CFG = &CFG_defaults;
+
+  if( CFG_valid( CFG_PAGE_B ) && CFG_commit() < 0 )
+    return -1;
+  if( !CFG_valid( CFG_PAGE_A ) || !CFG_current( CFG_PAGE_A ) ||
+      !CFG_inRangeAll( CFG_PAGE_A ) )
+    if( CFG_build( CFG_valid( CFG_PAGE_A ) ? CFG_PAGE_A : 0, 0, 0 ) < 0 || CFG_commit() < 0 )
+      return -1;
+
+  CFG = (const CFG_t *)( CFG_PAGE_A + CFG_DATA_OFFSET );
+  return 0;
+}
+
+
+//  const CFG_field_t *
+//  CFG_field( uint8_t id )
+//  Schema entry of a field, or 0 if there is no field with that id.
+const CFG_field_t *
+CFG_field( uint8_t id )
+{
+  for( uint8_t x = 0; x < CFG_COUNT; x++ )
+    if( CFG_schema[ x ].id == id )
+      return &CFG_schema[ x ];
+  return 0;
+}
+
+
+//  int8_t
+//  CFG_set( uint8_t id, const void *value )
+//  Store a new value (CFG_field( id )->size bytes, little endian) for one field. Most
+//  fields take effect after a reset. Returns 0, or -1 for an unknown id, a value out of
+//  range or a flash error.
+int8_t
+CFG_set( uint8_t id, const void *value )
+{
+  const CFG_field_t *field = CFG_field( id );
+
+  if( !field || !CFG_inRange( field, value ) ||
+      CFG != (const CFG_t *)( CFG_PAGE_A + CFG_DATA_OFFSET ) )
+    return -1;
+  if( CFG_build( CFG_PAGE_A, id, value ) < 0 )
+    return -1;
+  if( CFG_commit() < 0 )
+  {
+    // Page A may be gone; run from the copy in B until the next boot retries
+    CFG = CFG_valid( CFG_PAGE_B ) ? (const CFG_t *)( CFG_PAGE_B + CFG_DATA_OFFSET )
+                                  : &CFG_defaults;
+    return -1;
+  }
+  return 0;
+}
+
+
+//  void
+//  CFG_request( const uint8_t *payload, uint8_t len )
+//  Handle a DMX_TYPE_CFG frame: read or set one field and reply with its value.
+void
+CFG_request( const uint8_t *payload, uint8_t len )
+{
+  const CFG_field_t *field = len ? CFG_field( payload[ 0 ] ) : 0;
+  uint8_t            reply[ 1 + 4 ];
+  uint8_t            size = 0;
+
+  if( !len )
+    return;
+  reply[ 0 ] = payload[ 0 ];
+  if( field && field->size < sizeof( reply ) &&
+      ( len == 1 || ( len == 1 + field->size && CFG_set( field->id, payload + 1 ) == 0 ) ) )
+  {
+    size = field->size;
+    for( uint8_t x = 0; x < size; x++ )
+      reply[ 1 + x ] = ( (const uint8_t *)CFG )[ field->offset + x ];
+  }
+  DMX_sendFrame( DMX_TYPE_CFG, reply, 1 + size );
+}
+
+
+#endif /* __STM32F030_CMSIS_CFG_LIB_C */
@@ -0,0 +1,125 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-CLOCK-lib.c
+//  ------------------------------------------------------------------------------------------
+//  System clock: HSI or an external crystal, with clock security system failover
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    CLOCK_hz is the core (= AHB = APB) clock that the baud rate, SysTick and timer
+//    settings are computed from. Without CLOCK_HSE_HZ the part runs from HSI, 8 MHz.
+//
+//    With a crystal (make HSE=<Hz>, 4..32 MHz, defines CLOCK_HSE_HZ) CLOCK_init starts
+//    HSE, enables the clock security system and runs the core from HSE directly. Should
+//    the crystal stop, the hardware switches the core to HSI and raises the NMI.
+//    NMI_Handler then runs the PLL from HSI / 2 at the multiple closest to the crystal
+//    (the same clock for crystals that are a multiple of 4 MHz; the PLL does not go below
+//    16 MHz), sets CLOCK_hz and calls the retime function given to CLOCK_init, which
+//    loads the new divisors:
+//
+//      void retime( void ) { USART_setBaud( USART_baud ); SysTick_retime(); PROF_retime(); }
+//      ...
+//      POST_run();
+//      CLOCK_init( retime );                   // before USART_init and SysTick_init
+//      ...
+//      if( CLOCK_failed ) ...                  // main loop: log it
+//
+//    If HSE does not start within about 100 ms, CLOCK_init stays on HSI, sets
+//    CLOCK_failed and returns -1. HSI is trimmed to +-1 %, good enough for the UART.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_CLOCK_LIB_C
+#define __STM32F030_CMSIS_CLOCK_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define CLOCK_HSI_HZ        8000000UL
+#define CLOCK_NOSTART       1               // CLOCK_failed: HSE did not start
+#define CLOCK_LOST          2               // CLOCK_failed: HSE stopped, now on HSI PLL
+
+#ifdef CLOCK_HSE_HZ
+  #if CLOCK_HSE_HZ < 4000000 || CLOCK_HSE_HZ > 32000000
+    #error "CLOCK_HSE_HZ must be 4..32 MHz"
+  #endif
+  #define CLOCK_HSE_TIMEOUT 0x20000         // Polls of HSERDY, ~100 ms at 8 MHz
+  #define CLOCK_PLL_MUL     ( CLOCK_HSE_HZ < 14000000 ? 4 :                           \
+                              ( CLOCK_HSE_HZ + CLOCK_HSI_HZ / 4 ) / ( CLOCK_HSI_HZ / 2 ) )
+  #define CLOCK_PLL_HZ      ( CLOCK_PLL_MUL * CLOCK_HSI_HZ / 2 )
+#endif
+
+
+uint32_t          CLOCK_hz = CLOCK_HSI_HZ;  // Core, AHB and APB clock
+volatile uint8_t  CLOCK_failed;             // CLOCK_NOSTART or CLOCK_LOST, 0 = fine
+void            (*CLOCK_retime)( void );
+
+
+//  static void
+//  CLOCK_latency( uint32_t hz )
+//  One flash wait state (and prefetch) above 24 MHz. Set before raising the clock.
+static void
+CLOCK_latency( uint32_t hz )
+{
+  if( hz > 24000000 )
+    FLASH->ACR |= FLASH_ACR_LATENCY | FLASH_ACR_PRFTBE;
+}
+
+
+//  int8_t
+//  CLOCK_init( void (*retime)( void ) )
+//  Switch to the crystal if there is one (CLOCK_HSE_HZ). retime is called from the NMI
+//  after a clock failure. Returns 0, or -1 if HSE did not start (running on HSI).
+int8_t
+CLOCK_init( void (*retime)( void ) )
+{
+  CLOCK_retime = retime;
+#ifdef CLOCK_HSE_HZ
+  uint32_t n = CLOCK_HSE_TIMEOUT;
+
+  RCC->CR |= RCC_CR_HSEON;
+  while( !( RCC->CR & RCC_CR_HSERDY ) && --n ) ;
+  if( !n )
+  {
+    RCC->CR &= ~RCC_CR_HSEON;
+    CLOCK_failed = CLOCK_NOSTART;
+    return -1;
+  }
+  RCC->CR |= RCC_CR_CSSON;
+  CLOCK_latency( CLOCK_HSE_HZ );
+  RCC->CFGR = ( RCC->CFGR & ~RCC_CFGR_SW ) | RCC_CFGR_SW_HSE;
+  while( ( RCC->CFGR & RCC_CFGR_SWS ) != RCC_CFGR_SWS_HSE ) ;
+  CLOCK_hz = CLOCK_HSE_HZ;
+#endif
+  return 0;
+}
+
+
+#ifdef CLOCK_HSE_HZ
+//  void
+//  NMI_Handler( void )
+//  Clock security system: HSE has failed and the hardware has put the core on HSI. Move
+//  to the HSI PLL and retime the peripherals.
+void
+NMI_Handler( void )
+{
+  if( !( RCC->CIR & RCC_CIR_CSSF ) )
+    return;
+  RCC->CIR |= RCC_CIR_CSSC;               // Else the NMI stays pending
+
+  RCC->CR &= ~RCC_CR_PLLON;
+  while( RCC->CR & RCC_CR_PLLRDY ) ;
+  RCC->CFGR = ( RCC->CFGR & ~( RCC_CFGR_PLLSRC | RCC_CFGR_PLLMUL ) ) |
+              RCC_CFGR_PLLSRC_HSI_DIV2 | ( ( CLOCK_PLL_MUL - 2 ) << RCC_CFGR_PLLMUL_Pos );
+  RCC->CR |= RCC_CR_PLLON;
+  while( !( RCC->CR & RCC_CR_PLLRDY ) ) ;
+  CLOCK_latency( CLOCK_PLL_HZ );
+  RCC->CFGR = ( RCC->CFGR & ~RCC_CFGR_SW ) | RCC_CFGR_SW_PLL;
+  while( ( RCC->CFGR & RCC_CFGR_SWS ) != RCC_CFGR_SWS_PLL ) ;
+
+  CLOCK_hz     = CLOCK_PLL_HZ;
+  CLOCK_failed = CLOCK_LOST;
+  if( CLOCK_retime )
+    CLOCK_retime();
+}
+#endif /* CLOCK_HSE_HZ */
+
+
+#endif /* __STM32F030_CMSIS_CLOCK_LIB_C */
@@ -0,0 +1,161 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-COBS-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Consistent Overhead Byte Stuffing for binary frames on a text-capable serial port
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    COBS removes every 0x00 from a block of data at a cost of one byte per 254, so 0x00
+//    can be used as an unambiguous frame delimiter. The data is split at each zero and
+//    every block is prefixed with a code byte holding the distance to the next zero:
+//
+//      11 22 00 33        ->  03 11 22 02 33
+//      11 00 00           ->  02 11 01 01
+//
+//    The decoder is streaming: it is fed one byte at a time as bytes arrive, so a frame
+//    never has to be stored in encoded form.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_COBS_LIB_C
+#define __STM32F030_CMSIS_COBS_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+// Worst case encoded size of len bytes
+#define COBS_MAX_ENCODED( len )   ( (len) + (len) / 254 + 1 )
+
+
+typedef struct
+{
+  uint8_t *out;           // Decoded data buffer
+  uint16_t size;          // Size of out
+  uint16_t len;           // Decoded bytes so far
+  uint8_t  remaining;     // Data bytes left in the current block, 0 = code byte expected
+  uint8_t  zeroPending;   // Current block ends in a zero (unless it is the last block)
+  uint8_t  error;         // Output overflowed or a stray code was seen
+} COBS_decoder_t;
+
+
+//  uint16_t
+//  COBS_encode( const uint8_t *src, uint16_t len, uint8_t *dst )
+//  Encode len bytes from src into dst, which must hold COBS_MAX_ENCODED( len ) bytes. No
+//  delimiter is added. Returns the encoded length.
+uint16_t
+COBS_encode( const uint8_t *src, uint16_t len, uint8_t *dst )
+{
+  uint16_t codePos = 0, out = 1;
+  uint8_t  code = 1;
+
+  for( uint16_t x = 0; x < len; x++ )
+  {
+    if( src[ x ] == 0 )
+    {
+      dst[ codePos ] = code;
+      codePos = out++;
+      code    = 1;
+    }
+    else
+    {
+      dst[ out++ ] = src[ x ];
+      if( ++code == 0xFF )
+      {
+        dst[ codePos ] = code;
+        codePos = out++;
+        code    = 1;
+      }
+    }
+  }
+  dst[ codePos ] = code;
+  return out;
+}
+
+
+//  void
+//  COBS_start( COBS_decoder_t *dec, uint8_t *out, uint16_t size )
+//  Prepare dec to decode one frame into out (size bytes).
+void
+COBS_start( COBS_decoder_t *dec, uint8_t *out, uint16_t size )
+{
+  dec->out         = out;
+  dec->size        = size;
+  dec->len         = 0;
+  dec->remaining   = 0;
+  dec->zeroPending = 0;
+  dec->error       = 0;
+}
+
+
+//  void
+//  COBS_feed( COBS_decoder_t *dec, uint8_t b )
+//  Decode one encoded (non-zero) byte. Errors are latched in dec->error.
+void
+COBS_feed( COBS_decoder_t *dec, uint8_t b )
+{
+  if( dec->remaining == 0 )                 // Code byte starts a new block
+  {
+    if( dec->zeroPending )
+    {
+      if( dec->len >= dec->size )
+        dec->error = 1;
+      else
+        dec->out[ dec->len++ ] = 0;
+    }
+    dec->remaining   = b - 1;
+    dec->zeroPending = ( b != 0xFF );
+  }
+  else
+  {
+    if( dec->len >= dec->size )
+      dec->error = 1;
+    else
+      dec->out[ dec->len++ ] = b;
+    dec->remaining--;
+  }
+}
+
+
+//  void
+//  COBS_feedRun( COBS_decoder_t *dec, const uint8_t *data, uint16_t len )
+//  Decode a run of encoded (non-zero) bytes. The data bytes of each block are copied in
+//  one pass; only the code bytes go through COBS_feed.
+void
+COBS_feedRun( COBS_decoder_t *dec, const uint8_t *data, uint16_t len )
+{
+  uint16_t count;
+
+  while( len )
+  {
+    if( dec->remaining == 0 )
+    {
+      COBS_feed( dec, *data++ );
+      len--;
+      continue;
+    }
+
+    count = dec->remaining < len ? dec->remaining : len;
+    if( dec->len + count > dec->size )
+      dec->error = 1;
+    else
+      for( uint16_t x = 0; x < count; x++ )
+        dec->out[ dec->len++ ] = data[ x ];
+    dec->remaining -= count;
+    data += count;
+    len  -= count;
+  }
+}
+
+
+//  int16_t
+//  COBS_finish( COBS_decoder_t *dec )
+//  Called at the frame delimiter. Returns the decoded length, or -1 if the frame was
+//  truncated or did not fit.
+int16_t
+COBS_finish( COBS_decoder_t *dec )
+{
+  if( dec->error || dec->remaining )
+    return -1;
+  return dec->len;
+}
+
+
+#endif /* __STM32F030_CMSIS_COBS_LIB_C */
@@ -0,0 +1,59 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-CRC-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Checksums for serial frames
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF, no reflection, no final
+//    XOR) computed four bits at a time from a 16 entry table. The table costs 32 bytes of
+//    flash instead of 512 for a byte-wide table and needs two lookups per byte.
+//
+//      CRC16_update( CRC16_INIT, "123456789", 9 ) == 0x29B1
+//
+//    The host side uses the same CRC (binascii.crc_hqx( data, 0xFFFF ) in Python).
+//
+//    CRC16_update selects CRC16_update_c or, when built with ASM_KERNELS, the Thumb-1
+//    twin CRC16_update_asm from kernels_cortexm0.s.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_CRC_LIB_C
+#define __STM32F030_CMSIS_CRC_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define CRC16_INIT  0xFFFF
+
+#ifdef ASM_KERNELS
+  uint16_t CRC16_update_asm( uint16_t crc, const void *data, uint32_t len );
+  #define CRC16_update CRC16_update_asm
+#else
+  #define CRC16_update CRC16_update_c
+#endif
+
+
+static const uint16_t CRC16_table[ 16 ] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+
+//  uint16_t
+//  CRC16_update_c( uint16_t crc, const void *data, uint32_t len )
+//  Continue a CRC-16/CCITT-FALSE over len bytes. Start with crc = CRC16_INIT.
+uint16_t
+CRC16_update_c( uint16_t crc, const void *data, uint32_t len )
+{
+  const uint8_t *p = data;
+
+  while( len-- )
+  {
+    crc = ( crc << 4 ) ^ CRC16_table[ ( crc >> 12 ) ^ ( *p >> 4 ) ];
+    crc = ( crc << 4 ) ^ CRC16_table[ ( crc >> 12 ) ^ ( *p++ & 0x0F ) ];
+  }
+  return crc;
+}
+
+
+#endif /* __STM32F030_CMSIS_CRC_LIB_C */
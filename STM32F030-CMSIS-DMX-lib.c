@@ -0,0 +1,280 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-DMX-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Text console and binary frames sharing USART1
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    A human console and a machine protocol use the same port without reflashing. Text
+//    never contains 0x00, so 0x00 is used as the frame marker:
+//
+//      Frame on the wire:  00 | COBS( type, payload..., CRC16 high, CRC16 low ) | 00
+//
+//    The CRC is CRC-16/CCITT-FALSE over type and payload. Payloads are at most
+//    DMX_MAX_PAYLOAD bytes.
+//
+//    Receive: DMX_poll() walks the unread bytes of its own RXF reader in place. In text
+//    state, runs of bytes up to the next 0x00 go to the line editor (the non-blocking
+//    equivalent of USART_gets: printable characters are echoed, DEL erases, <Enter>
+//    completes the line). A 0x00 switches to frame state, where the run up to the closing
+//    0x00 is fed to the streaming COBS decoder. Markers and runs of printable text are
+//    found with the word-at-a-time scans of the SWAR lib. A complete frame with a good
+//    CRC goes to the frame handler; damaged frames are counted and dropped. Repeated 0x00
+//    bytes are empty frames and are skipped, so a host can always resynchronize by
+//    sending 0x00.
+//
+//    Transmit: console output is queued as bulk text; frames are encoded in one piece and
+//    queued as urgent (or, for bulk transfers, queued whole behind the text with
+//    DMX_sendBulk), so a frame is never split by text and text never contains the
+//    marker. The host separates the two streams the same way (see tools/dmx.py).
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_DMX_LIB_C
+#define __STM32F030_CMSIS_DMX_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-USART-TXQ-lib.c"
+#include "STM32F030-CMSIS-USART-RXF-lib.c"
+#include "STM32F030-CMSIS-COBS-lib.c"
+#include "STM32F030-CMSIS-CRC-lib.c"
+#include "STM32F030-CMSIS-SWAR-lib.c"
+
+
+#define DMX_LINE_SIZE     64    // Console line buffer including the terminating null
+#define DMX_MAX_PAYLOAD   56    // Largest frame payload
+#define DMX_MARKER        0x00
+
+#define DMX_RAW_SIZE      ( DMX_MAX_PAYLOAD + 3 )   // Type + payload + CRC
+#define DMX_FRAME_SIZE    ( COBS_MAX_ENCODED( DMX_RAW_SIZE ) + 2 )
+
+// Frame types. Keep in sync with tools/dmx.py.
+#define DMX_TYPE_PING     0x01  // Echoed back unchanged
+#define DMX_TYPE_TSYNC    0x02  // Clock synchronization, see STM32F030-CMSIS-TSYNC-lib.c
+#define DMX_TYPE_REC      0x03  // Flight recorder download, see STM32F030-CMSIS-REC-lib.c
+#define DMX_TYPE_CFG      0x04  // Configuration fields, see STM32F030-CMSIS-CFG-lib.c
+#define DMX_TYPE_PROF     0x05  // Sampling profiler, see STM32F030-CMSIS-PROF-lib.c
+#define DMX_TYPE_BERT     0x06  // Bit error rate test, see STM32F030-CMSIS-BERT-lib.c
+#define DMX_TYPE_LAT      0x07  // Latency and throughput test, see STM32F030-CMSIS-LAT-lib.c
+
+
+// void
+// DMX_line_t( char *line, uint8_t len )
+// Receives a completed, null terminated console line.
+typedef void (*DMX_line_t)( char *line, uint8_t len );
+
+// void
+// DMX_frame_t( uint8_t type, const uint8_t *payload, uint8_t len )
+// Receives the type and payload of a frame with a good CRC.
+typedef void (*DMX_frame_t)( uint8_t type, const uint8_t *payload, uint8_t len );
+
+
+RXF_reader_t   DMX_reader;
+DMX_line_t     DMX_lineHandler;
+DMX_frame_t    DMX_frameHandler;
+
+uint8_t        DMX_inFrame;                 // 1 after an opening marker
+COBS_decoder_t DMX_decoder;
+uint8_t        DMX_raw[ DMX_RAW_SIZE ];     // Decoded frame
+
+char           DMX_line[ DMX_LINE_SIZE ];
+uint8_t        DMX_linePos;
+
+uint16_t       DMX_badFrames;               // Frames dropped for CRC, length or overflow
+
+
+//  uint8_t
+//  DMX_init( DMX_line_t lineHandler, DMX_frame_t frameHandler )
+//  Attach the demultiplexer to the RX ring. RXF_init and TXQ_init must have been called.
+//  Returns 0 if no RX reader slot was free.
+uint8_t
+DMX_init( DMX_line_t lineHandler, DMX_frame_t frameHandler )
+{
+  DMX_lineHandler  = lineHandler;
+  DMX_frameHandler = frameHandler;
+  DMX_inFrame      = 0;
+  DMX_linePos      = 0;
+  DMX_badFrames    = 0;
+
+  return RXF_attach( &DMX_reader );
+}
+
+
+//  void
+//  DMX_text( const uint8_t *data, uint16_t len )
+//  Line editor: process a run of console bytes.
+static void
+DMX_text( const uint8_t *data, uint16_t len )
+{
+  uint16_t x = 0, span, fit;
+
+  while( x < len )
+  {
+    uint8_t c = data[ x ];
+
+    // Printable run: append and echo what fits in one go, drop the rest
+    span = SWAR_spanPrintable( &data[ x ], len - x );
+    if( span )
+    {
+      fit = DMX_LINE_SIZE - 1 - DMX_linePos;
+      if( fit > span )
+        fit = span;
+      for( uint16_t y = 0; y < fit; y++ )
+        DMX_line[ DMX_linePos++ ] = data[ x + y ];
+      TXQ_bulk( &data[ x ], fit );          // Echo
+      x += span;
+      continue;
+    }
+
+    x++;
+    if( c == 127 && DMX_linePos > 0 )       // Backspace
+    {
+      DMX_linePos--;
+      TXQ_bulk( &c, 1 );
+    }
+    else if( c == 13 )                      // <Enter>
+    {
+      DMX_line[ DMX_linePos ] = 0x00;
+      TXQ_puts( "\r\n" );
+      if( DMX_lineHandler )
+        DMX_lineHandler( DMX_line, DMX_linePos );
+      DMX_linePos = 0;
+    }
+  }
+}
+
+
+//  void
+//  DMX_endFrame( void )
+//  Closing marker seen: check and dispatch the decoded frame.
+static void
+DMX_endFrame( void )
+{
+  int16_t  len = COBS_finish( &DMX_decoder );
+  uint16_t crc;
+
+  if( len == 0 )                            // 00 00, treat as a new opening marker
+    return;
+
+  DMX_inFrame = 0;
+  if( len < 3 )
+  {
+    DMX_badFrames++;
+    return;
+  }
+
+  crc = CRC16_update( CRC16_INIT, DMX_raw, len - 2 );
+  if( DMX_raw[ len - 2 ] != ( crc >> 8 ) || DMX_raw[ len - 1 ] != ( crc & 0xFF ) )
+  {
+    DMX_badFrames++;
+    return;
+  }
+
+  if( DMX_frameHandler )
+    DMX_frameHandler( DMX_raw[ 0 ], &DMX_raw[ 1 ], len - 3 );
+}
+
+
+//  void
+//  DMX_poll( void )
+//  Route all unread received bytes to the line editor or the frame decoder. Call this from
+//  the main loop.
+void
+DMX_poll( void )
+{
+  const uint8_t *data;
+  uint16_t       count, run;
+
+  while( ( count = RXF_span( &DMX_reader, &data ) ) )
+  {
+    // Length of the run up to (not including) the next marker
+    run = SWAR_findByte( data, count, DMX_MARKER );
+
+    if( DMX_inFrame )
+      COBS_feedRun( &DMX_decoder, data, run );
+    else
+      DMX_text( data, run );
+
+    if( run < count )                       // Marker
+    {
+      if( DMX_inFrame )
+        DMX_endFrame();
+      else
+        DMX_inFrame = 1;
+      if( DMX_inFrame )
+        COBS_start( &DMX_decoder, DMX_raw, DMX_RAW_SIZE );
+      run++;
+    }
+    RXF_consume( &DMX_reader, run );
+  }
+}
+
+
+//  void
+//  DMX_flush( void )
+//  Drop all unread input and any partial line or frame, e.g. after something else has
+//  used the port.
+void
+DMX_flush( void )
+{
+  RXF_consume( &DMX_reader, RXF_available( &DMX_reader ) );
+  DMX_inFrame = 0;
+  DMX_linePos = 0;
+}
+
+
+//  static uint8_t
+//  DMX_encode( uint8_t type, const void *payload, uint8_t len, uint8_t *frame )
+//  Build the complete frame including both markers. Returns its length.
+static uint8_t
+DMX_encode( uint8_t type, const void *payload, uint8_t len, uint8_t *frame )
+{
+  uint8_t  raw[ DMX_RAW_SIZE ];
+  uint16_t crc, n;
+
+  raw[ 0 ] = type;
+  for( uint8_t x = 0; x < len; x++ )
+    raw[ x + 1 ] = ( (const uint8_t *)payload )[ x ];
+  crc = CRC16_update( CRC16_INIT, raw, len + 1 );
+  raw[ len + 1 ] = crc >> 8;
+  raw[ len + 2 ] = crc & 0xFF;
+
+  frame[ 0 ] = DMX_MARKER;
+  n = COBS_encode( raw, len + 3, &frame[ 1 ] ) + 1;
+  frame[ n++ ] = DMX_MARKER;
+  return n;
+}
+
+
+//  uint8_t
+//  DMX_sendFrame( uint8_t type, const void *payload, uint8_t len )
+//  Send a frame ahead of any queued console text. Returns 1 if queued, 0 if the payload is
+//  too long or the urgent queue is full.
+uint8_t
+DMX_sendFrame( uint8_t type, const void *payload, uint8_t len )
+{
+  uint8_t frame[ DMX_FRAME_SIZE ];
+
+  if( len > DMX_MAX_PAYLOAD )
+    return 0;
+  return TXQ_urgent( frame, DMX_encode( type, payload, len, frame ) );
+}
+
+
+//  uint8_t
+//  DMX_sendBulk( uint8_t type, const void *payload, uint8_t len )
+//  Send a frame in turn with the console text, for large transfers (dumps, downloads)
+//  that must not hold up urgent frames. Returns 1 if queued, 0 if the payload is too long
+//  or the bulk queue has no room for the whole frame.
+uint8_t
+DMX_sendBulk( uint8_t type, const void *payload, uint8_t len )
+{
+  uint8_t frame[ DMX_FRAME_SIZE ];
+  uint8_t n;
+
+  if( len > DMX_MAX_PAYLOAD || TXQ_bulkFree() < DMX_FRAME_SIZE )
+    return 0;
+  n = DMX_encode( type, payload, len, frame );
+  return TXQ_bulk( frame, n ) == n;
+}
+
+
+#endif /* __STM32F030_CMSIS_DMX_LIB_C */
@@ -0,0 +1,367 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-DPATCH-lib.c
+//  ------------------------------------------------------------------------------------------
+//  In-place delta patching of the flash image, one page at a time through a scratch page
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    tools/delta.py compares the image on the device (found by its IMG header) with a new
+//    build and emits a patch that rebuilds the new image page by page from the old one.
+//    Most of the old image survives a release at the same or a nearby address, so the
+//    patch is mostly ADD operations with zero difference bytes and compresses well (LZ).
+//
+//      header   'D' 'P' pages:u8 flags:u8 oldLength:u32 oldCrc:u32 newLength:u32 newCrc:u32
+//      crcs     pages x CRC16 of each new page (1K, padded with 0xFF)
+//      ops      for every page in processing order, until 1024 bytes are produced:
+//                 0x01 len:u16 src:u16 diff[len]   new = old[ src + k ] + diff[ k ]
+//                 0x02 len:u16 data[len]           new = data[ k ]
+//
+//    Each page is built in the scratch page (the last flash page) and only then copied
+//    over its target, so the old data a page is built from is never erased early. Pages
+//    are processed first to last, or last to first if flags has DPATCH_REVERSE (code
+//    that grew moves up in memory). The patch only refers to old pages that are not
+//    overwritten yet:
+//
+//      forward:  src >= page * 1024           reverse:  src + len <= ( page + 1 ) * 1024
+//
+//    Progress markers are the page CRCs. A page whose flash already matches its CRC is
+//    done and skipped; a scratch page matching the CRC of the next page means power
+//    failed while copying it, and the copy is simply repeated. After a power failure the
+//    same patch is sent again from the start and resumes where it stopped.
+//
+//    Flash access goes through the erase/program callbacks, which must return when the
+//    operation is finished (0 = ok, -1 = error). Reading old data while it is patched
+//    means the code doing this must not run from the image being patched, so this is
+//    meant for a bootloader (or code copied to RAM).
+//
+//    Usage:
+//      DPATCH_start( FLASH_BASE, (uint32_t)&_sscratch, FLASH_eraseWait, FLASH_programWait );
+//      DPATCH_feed( data, len );              // for every chunk received, or as LZ sink
+//      if( DPATCH_finish() < 0 ) ...          // DPATCH_error tells why
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_DPATCH_LIB_C
+#define __STM32F030_CMSIS_DPATCH_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-CRC-lib.c"
+#include "STM32F030-CMSIS-IMG-lib.c"
+
+
+#define DPATCH_PAGE_SIZE    1024
+#define DPATCH_MAX_PAGES    ( IMG_MAX_LENGTH / DPATCH_PAGE_SIZE )
+#define DPATCH_HEADER_SIZE  20
+#define DPATCH_CHUNK        16      // Bytes programmed per call, divides DPATCH_PAGE_SIZE
+
+#define DPATCH_REVERSE      0x01    // flags: pages are processed last to first
+
+#define DPATCH_OP_ADD       0x01
+#define DPATCH_OP_INSERT    0x02
+
+enum { DPATCH_OK, DPATCH_EFORMAT, DPATCH_EBASE, DPATCH_EFLASH, DPATCH_EVERIFY };
+enum { DPATCH_HEADER, DPATCH_CRCS, DPATCH_OP, DPATCH_ARGS, DPATCH_DATA, DPATCH_DONE };
+
+
+typedef int8_t DPATCH_erase_t( uint32_t addr );
+typedef int8_t DPATCH_program_t( uint32_t addr, const void *data, uint16_t len );
+
+uint32_t          DPATCH_base, DPATCH_scratch;
+DPATCH_erase_t   *DPATCH_erase;
+DPATCH_program_t *DPATCH_program;
+
+uint8_t  DPATCH_hdr[ DPATCH_HEADER_SIZE ];
+uint16_t DPATCH_pageCrc[ DPATCH_MAX_PAGES ];
+uint8_t  DPATCH_pages, DPATCH_flags;
+uint32_t DPATCH_oldLength;
+
+uint8_t  DPATCH_state;
+uint16_t DPATCH_count;          // Header/argument bytes collected or data bytes left
+uint8_t  DPATCH_op, DPATCH_args[ 4 ];
+uint16_t DPATCH_src;
+
+uint8_t  DPATCH_index;          // Pages finished, in processing order
+uint8_t  DPATCH_page;           // Page being processed
+uint16_t DPATCH_fill;           // Bytes of the page produced so far
+uint8_t  DPATCH_build;          // 1 = build in scratch, 0 = ops are skipped
+uint8_t  DPATCH_commit;         // Copy scratch to the page at its end
+uint8_t  DPATCH_buf[ DPATCH_CHUNK ];
+
+uint8_t  DPATCH_error;          // DPATCH_OK or the first error
+
+
+//  static uint32_t
+//  DPATCH_u32( const uint8_t *p )
+//  Little endian 32-bit value at p.
+static uint32_t
+DPATCH_u32( const uint8_t *p )
+{
+  return p[ 0 ] | ( p[ 1 ] << 8 ) | ( p[ 2 ] << 16 ) | ( (uint32_t)p[ 3 ] << 24 );
+}
+
+
+//  static uint16_t
+//  DPATCH_crc( uint32_t addr )
+//  CRC16 of the flash page at addr.
+static uint16_t
+DPATCH_crc( uint32_t addr )
+{
+  return CRC16_update( CRC16_INIT, (const void *)(uintptr_t)addr, DPATCH_PAGE_SIZE );
+}
+
+
+//  static void
+//  DPATCH_beginPage( void )
+//  Decide how the next page is handled: already done, copy a finished scratch page, or
+//  build it.
+static void
+DPATCH_beginPage( void )
+{
+  uint16_t expected;
+
+  DPATCH_page   = DPATCH_flags & DPATCH_REVERSE ? DPATCH_pages - 1 - DPATCH_index : DPATCH_index;
+  DPATCH_fill   = 0;
+  DPATCH_build  = 0;
+  DPATCH_commit = 0;
+  DPATCH_state  = DPATCH_OP;
+  expected = DPATCH_pageCrc[ DPATCH_page ];
+
+  if( DPATCH_crc( DPATCH_base + DPATCH_page * DPATCH_PAGE_SIZE ) == expected )
+    return;
+  if( DPATCH_crc( DPATCH_scratch ) == expected )
+    DPATCH_commit = 1;
+  else if( DPATCH_erase( DPATCH_scratch ) < 0 )
+    DPATCH_error = DPATCH_EFLASH;
+  else
+    DPATCH_build = 1;
+}
+
+
+//  static void
+//  DPATCH_endPage( void )
+//  Check the page built in scratch, copy it over its target and move on.
+static void
+DPATCH_endPage( void )
+{
+  uint32_t addr     = DPATCH_base + DPATCH_page * DPATCH_PAGE_SIZE;
+  uint16_t expected = DPATCH_pageCrc[ DPATCH_page ];
+
+  if( DPATCH_build )
+  {
+    if( DPATCH_crc( DPATCH_scratch ) != expected )
+    {
+      DPATCH_error = DPATCH_EVERIFY;
+      return;
+    }
+    DPATCH_commit = 1;
+  }
+  if( DPATCH_commit )
+  {
+    if( DPATCH_erase( addr ) < 0 ||
+        DPATCH_program( addr, (const void *)(uintptr_t)DPATCH_scratch,
+                        DPATCH_PAGE_SIZE ) < 0 )
+    {
+      DPATCH_error = DPATCH_EFLASH;
+      return;
+    }
+    if( DPATCH_crc( addr ) != expected )
+    {
+      DPATCH_error = DPATCH_EVERIFY;
+      return;
+    }
+  }
+
+  if( ++DPATCH_index == DPATCH_pages )
+    DPATCH_state = DPATCH_DONE;
+  else
+    DPATCH_beginPage();
+}
+
+
+//  static void
+//  DPATCH_header( void )
+//  Check the patch header and that it applies to the image in flash.
+static void
+DPATCH_header( void )
+{
+  uint32_t newLength = DPATCH_u32( &DPATCH_hdr[ 12 ] );
+
+  DPATCH_pages     = DPATCH_hdr[ 2 ];
+  DPATCH_flags     = DPATCH_hdr[ 3 ];
+  DPATCH_oldLength = DPATCH_u32( &DPATCH_hdr[ 4 ] );
+
+  if( DPATCH_hdr[ 0 ] != 'D' || DPATCH_hdr[ 1 ] != 'P' ||
+      DPATCH_pages == 0 || DPATCH_pages > DPATCH_MAX_PAGES ||
+      newLength > DPATCH_pages * DPATCH_PAGE_SIZE ||
+      newLength <= ( DPATCH_pages - 1 ) * DPATCH_PAGE_SIZE ||
+      DPATCH_oldLength > IMG_MAX_LENGTH )
+    DPATCH_error = DPATCH_EFORMAT;
+  DPATCH_state = DPATCH_CRCS;
+  DPATCH_count = 0;
+}
+
+
+//  static uint8_t
+//  DPATCH_baseOk( void )
+//  Returns 1 if flash holds the old image, the new one, or a partly patched one whose
+//  first page is waiting in scratch.
+static uint8_t
+DPATCH_baseOk( void )
+{
+  uint32_t crc = IMG_HEADER( DPATCH_base )->crc;
+
+  return crc == DPATCH_u32( &DPATCH_hdr[ 8 ] ) || crc == DPATCH_u32( &DPATCH_hdr[ 16 ] ) ||
+         DPATCH_crc( DPATCH_scratch ) == DPATCH_pageCrc[ 0 ];
+}
+
+
+//  static void
+//  DPATCH_checkArgs( void )
+//  All arguments of an operation are in; check them.
+static void
+DPATCH_checkArgs( void )
+{
+  uint16_t len = DPATCH_args[ 0 ] | ( DPATCH_args[ 1 ] << 8 );
+  uint32_t pageStart = (uint32_t)DPATCH_page * DPATCH_PAGE_SIZE;
+
+  DPATCH_src = DPATCH_args[ 2 ] | ( DPATCH_args[ 3 ] << 8 );
+  if( len == 0 || len > DPATCH_PAGE_SIZE - DPATCH_fill )
+    DPATCH_error = DPATCH_EFORMAT;
+  else if( DPATCH_op == DPATCH_OP_ADD &&
+           ( DPATCH_src + len > DPATCH_oldLength ||
+             ( DPATCH_flags & DPATCH_REVERSE ? DPATCH_src + len > pageStart + DPATCH_PAGE_SIZE
+                                             : DPATCH_src < pageStart ) ) )
+    DPATCH_error = DPATCH_EFORMAT;        // Old data is gone or not part of the image
+  DPATCH_count = len;
+  DPATCH_state = DPATCH_DATA;
+}
+
+
+//  static void
+//  DPATCH_data( uint8_t b )
+//  One data byte of an operation.
+static void
+DPATCH_data( uint8_t b )
+{
+  uint8_t *chunk = &DPATCH_buf[ DPATCH_fill % DPATCH_CHUNK ];
+
+  if( DPATCH_build )
+  {
+    *chunk = DPATCH_op == DPATCH_OP_ADD ?
+             *(const uint8_t *)(uintptr_t)( DPATCH_base + DPATCH_src ) + b : b;
+    if( chunk == &DPATCH_buf[ DPATCH_CHUNK - 1 ] &&
+        DPATCH_program( DPATCH_scratch + DPATCH_fill + 1 - DPATCH_CHUNK,
+                        DPATCH_buf, DPATCH_CHUNK ) < 0 )
+      DPATCH_error = DPATCH_EFLASH;
+  }
+  DPATCH_src++;
+  DPATCH_fill++;
+
+  if( --DPATCH_count == 0 )
+  {
+    DPATCH_state = DPATCH_OP;
+    if( DPATCH_fill == DPATCH_PAGE_SIZE && DPATCH_error == DPATCH_OK )
+      DPATCH_endPage();                   // Not after a failed program, keep that error
+  }
+}
+
+
+//  static void
+//  DPATCH_byte( uint8_t b )
+//  Run one patch byte through the parser.
+static void
+DPATCH_byte( uint8_t b )
+{
+  switch( DPATCH_state )
+  {
+    case DPATCH_HEADER:
+      DPATCH_hdr[ DPATCH_count++ ] = b;
+      if( DPATCH_count == DPATCH_HEADER_SIZE )
+        DPATCH_header();
+      break;
+
+    case DPATCH_CRCS:
+      if( DPATCH_count & 1 )
+        DPATCH_pageCrc[ DPATCH_count / 2 ] |= b << 8;
+      else
+        DPATCH_pageCrc[ DPATCH_count / 2 ] = b;
+      if( ++DPATCH_count == DPATCH_pages * 2 )
+      {
+        if( !DPATCH_baseOk() )
+          DPATCH_error = DPATCH_EBASE;
+        else
+          DPATCH_beginPage();
+      }
+      break;
+
+    case DPATCH_OP:
+      DPATCH_op    = b;
+      DPATCH_count = 0;
+      DPATCH_state = DPATCH_ARGS;
+      if( b != DPATCH_OP_ADD && b != DPATCH_OP_INSERT )
+        DPATCH_error = DPATCH_EFORMAT;
+      break;
+
+    case DPATCH_ARGS:
+      DPATCH_args[ DPATCH_count++ ] = b;
+      if( DPATCH_count == ( DPATCH_op == DPATCH_OP_ADD ? 4 : 2 ) )
+        DPATCH_checkArgs();
+      break;
+
+    case DPATCH_DATA:
+      DPATCH_data( b );
+      break;
+
+    default:                              // Data after the last page
+      DPATCH_error = DPATCH_EFORMAT;
+  }
+}
+
+
+//  void
+//  DPATCH_start( uint32_t base, uint32_t scratch, DPATCH_erase_t *erase,
+//                DPATCH_program_t *program )
+//  Prepare to patch the image at base, using the flash page at scratch.
+void
+DPATCH_start( uint32_t base, uint32_t scratch, DPATCH_erase_t *erase,
+              DPATCH_program_t *program )
+{
+  DPATCH_base    = base;
+  DPATCH_scratch = scratch;
+  DPATCH_erase   = erase;
+  DPATCH_program = program;
+  DPATCH_state   = DPATCH_HEADER;
+  DPATCH_count   = 0;
+  DPATCH_index   = 0;
+  DPATCH_error   = DPATCH_OK;
+}
+
+
+//  void
+//  DPATCH_feed( const uint8_t *data, uint16_t len )
+//  Apply len bytes of the patch. Matches LZ_sink_t, so a compressed patch can be fed
+//  through LZ_feed. Errors are latched in DPATCH_error and the rest is ignored.
+void
+DPATCH_feed( const uint8_t *data, uint16_t len )
+{
+  while( len-- && DPATCH_error == DPATCH_OK )
+    DPATCH_byte( *data++ );
+}
+
+
+//  int8_t
+//  DPATCH_finish( void )
+//  Called after the last patch byte. Returns 0 if every page was written and the image
+//  matches its new CRC, else -1.
+int8_t
+DPATCH_finish( void )
+{
+  if( DPATCH_error == DPATCH_OK && DPATCH_state != DPATCH_DONE )
+    DPATCH_error = DPATCH_EFORMAT;
+  if( DPATCH_error == DPATCH_OK &&
+      ( IMG_check( DPATCH_base ) < 0 ||
+        IMG_HEADER( DPATCH_base )->crc != DPATCH_u32( &DPATCH_hdr[ 16 ] ) ) )
+    DPATCH_error = DPATCH_EVERIFY;
+  return DPATCH_error == DPATCH_OK ? 0 : -1;
+}
+
+
+#endif /* __STM32F030_CMSIS_DPATCH_LIB_C */
@@ -0,0 +1,279 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-FLASH-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Interrupt driven flash erase and programming with an operation queue
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Page erases and half-word programming are queued and run from the flash interrupt:
+//    the end of operation flag (EOP) starts the next half-word or the next queued
+//    operation, so the caller never polls BSY. Each operation reports its result through
+//    a callback (called from the interrupt):
+//
+//      FLASH_erase( addr, done );              // 1K page at addr, 20..40 ms
+//      FLASH_program( addr, data, len, done ); // len bytes (even), ~50 us per half-word
+//
+//    The data of a program operation is read while the operation runs and must stay
+//    valid until its callback. The flash is unlocked while operations are queued and
+//    locked again when the queue is empty. Errors (PGERR: location not erased,
+//    WRPRTERR: write protected) and half-words that read back wrong fail the operation.
+//
+//    The F030 has a single flash bank and all code runs from it: while an erase or a
+//    half-word write is in progress, the next read from flash (instruction fetch,
+//    constant, vector fetch) stalls the CPU until it finishes, interrupt handlers
+//    included. The queue saves the polling and gives the main loop the time between
+//    half-words, but an erase holds up everything for 20..40 ms. DMA keeps running, so
+//    TXQ bulk output goes on and received bytes collect in the RXF ring, but it holds
+//    256 bytes (about 22 ms at 112500 baud), less than a slow erase. Urgent frames,
+//    TSYNC stamps and SysTick wait, and SysTick_millis falls behind by the length of the
+//    erase. Callers therefore erase only when no traffic is expected: at start-up, on
+//    request of the host (STM32F030-CMSIS-CFG-lib.c), or after the link has been idle
+//    for a while (STM32F030-CMSIS-REC-lib.c).
+//
+//    FLASH_eraseWait and FLASH_programWait queue an operation and wait for it; they
+//    match the DPATCH callbacks.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_FLASH_LIB_C
+#define __STM32F030_CMSIS_FLASH_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define FLASH_PAGE_SIZE   1024
+#define FLASH_SIZE        ( 32 * 1024 )
+#define FLASH_QUEUE_SIZE  4             // Must be a power of two
+
+enum { FLASH_OP_ERASE, FLASH_OP_PROGRAM };
+
+
+// Result of an operation: 0 = done, -1 = failed
+typedef void FLASH_done_t( int8_t status );
+
+typedef struct
+{
+  uint32_t       addr;
+  const uint8_t *data;
+  uint16_t       len;
+  uint8_t        type;
+  FLASH_done_t  *done;
+} FLASH_op_t;
+
+FLASH_op_t        FLASH_queue[ FLASH_QUEUE_SIZE ];
+volatile uint8_t  FLASH_head, FLASH_tail;
+volatile uint8_t  FLASH_active;       // An operation is running
+uint16_t          FLASH_pos;          // Bytes of the running program operation written
+uint16_t          FLASH_errors;       // Failed operations
+
+
+//  void
+//  FLASH_init( void )
+//  Enable the flash interrupt.
+void
+FLASH_init( void )
+{
+  FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+  NVIC_EnableIRQ( FLASH_IRQn );
+}
+
+
+//  static uint16_t
+//  FLASH_halfword( const FLASH_op_t *op )
+//  The next half-word of a program operation (data may be unaligned).
+static uint16_t
+FLASH_halfword( const FLASH_op_t *op )
+{
+  return op->data[ FLASH_pos ] | ( op->data[ FLASH_pos + 1 ] << 8 );
+}
+
+
+//  static void
+//  FLASH_startOp( void )
+//  Start the operation at the tail of the queue.
+static void
+FLASH_startOp( void )
+{
+  const FLASH_op_t *op = &FLASH_queue[ FLASH_tail & ( FLASH_QUEUE_SIZE - 1 ) ];
+
+  if( FLASH->CR & FLASH_CR_LOCK )
+  {
+    FLASH->KEYR = FLASH_KEY1;
+    FLASH->KEYR = FLASH_KEY2;
+  }
+  FLASH_pos = 0;
+  if( op->type == FLASH_OP_ERASE )
+  {
+    FLASH->CR = FLASH_CR_PER | FLASH_CR_EOPIE | FLASH_CR_ERRIE;
+    FLASH->AR = op->addr;
+    FLASH->CR |= FLASH_CR_STRT;
+  }
+  else
+  {
+    FLASH->CR = FLASH_CR_PG | FLASH_CR_EOPIE | FLASH_CR_ERRIE;
+    *(volatile uint16_t *)op->addr = FLASH_halfword( op );
+  }
+}
+
+
+//  void
+//  FLASH_IRQHandler( void )
+//  End of a half-word or erase, or an error. Continues or finishes the running operation
+//  and starts the next one.
+void
+FLASH_IRQHandler( void )
+{
+  const FLASH_op_t *op = &FLASH_queue[ FLASH_tail & ( FLASH_QUEUE_SIZE - 1 ) ];
+  FLASH_done_t     *done;
+  uint32_t          sr = FLASH->SR;
+  int8_t            status = 0;
+
+  FLASH->SR = sr & ( FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR );   // Write 1 to clear
+  if( !FLASH_active )
+    return;
+
+  if( sr & ( FLASH_SR_PGERR | FLASH_SR_WRPRTERR ) )
+    status = -1;
+  else if( op->type == FLASH_OP_PROGRAM )
+  {
+    if( *(volatile uint16_t *)( op->addr + FLASH_pos ) != FLASH_halfword( op ) )
+      status = -1;
+    else if( ( FLASH_pos += 2 ) < op->len )
+    {
+      *(volatile uint16_t *)( op->addr + FLASH_pos ) = FLASH_halfword( op );
+      return;
+    }
+  }
+
+  FLASH->CR = FLASH_CR_EOPIE | FLASH_CR_ERRIE;
+  if( status < 0 )
+    FLASH_errors++;
+  done = op->done;                      // The slot is free once tail moves
+  FLASH_tail++;
+  if( FLASH_head != FLASH_tail )
+    FLASH_startOp();
+  else
+  {
+    FLASH->CR    = FLASH_CR_LOCK;
+    FLASH_active = 0;
+  }
+  if( done )
+    done( status );
+}
+
+
+//  static int8_t
+//  FLASH_queueOp( uint8_t type, uint32_t addr, const void *data, uint16_t len,
+//                 FLASH_done_t *done )
+//  Append an operation and start it if the flash is idle. Returns -1 if the queue is full.
+static int8_t
+FLASH_queueOp( uint8_t type, uint32_t addr, const void *data, uint16_t len,
+               FLASH_done_t *done )
+{
+  uint32_t    primask = __get_PRIMASK();
+  FLASH_op_t *op;
+
+  __disable_irq();
+  if( (uint8_t)( FLASH_head - FLASH_tail ) >= FLASH_QUEUE_SIZE )
+  {
+    __set_PRIMASK( primask );
+    return -1;
+  }
+  op = &FLASH_queue[ FLASH_head & ( FLASH_QUEUE_SIZE - 1 ) ];
+  op->type = type;
+  op->addr = addr;
+  op->data = data;
+  op->len  = len;
+  op->done = done;
+  FLASH_head++;
+  if( !FLASH_active )
+  {
+    FLASH_active = 1;
+    FLASH_startOp();
+  }
+  __set_PRIMASK( primask );
+  return 0;
+}
+
+
+//  int8_t
+//  FLASH_erase( uint32_t addr, FLASH_done_t *done )
+//  Queue the erase of the page at addr (page aligned). done may be 0. Returns -1 if addr
+//  is not a flash page or the queue is full.
+int8_t
+FLASH_erase( uint32_t addr, FLASH_done_t *done )
+{
+  if( addr < FLASH_BASE || addr >= FLASH_BASE + FLASH_SIZE || addr % FLASH_PAGE_SIZE )
+    return -1;
+  return FLASH_queueOp( FLASH_OP_ERASE, addr, 0, 0, done );
+}
+
+
+//  int8_t
+//  FLASH_program( uint32_t addr, const void *data, uint16_t len, FLASH_done_t *done )
+//  Queue programming len bytes (even, at an even addr) of erased flash. done may be 0.
+//  Returns -1 if the range is not in flash or the queue is full.
+int8_t
+FLASH_program( uint32_t addr, const void *data, uint16_t len, FLASH_done_t *done )
+{
+  if( addr < FLASH_BASE || addr + len > FLASH_BASE + FLASH_SIZE || ( addr | len ) & 1 || !len )
+    return -1;
+  return FLASH_queueOp( FLASH_OP_PROGRAM, addr, data, len, done );
+}
+
+
+//  uint8_t
+//  FLASH_pending( void )
+//  Returns the number of queued operations, including the running one.
+uint8_t
+FLASH_pending( void )
+{
+  return FLASH_head - FLASH_tail;
+}
+
+
+volatile int8_t  FLASH_waitStatus;
+volatile uint8_t FLASH_waitDone;
+
+//  static void
+//  FLASH_waited( int8_t status )
+//  Completion callback of the waiting calls.
+static void
+FLASH_waited( int8_t status )
+{
+  FLASH_waitStatus = status;
+  FLASH_waitDone   = 1;
+}
+
+
+//  int8_t
+//  FLASH_eraseWait( uint32_t addr )
+//  FLASH_programWait( uint32_t addr, const void *data, uint16_t len )
+//  Queue the operation behind any others and wait for it. Returns 0 or -1. Not for use
+//  in interrupt handlers.
+int8_t
+FLASH_eraseWait( uint32_t addr )
+{
+  FLASH_waitDone = 0;
+  while( FLASH_pending() >= FLASH_QUEUE_SIZE )
+    ;
+  if( FLASH_erase( addr, FLASH_waited ) < 0 )
+    return -1;
+  while( !FLASH_waitDone )
+    ;
+  return FLASH_waitStatus;
+}
+
+int8_t
+FLASH_programWait( uint32_t addr, const void *data, uint16_t len )
+{
+  FLASH_waitDone = 0;
+  while( FLASH_pending() >= FLASH_QUEUE_SIZE )
+    ;
+  if( FLASH_program( addr, data, len, FLASH_waited ) < 0 )
+    return -1;
+  while( !FLASH_waitDone )
+    ;
+  return FLASH_waitStatus;
+}
+
+
+#endif /* __STM32F030_CMSIS_FLASH_LIB_C */
@@ -0,0 +1,58 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-FMT-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Number formatting into memory buffers
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Formats numbers into a caller supplied buffer so they can be queued (TXQ_bulk, frames)
+//    instead of being written to the USART a character at a time. The output matches
+//    USART_puth: a fixed number of upper case digits, with '.' in place of every digit if
+//    the value does not fit. No terminator is written.
+//
+//    FMT_hex selects FMT_hex_c or, when built with ASM_KERNELS, the Thumb-1 twin
+//    FMT_hex_asm from kernels_cortexm0.s.
+//
+//    Usage:
+//      char text[ 8 ];
+//      TXQ_bulk( text, FMT_hex( text, SysTick_millis(), 8 ) );
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_FMT_LIB_C
+#define __STM32F030_CMSIS_FMT_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#ifdef ASM_KERNELS
+  uint8_t FMT_hex_asm( char *buf, uint32_t number, uint8_t places );
+  #define FMT_hex FMT_hex_asm
+#else
+  #define FMT_hex FMT_hex_c
+#endif
+
+
+//  uint8_t
+//  FMT_hex_c( char *buf, uint32_t number, uint8_t places )
+//  Writes places hex digits of number to buf, or places periods if number needs more
+//  digits. Returns places.
+uint8_t
+FMT_hex_c( char *buf, uint32_t number, uint8_t places )
+{
+  uint8_t  thisDigit;
+  uint32_t oob;     // Non-zero if number has more hex digits than "places"
+
+  oob = places < 8 ? number >> ( places * 4 ) : 0;
+  for( uint8_t x = places; x; x-- )
+  {
+    thisDigit = number & 0xF;
+    if( oob )
+      buf[ x - 1 ] = '.';
+    else
+      buf[ x - 1 ] = thisDigit < 10 ? thisDigit + '0' : thisDigit - 10 + 'A';
+    number >>= 4;
+  }
+  return places;
+}
+
+
+#endif /* __STM32F030_CMSIS_FMT_LIB_C */
@@ -0,0 +1,190 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-IMG-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Firmware image header: identifies the image in flash by version, length and CRC
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Every image carries a 16 byte header directly after the vector table (section
+//    .image_header, placed at offset IMG_HEADER_OFFSET by the linker script):
+//
+//      magic    IMG_MAGIC
+//      version  IMG_VERSION (make VERSION=n)
+//      length   image size in bytes, a multiple of 4
+//      crc      CRC-32 of the image, computed as the hardware CRC unit does
+//
+//    length and crc are unknown when the code is compiled. The compiler emits 0xFFFFFFFF
+//    and tools/imagehdr.py patches the real values into output.bin after linking.
+//
+//    The CRC is the CRC unit's default: polynomial 0x04C11DB7, initial value 0xFFFFFFFF,
+//    32-bit words fed most significant bit first, no final XOR. It covers the whole image
+//    except the crc word itself (words before it, then words after it). The words are
+//    moved into the CRC unit by DMA, a few milliseconds for a full image at 8 MHz.
+//
+//    Update tools identify the image on a device by its header (see DPATCH).
+//
+//    IMG_scrub checks the running image again and again in the background, one slice of
+//    IMG_SCRUB_WORDS per call, keeping the running CRC in RAM between calls so the CRC
+//    unit stays free for others. Call it from the main loop at a steady rate; at one
+//    call per millisecond a 25K image is covered every 0.4 s.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_IMG_LIB_C
+#define __STM32F030_CMSIS_IMG_LIB_C
+
+#include <stddef.h>
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define IMG_MAGIC           0x31474D49UL    // "IMG1"
+#define IMG_HEADER_OFFSET   0xC0            // 48 vectors; checked by the linker script
+#define IMG_MAX_LENGTH      ( 25 * 1024 )   // FLASH region of the linker script
+
+#ifndef IMG_SCRUB_WORDS
+  #define IMG_SCRUB_WORDS   16              // Words per IMG_scrub call, ~10 us at 8 MHz
+#endif
+
+#ifndef IMG_VERSION
+  #define IMG_VERSION       0
+#endif
+
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t length;
+  uint32_t crc;
+} IMG_header_t;
+
+
+__attribute__(( section( ".image_header" ), used ))
+const IMG_header_t IMG_header = { IMG_MAGIC, IMG_VERSION, 0xFFFFFFFF, 0xFFFFFFFF };
+
+
+// Header of the image at base
+#define IMG_HEADER( base )  \
+  ( (const IMG_header_t *)(uintptr_t)( (uint32_t)(base) + IMG_HEADER_OFFSET ) )
+
+// Word index of the crc field, which the CRC skips
+#define IMG_CRC_WORD        ( ( IMG_HEADER_OFFSET + offsetof( IMG_header_t, crc ) ) / 4 )
+
+
+uint16_t IMG_scrubPos;        // Next word of the running image to scrub
+uint32_t IMG_scrubCrc;        // CRC up to there
+uint16_t IMG_scrubPasses;     // Completed passes
+uint16_t IMG_scrubErrors;     // Passes that did not match the header
+
+
+//  static void
+//  IMG_crcWords( const uint32_t *data, uint32_t words )
+//  Feed words into the CRC unit with a memory to memory transfer on DMA1 Channel 1
+//  (unused by the other libs), so the CPU only waits for the end of the transfer.
+static void
+IMG_crcWords( const uint32_t *data, uint32_t words )
+{
+  if( !words )
+    return;
+  RCC->AHBENR |= RCC_AHBENR_DMAEN;
+  DMA1_Channel1->CCR   = 0;
+  DMA1_Channel1->CPAR  = (uintptr_t)data;         // Source, incremented
+  DMA1_Channel1->CMAR  = (uintptr_t)&CRC->DR;     // Destination, fixed
+  DMA1_Channel1->CNDTR = words;
+  DMA1->IFCR = DMA_IFCR_CGIF1;
+  DMA1_Channel1->CCR   = DMA_CCR_MEM2MEM | DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1 |
+                         DMA_CCR_PINC | DMA_CCR_EN;
+  while( !( DMA1->ISR & ( DMA_ISR_TCIF1 | DMA_ISR_TEIF1 ) ) )
+    ;
+  DMA1_Channel1->CCR = 0;
+  DMA1->IFCR = DMA_IFCR_CGIF1;
+}
+
+
+//  uint8_t
+//  IMG_valid( uint32_t base )
+//  Returns 1 if the header of the image at base is plausible (magic and length), else 0.
+//  The CRC is not checked.
+uint8_t
+IMG_valid( uint32_t base )
+{
+  const IMG_header_t *hdr = IMG_HEADER( base );
+
+  return hdr->magic == IMG_MAGIC &&
+         hdr->length >= IMG_HEADER_OFFSET + sizeof( IMG_header_t ) &&
+         hdr->length <= IMG_MAX_LENGTH && !( hdr->length & 3 );
+}
+
+
+//  uint32_t
+//  IMG_crc( uint32_t base )
+//  Computes the CRC of the image at base over the length in its header. The header must
+//  be valid (IMG_valid).
+uint32_t
+IMG_crc( uint32_t base )
+{
+  const IMG_header_t *hdr = IMG_HEADER( base );
+
+  RCC->AHBENR |= RCC_AHBENR_CRCEN;
+  CRC->INIT = 0xFFFFFFFF;
+  CRC->CR   = CRC_CR_RESET;
+  IMG_crcWords( (const uint32_t *)(uintptr_t)base, IMG_CRC_WORD );
+  IMG_crcWords( &hdr->crc + 1, hdr->length / 4 - IMG_CRC_WORD - 1 );
+  return CRC->DR;
+}
+
+
+//  int8_t
+//  IMG_check( uint32_t base )
+//  Returns 0 if the image at base has a valid header and matches its CRC, else -1.
+int8_t
+IMG_check( uint32_t base )
+{
+  if( !IMG_valid( base ) || IMG_crc( base ) != IMG_HEADER( base )->crc )
+    return -1;
+  return 0;
+}
+
+
+//  int8_t
+//  IMG_scrub( void )
+//  CRC the next slice of the running image. Returns -1 when a pass has just finished
+//  and did not match the header, else 0. Does nothing if the image has no valid header.
+int8_t
+IMG_scrub( void )
+{
+  const IMG_header_t *hdr   = IMG_HEADER( FLASH_BASE );
+  uint32_t            words = hdr->length / 4;
+  uint32_t            end;
+
+  if( !IMG_valid( FLASH_BASE ) )
+    return 0;
+
+  if( IMG_scrubPos == 0 )
+    IMG_scrubCrc = 0xFFFFFFFF;
+  else if( IMG_scrubPos == IMG_CRC_WORD )
+    IMG_scrubPos++;
+  end = IMG_scrubPos + IMG_SCRUB_WORDS;
+  if( IMG_scrubPos < IMG_CRC_WORD && end > IMG_CRC_WORD )
+    end = IMG_CRC_WORD;
+  if( end > words )
+    end = words;
+
+  // Continue from the saved CRC: RESET loads INIT into the data register
+  RCC->AHBENR |= RCC_AHBENR_CRCEN;
+  CRC->INIT = IMG_scrubCrc;
+  CRC->CR   = CRC_CR_RESET;
+  IMG_crcWords( (const uint32_t *)FLASH_BASE + IMG_scrubPos, end - IMG_scrubPos );
+  IMG_scrubCrc = CRC->DR;
+  IMG_scrubPos = end;
+
+  if( IMG_scrubPos < words )
+    return 0;
+  IMG_scrubPos = 0;
+  IMG_scrubPasses++;
+  if( IMG_scrubCrc == hdr->crc )
+    return 0;
+  IMG_scrubErrors++;
+  return -1;
+}
+
+
+#endif /* __STM32F030_CMSIS_IMG_LIB_C */
@@ -0,0 +1,294 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-INSTR-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Exact per-function call counts and cycles from -finstrument-functions hooks
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    "make INSTRUMENT=1" compiles with -finstrument-functions, so every function calls
+//    __cyg_profile_func_enter on entry and __cyg_profile_func_exit on return. The hooks
+//    here timestamp both with SysTick_cycles() and keep, per function:
+//
+//      calls   number of completed calls
+//      incl    cycles from entry to exit, including called functions
+//      excl    the same without the called (instrumented) functions
+//
+//    Functions are found in an open addressed table of INSTR_SLOTS entries; calls
+//    nested deeper than INSTR_DEPTH are counted for their caller. The cost of the hooks
+//    themselves is measured by INSTR_init and removed from both sums, so short functions
+//    like USART_putc come out at their real cost (give or take a few cycles of call
+//    setup the compiler adds around the hooks).
+//
+//    Only thread mode code is measured: the hooks do nothing inside interrupt handlers,
+//    and time spent in an interrupt counts for the function it interrupted. This file,
+//    the SysTick lib and the CMSIS headers are excluded from instrumentation by the
+//    Makefile. The hooks must not call an inline CMSIS function all the same: gcc puts
+//    enter/exit calls around inlined bodies of instrumented files, which would recurse.
+//
+//      INSTR_init();           // after SysTick_init
+//      INSTR_report();         // console command "instr"; INSTR_run() sends the lines
+//
+//    Report lines (hex function address, decimal values), symbolized by tools/instr.py:
+//      INSTR overhead <cycles per call>
+//      I <fn> <calls> <incl> <excl>
+//      INSTR end <lost calls>
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_INSTR_LIB_C
+#define __STM32F030_CMSIS_INSTR_LIB_C
+
+#include <stdlib.h>
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-USART-TXQ-lib.c"
+#include "STM32F030-CMSIS-FMT-lib.c"
+
+
+#define INSTR_SLOTS       32              // Must be a power of two
+#define INSTR_DEPTH       16
+#define INSTR_LINE_SIZE   48
+
+#define INSTR_HOOK        __attribute__(( no_instrument_function ))
+
+
+typedef struct
+{
+  uint32_t fn;
+  uint32_t calls;
+  uint32_t incl;
+  uint32_t excl;
+} INSTR_slot_t;
+
+typedef struct
+{
+  INSTR_slot_t *slot;
+  uint32_t      start;
+  uint32_t      child;                    // Raw cycles of called functions, with hooks
+  uint32_t      nested;                   // Calls made below this one
+} INSTR_frame_t;
+
+
+INSTR_slot_t   INSTR_table[ INSTR_SLOTS ];
+INSTR_frame_t  INSTR_stack[ INSTR_DEPTH ];
+uint8_t        INSTR_depth;               // May exceed INSTR_DEPTH
+uint8_t        INSTR_paused = 1;          // Until INSTR_init
+uint32_t       INSTR_lost;                // Calls not counted (table full, too deep)
+uint32_t       INSTR_inside;              // Hook cycles inside a measured span
+uint32_t       INSTR_pair;                // Cycles an enter/exit pair adds to the caller
+uint8_t        INSTR_sendSlot = INSTR_SLOTS + 2;  // Next report line, INSTR_SLOTS + 2 = idle
+
+
+//  static uint32_t
+//  INSTR_ipsr( void )
+//  Exception number, 0 in thread mode. Own copy of __get_IPSR, see above.
+INSTR_HOOK static inline uint32_t
+INSTR_ipsr( void )
+{
+  uint32_t ipsr;
+
+  __asm volatile( "mrs %0, ipsr" : "=r" ( ipsr ) );
+  return ipsr;
+}
+
+
+//  static INSTR_slot_t *
+//  INSTR_find( uint32_t fn )
+//  Slot of a function, claimed on first use. 0 if the table is full.
+INSTR_HOOK static INSTR_slot_t *
+INSTR_find( uint32_t fn )
+{
+  uint8_t x = ( fn >> 1 ) & ( INSTR_SLOTS - 1 );
+
+  for( uint8_t n = 0; n < INSTR_SLOTS; n++, x = ( x + 1 ) & ( INSTR_SLOTS - 1 ) )
+  {
+    if( INSTR_table[ x ].fn == fn )
+      return &INSTR_table[ x ];
+    if( !INSTR_table[ x ].fn )
+    {
+      INSTR_table[ x ].fn = fn;
+      return &INSTR_table[ x ];
+    }
+  }
+  return 0;
+}
+
+
+INSTR_HOOK void
+__cyg_profile_func_enter( void *fn, void *caller )
+{
+  INSTR_frame_t *frame;
+
+  if( INSTR_paused || INSTR_ipsr() )
+    return;
+  if( INSTR_depth < INSTR_DEPTH )
+  {
+    frame         = &INSTR_stack[ INSTR_depth ];
+    frame->slot   = INSTR_find( (uint32_t)fn );
+    frame->child  = 0;
+    frame->nested = 0;
+    frame->start  = SysTick_cycles();     // Last, so the hook's own work is not counted
+  }
+  INSTR_depth++;
+}
+
+
+INSTR_HOOK void
+__cyg_profile_func_exit( void *fn, void *caller )
+{
+  uint32_t       now = SysTick_cycles();
+  uint32_t       raw, incl;
+  INSTR_frame_t *frame;
+
+  if( INSTR_paused || INSTR_ipsr() || !INSTR_depth )
+    return;
+  if( --INSTR_depth >= INSTR_DEPTH )
+  {
+    INSTR_lost++;
+    return;
+  }
+  frame = &INSTR_stack[ INSTR_depth ];
+  raw   = now - frame->start;
+  incl  = raw - INSTR_inside - frame->nested * INSTR_pair;
+  if( frame->slot )
+  {
+    frame->slot->calls++;
+    frame->slot->incl += incl;
+    frame->slot->excl += raw - INSTR_inside - frame->child;
+  }
+  else
+    INSTR_lost++;
+  if( INSTR_depth )
+  {
+    frame[ -1 ].child  += raw + INSTR_pair - INSTR_inside;
+    frame[ -1 ].nested += 1 + frame->nested;
+  }
+}
+
+
+//  static void
+//  INSTR_clear( void )
+//  Empty the table.
+INSTR_HOOK static void
+INSTR_clear( void )
+{
+  for( uint8_t x = 0; x < INSTR_SLOTS; x++ )
+    INSTR_table[ x ] = (INSTR_slot_t){ 0 };
+  INSTR_lost = 0;
+}
+
+
+//  void
+//  INSTR_init( void )
+//  Measure the cost of the hooks (best of 8 tries), then start counting. SysTick must
+//  be running.
+INSTR_HOOK void
+INSTR_init( void )
+{
+  uint32_t t0, t1, read = 0xFFFFFFFF, pair = 0xFFFFFFFF, inside = 0;
+
+  INSTR_paused = 0;
+  INSTR_depth  = 0;
+  INSTR_inside = 0;
+  INSTR_pair   = 0;
+  for( uint8_t n = 0; n < 8; n++ )
+  {
+    t0 = SysTick_cycles();
+    t1 = SysTick_cycles();
+    if( t1 - t0 < read )
+      read = t1 - t0;
+    INSTR_clear();
+    t0 = SysTick_cycles();
+    __cyg_profile_func_enter( (void *)INSTR_init, 0 );
+    __cyg_profile_func_exit( (void *)INSTR_init, 0 );
+    t1 = SysTick_cycles();
+    if( t1 - t0 < pair )
+    {
+      pair   = t1 - t0;
+      inside = INSTR_find( (uint32_t)INSTR_init )->incl;
+    }
+  }
+  INSTR_inside = inside;
+  INSTR_pair   = pair - read;
+  INSTR_clear();
+}
+
+
+//  void
+//  INSTR_report( void )
+//  Start sending the table as console text (see INSTR_run). Counting pauses until done.
+INSTR_HOOK void
+INSTR_report( void )
+{
+  INSTR_paused   = 1;
+  INSTR_sendSlot = 0;
+}
+
+
+//  static uint8_t
+//  INSTR_putu( char *buf, uint32_t value )
+//  Append " value" in decimal. Returns the characters written.
+INSTR_HOOK static uint8_t
+INSTR_putu( char *buf, uint32_t value )
+{
+  uint8_t n = 1;
+
+  buf[ 0 ] = ' ';
+  utoa( value, buf + 1, 10 );
+  while( buf[ n ] )
+    n++;
+  return n;
+}
+
+
+//  void
+//  INSTR_run( void )
+//  Call from the main loop: sends one report line when the bulk queue has room, and
+//  clears the table and resumes counting after the last one.
+INSTR_HOOK void
+INSTR_run( void )
+{
+  static const char head[] = "INSTR overhead";
+  char              line[ INSTR_LINE_SIZE ];
+  uint8_t           n = 0;
+  INSTR_slot_t     *slot;
+
+  if( !INSTR_paused || INSTR_sendSlot > INSTR_SLOTS + 1 || TXQ_bulkFree() < INSTR_LINE_SIZE )
+    return;
+
+  if( INSTR_sendSlot == 0 )
+  {
+    for( ; head[ n ]; n++ )
+      line[ n ] = head[ n ];
+    n += INSTR_putu( line + n, INSTR_pair );
+  }
+  else if( INSTR_sendSlot <= INSTR_SLOTS )
+  {
+    slot = &INSTR_table[ INSTR_sendSlot - 1 ];
+    if( slot->calls )
+    {
+      line[ n++ ] = 'I';
+      line[ n++ ] = ' ';
+      n += FMT_hex( line + n, slot->fn, 8 );
+      n += INSTR_putu( line + n, slot->calls );
+      n += INSTR_putu( line + n, slot->incl );
+      n += INSTR_putu( line + n, slot->excl );
+    }
+  }
+  else
+  {
+    for( const char *s = "INSTR end"; *s; s++ )
+      line[ n++ ] = *s;
+    n += INSTR_putu( line + n, INSTR_lost );
+    INSTR_clear();
+    INSTR_depth  = 0;
+    INSTR_paused = 0;
+  }
+  INSTR_sendSlot++;
+  if( n )
+  {
+    line[ n++ ] = '\n';
+    TXQ_bulk( line, n );
+  }
+}
+
+
+#endif /* __STM32F030_CMSIS_INSTR_LIB_C */
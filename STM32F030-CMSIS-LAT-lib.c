@@ -0,0 +1,347 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-LAT-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Round-trip latency and throughput of the USART1 drivers
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Puts a number on each way of moving bytes through the port. On request the port
+//    switches to the test baud rate for a number of seconds (the same sequence as the bit
+//    error test, STM32F030-CMSIS-LEND-lib.c) and runs one test over one driver:
+//
+//      test    echo    send every received byte back (host measures the round trip)
+//              tx      send a counting pattern as fast as the driver can
+//              rx      count what arrives (host sends as fast as it can)
+//
+//      driver  blocking  USART_getc / USART_putc in a loop, main loop stalled
+//              irq       RXNE interrupt, echo through the urgent queue (TXE interrupt)
+//              dma       RX DMA ring polled by the main loop, TX through the bulk DMA
+//              idle      RX DMA ring drained from the IDLE line interrupt (echo and rx)
+//
+//    For echo the device times its own part, from seeing a byte to having queued (or, for
+//    blocking, sent) the reply, into a histogram of LAT_BUCKETS log2 cycle buckets:
+//    bucket b counts 2^b .. 2^(b+1) - 1 cycles. Seeing is the RXNE poll or interrupt, the
+//    IDLE interrupt, or the main loop noticing new bytes in the ring; for dma the worst
+//    gap between those checks is reported as well. The result carries the core clock the
+//    cycles were counted at. tools/lat.py subtracts this and the time on the wire from
+//    its round trips, which leaves the latency of the host and its USB adapter.
+//
+//    Over DMX_TYPE_LAT frames (little endian):
+//      request  0x01 mode:u8 baud:u32 seconds:u16     start; mode = test << 4 | driver
+//               0x02                                  repeat the last result
+//      reply    0x01 mode baud seconds                accepted, at the old baud
+//               0x00                                  rejected
+//      result   0x02 mode:u8 rxBytes:u32 txBytes:u32 loopMax:u32 hist:u16 x LAT_BUCKETS
+//               coreHz:u32
+//
+//    Like BERT_run, LAT_run() returns 1 while the test owns the port:
+//
+//      if( BERT_run() || LAT_run() ) continue;
+//      void USART1_IRQHandler( void ) { ...; LAT_usartIsr(); }
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_LAT_LIB_C
+#define __STM32F030_CMSIS_LAT_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-USART-lib.c"
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+#include "STM32F030-CMSIS-LEND-lib.c"
+
+
+#define LAT_BUCKETS       16
+#define LAT_CHUNK         32              // Bytes queued at a time by the tx test
+
+enum { LAT_ECHO, LAT_TX, LAT_RX };                        // Tests
+enum { LAT_BLOCKING, LAT_IRQ, LAT_DMA, LAT_IDLE };        // Drivers
+
+
+LEND_t            LAT_lend;               // Test baud rate, length and phase
+uint8_t           LAT_mode;
+uint32_t          LAT_lastRun;            // SysTick_cycles() of the previous LAT_run
+
+volatile uint32_t LAT_rxBytes;
+volatile uint32_t LAT_txBytes;
+uint32_t          LAT_loopMax;            // Longest gap between ring checks (dma)
+uint16_t          LAT_hist[ LAT_BUCKETS ];
+uint8_t           LAT_pattern;            // Next byte of the tx test
+
+
+//  static void
+//  LAT_record( uint32_t cycles )
+//  Count one turnaround in the histogram.
+static void
+LAT_record( uint32_t cycles )
+{
+  uint8_t b = 0;
+
+  while( cycles > 1 && b < LAT_BUCKETS - 1 )
+  {
+    cycles >>= 1;
+    b++;
+  }
+  if( LAT_hist[ b ] != 0xFFFF )
+    LAT_hist[ b ]++;
+}
+
+
+//  static void
+//  LAT_take( uint32_t seen )
+//  Take everything from the RX ring (the DMX reader, idle while the test runs), echo it
+//  for the echo test. Only called in the RUN phase. seen is the SysTick_cycles() time
+//  the bytes were noticed.
+static void
+LAT_take( uint32_t seen )
+{
+  const uint8_t *data;
+  uint16_t       count;
+
+  while( ( count = RXF_span( &DMX_reader, &data ) ) )
+  {
+    LAT_rxBytes += count;
+    if( ( LAT_mode >> 4 ) == LAT_ECHO )
+    {
+      LAT_txBytes += TXQ_bulk( data, count );
+      LAT_record( SysTick_cycles() - seen );
+    }
+    RXF_consume( &DMX_reader, count );
+  }
+}
+
+
+//  static void
+//  LAT_driver( uint8_t on )
+//  Switch the USART over to the test driver and back. blocking and irq read RDR with the
+//  CPU, so the RX DMA request is off meanwhile.
+static void
+LAT_driver( uint8_t on )
+{
+  uint8_t driver = LAT_mode & 0x0F;
+
+  if( driver == LAT_BLOCKING || driver == LAT_IRQ )
+  {
+    if( on )
+      USART_USART->CR3 &= ~USART_CR3_DMAR;
+    else
+      USART_USART->CR3 |= USART_CR3_DMAR;
+  }
+  if( driver == LAT_IRQ )
+  {
+    if( on )
+      USART_USART->CR1 |= USART_CR1_RXNEIE;
+    else
+      USART_USART->CR1 &= ~USART_CR1_RXNEIE;
+  }
+  if( driver == LAT_IDLE )
+  {
+    USART_USART->ICR = USART_ICR_IDLECF;
+    if( on )
+      USART_USART->CR1 |= USART_CR1_IDLEIE;
+    else
+      USART_USART->CR1 &= ~USART_CR1_IDLEIE;
+  }
+}
+
+
+//  static void
+//  LAT_blocking( void )
+//  The blocking driver: runs the whole test in a polling loop. The echo turnaround
+//  includes one character time, as USART_putc returns once the byte is sent.
+static void
+LAT_blocking( void )
+{
+  uint8_t  test = LAT_mode >> 4;
+  uint32_t seen;
+  char     c;
+
+  while( SysTick_millis() - LAT_lend.phaseStart < LAT_lend.seconds * 1000UL )
+  {
+    if( test == LAT_TX )
+    {
+      USART_putc( LAT_pattern++ );
+      LAT_txBytes++;
+    }
+    else if( USART_USART->ISR & USART_ISR_RXNE )
+    {
+      seen = SysTick_cycles();
+      c    = USART_getc();
+      LAT_rxBytes++;
+      if( test == LAT_ECHO )
+      {
+        USART_putc( c );
+        LAT_txBytes++;
+        LAT_record( SysTick_cycles() - seen );
+      }
+    }
+  }
+}
+
+
+//  static void
+//  LAT_send( void )
+//  tx test over the irq (urgent queue) or dma (bulk queue) driver: keep the queue full.
+static void
+LAT_send( void )
+{
+  uint8_t buf[ LAT_CHUNK ];
+
+  for( ;; )
+  {
+    if( ( LAT_mode & 0x0F ) == LAT_IRQ ? RING_free( &TXQ_urgRing ) < LAT_CHUNK
+                                       : TXQ_bulkFree() < LAT_CHUNK )
+      return;
+    for( uint8_t x = 0; x < LAT_CHUNK; x++ )
+      buf[ x ] = LAT_pattern++;
+    if( ( LAT_mode & 0x0F ) == LAT_IRQ )
+      TXQ_urgent( buf, LAT_CHUNK );
+    else
+      TXQ_bulk( buf, LAT_CHUNK );
+    LAT_txBytes += LAT_CHUNK;
+  }
+}
+
+
+//  static uint8_t
+//  LAT_sendResult( void )
+//  Queue the result frame. Returns 0 if the bulk queue had no room.
+static uint8_t
+LAT_sendResult( void )
+{
+  uint8_t  payload[ 18 + 2 * LAT_BUCKETS ], n = 2;
+  uint32_t values[] = { LAT_rxBytes, LAT_txBytes, LAT_loopMax };
+
+  payload[ 0 ] = 0x02;
+  payload[ 1 ] = LAT_mode;
+  for( uint8_t x = 0; x < 3; x++ )
+    for( uint8_t y = 0; y < 4; y++ )
+      payload[ n++ ] = values[ x ] >> ( 8 * y );
+  for( uint8_t x = 0; x < LAT_BUCKETS; x++ )
+  {
+    payload[ n++ ] = LAT_hist[ x ] & 0xFF;
+    payload[ n++ ] = LAT_hist[ x ] >> 8;
+  }
+  for( uint8_t y = 0; y < 4; y++ )
+    payload[ n++ ] = CLOCK_hz >> ( 8 * y );
+  return DMX_sendBulk( DMX_TYPE_LAT, payload, n );
+}
+
+
+//  void
+//  LAT_request( const uint8_t *payload, uint8_t len )
+//  Handle a DMX_TYPE_LAT frame.
+void
+LAT_request( const uint8_t *payload, uint8_t len )
+{
+  uint8_t reply = 0x00, test, driver;
+
+  if( len == 1 && payload[ 0 ] == 0x02 && LAT_lend.phase == LEND_IDLE )
+  {
+    LAT_sendResult();
+    return;
+  }
+  if( len == 8 && payload[ 0 ] == 0x01 && LEND_args( &LAT_lend, &payload[ 2 ] ) )
+  {
+    LAT_mode = payload[ 1 ];
+    test     = LAT_mode >> 4;
+    driver   = LAT_mode & 0x0F;
+    if( test <= LAT_RX && driver <= LAT_IDLE && !( test == LAT_TX && driver == LAT_IDLE ) )
+    {
+      LAT_rxBytes = LAT_txBytes = LAT_loopMax = 0;
+      for( uint8_t x = 0; x < LAT_BUCKETS; x++ )
+        LAT_hist[ x ] = 0;
+      LEND_start( &LAT_lend );
+      DMX_sendFrame( DMX_TYPE_LAT, payload, len );
+      return;
+    }
+  }
+  DMX_sendFrame( DMX_TYPE_LAT, &reply, 1 );
+}
+
+
+//  uint8_t
+//  LAT_run( void )
+//  Call from the main loop. Returns 1 while a test owns the port; the caller must then
+//  skip DMX_poll and everything that writes to the TX queue.
+uint8_t
+LAT_run( void )
+{
+  uint32_t now = SysTick_cycles();
+
+  switch( LEND_run( &LAT_lend ) )
+  {
+    case LEND_OFF:
+      return 0;
+
+    case LEND_WAIT:
+      return 1;
+
+    case LEND_START:
+      RXF_consume( &DMX_reader, RXF_available( &DMX_reader ) );   // From the settle time
+      LAT_lastRun = now;
+      LAT_driver( 1 );
+      if( ( LAT_mode & 0x0F ) == LAT_BLOCKING )
+        LAT_blocking();
+      return 1;
+
+    case LEND_STOP:
+      LAT_driver( 0 );
+      break;
+
+    case LEND_RESULT:
+      if( LAT_sendResult() )
+      {
+        LEND_end( &LAT_lend );
+        return 0;
+      }
+      break;
+  }
+
+  if( LAT_lend.phase == LEND_RUN )
+  {
+    if( now - LAT_lastRun > LAT_loopMax )
+      LAT_loopMax = now - LAT_lastRun;
+    LAT_lastRun = now;
+    if( ( LAT_mode >> 4 ) == LAT_TX )
+      LAT_send();
+    else if( ( LAT_mode & 0x0F ) == LAT_DMA )
+      LAT_take( now );
+    return 1;
+  }
+  RXF_consume( &DMX_reader, RXF_available( &DMX_reader ) );     // Not counted
+  return 1;
+}
+
+
+//  void
+//  LAT_usartIsr( void )
+//  USART1 interrupt service for the irq and idle drivers.
+void
+LAT_usartIsr( void )
+{
+  uint32_t seen, isr, cr1;
+  uint8_t  c;
+
+  if( LAT_lend.phase != LEND_RUN )
+    return;
+  seen = SysTick_cycles();
+  isr  = USART_USART->ISR;
+  cr1  = USART_USART->CR1;
+  if( ( cr1 & USART_CR1_RXNEIE ) && ( isr & USART_ISR_RXNE ) )
+  {
+    c = USART_USART->RDR;
+    LAT_rxBytes++;
+    if( ( LAT_mode >> 4 ) == LAT_ECHO && TXQ_urgent( &c, 1 ) )
+    {
+      LAT_txBytes++;
+      LAT_record( SysTick_cycles() - seen );
+    }
+  }
+  if( ( cr1 & USART_CR1_IDLEIE ) && ( isr & USART_ISR_IDLE ) )
+  {
+    USART_USART->ICR = USART_ICR_IDLECF;
+    LAT_take( seen );
+  }
+}
+
+
+#endif /* __STM32F030_CMSIS_LAT_LIB_C */
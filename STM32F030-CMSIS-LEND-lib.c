@@ -0,0 +1,161 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-LEND-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Lending the USART1 link to a test at another baud rate
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    The link tests (STM32F030-CMSIS-BERT-lib.c, STM32F030-CMSIS-LAT-lib.c) take over the
+//    port for a number of seconds at a baud rate of the host's choosing. The sequence
+//    around the test is the same for all of them and lives here:
+//
+//      ARM       the reply to the request is still going out at the link baud rate
+//      SETTLE    switched to the test rate; LEND_SETTLE_MS for the host to switch too
+//      RUN       the test, for the requested number of seconds
+//      DRAIN     the last test bytes are still going out
+//      RESTORE   back at the link rate; 2 * LEND_SETTLE_MS, then the result is sent
+//
+//    A request carries baud:u32 seconds:u16 (little endian), read by LEND_args, which
+//    also checks the rate (at least 300, at most CLOCK_hz / 16 for USART_brr). The test
+//    calls LEND_run from the main loop and acts on the events it returns:
+//
+//      if( LEND_args( &lend, &payload[ 3 ] ) && ... ) { reset counts; LEND_start( &lend ); }
+//      ...
+//      switch( LEND_run( &lend ) )
+//      {
+//        case LEND_OFF:    return 0;                   // Not lent, main loop as usual
+//        case LEND_WAIT:   return 1;                   // Draining, leave the port alone
+//        case LEND_START:  ...                         // Entered RUN
+//        case LEND_STOP:   ...                         // Left RUN
+//        case LEND_RESULT: if( sendResult() ) { LEND_end( &lend ); return 0; }
+//      }
+//      ...                                             // Work of the current phase
+//      return 1;
+//
+//    While lent, the main loop must skip DMX_poll and everything that writes to the TX
+//    queue. LEND_end drops what arrived at the wrong rate from the frame reader.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_LEND_LIB_C
+#define __STM32F030_CMSIS_LEND_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-CLOCK-lib.c"
+#include "STM32F030-CMSIS-USART-lib.c"
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+
+
+#define LEND_SETTLE_MS    100             // Quiet time around each baud switch
+#define LEND_MIN_BAUD     300
+
+enum { LEND_IDLE, LEND_ARM, LEND_SETTLE, LEND_RUN, LEND_DRAIN, LEND_RESTORE };    // Phases
+enum { LEND_OFF, LEND_NONE, LEND_WAIT, LEND_SWITCHED, LEND_START, LEND_STOP,
+       LEND_RESULT };                                                             // Events
+
+
+typedef struct
+{
+  volatile uint8_t phase;                 // Read by the interrupt handlers of the tests
+  uint16_t         seconds;               // Length of RUN
+  uint32_t         baud;                  // Test baud rate
+  uint32_t         linkBaud;              // Baud rate to return to
+  uint32_t         phaseStart;            // SysTick_millis() at the start of the phase
+} LEND_t;
+
+
+//  static void
+//  LEND_enter( LEND_t *lend, uint8_t phase )
+//  Switch phase and note the time.
+static void
+LEND_enter( LEND_t *lend, uint8_t phase )
+{
+  lend->phase      = phase;
+  lend->phaseStart = SysTick_millis();
+}
+
+
+//  uint8_t
+//  LEND_args( LEND_t *lend, const uint8_t *args )
+//  Take baud:u32 seconds:u16 from a request. Returns 0 if the port is already lent or
+//  the arguments are out of range.
+uint8_t
+LEND_args( LEND_t *lend, const uint8_t *args )
+{
+  if( lend->phase != LEND_IDLE )
+    return 0;
+  lend->baud    = args[ 0 ] | ( args[ 1 ] << 8 ) | ( args[ 2 ] << 16 ) |
+                  ( (uint32_t)args[ 3 ] << 24 );
+  lend->seconds = args[ 4 ] | ( args[ 5 ] << 8 );
+  return lend->baud >= LEND_MIN_BAUD && lend->baud <= CLOCK_hz / 16 && lend->seconds;
+}
+
+
+//  void
+//  LEND_start( LEND_t *lend )
+//  Start the sequence, after the request has been accepted and the reply queued.
+void
+LEND_start( LEND_t *lend )
+{
+  LEND_enter( lend, LEND_ARM );
+}
+
+
+//  uint8_t
+//  LEND_run( LEND_t *lend )
+//  Call from the main loop: move the sequence on. Returns LEND_OFF if the port is not
+//  lent, LEND_WAIT while the TX queue drains before a baud switch, or what happened:
+//  LEND_SWITCHED (now at the test rate), LEND_START / LEND_STOP (RUN begins / ends),
+//  LEND_RESULT (time to send the result, every call until LEND_end), else LEND_NONE.
+uint8_t
+LEND_run( LEND_t *lend )
+{
+  uint32_t elapsed = SysTick_millis() - lend->phaseStart;
+
+  switch( lend->phase )
+  {
+    case LEND_ARM:
+      if( !TXQ_idle() )
+        return LEND_WAIT;
+      lend->linkBaud = USART_baud;
+      USART_setBaud( lend->baud );
+      LEND_enter( lend, LEND_SETTLE );
+      return LEND_SWITCHED;
+
+    case LEND_SETTLE:                     // The host is switching too
+      if( elapsed < LEND_SETTLE_MS )
+        return LEND_NONE;
+      LEND_enter( lend, LEND_RUN );
+      return LEND_START;
+
+    case LEND_RUN:
+      if( elapsed < lend->seconds * 1000UL )
+        return LEND_NONE;
+      LEND_enter( lend, LEND_DRAIN );
+      return LEND_STOP;
+
+    case LEND_DRAIN:
+      if( !TXQ_idle() )
+        return LEND_WAIT;
+      USART_setBaud( lend->linkBaud );
+      LEND_enter( lend, LEND_RESTORE );
+      return LEND_NONE;
+
+    case LEND_RESTORE:
+      return elapsed >= 2 * LEND_SETTLE_MS ? LEND_RESULT : LEND_NONE;
+  }
+  return LEND_OFF;
+}
+
+
+//  void
+//  LEND_end( LEND_t *lend )
+//  Give the port back to the main loop, once the result is queued.
+void
+LEND_end( LEND_t *lend )
+{
+  DMX_flush();
+  lend->phase = LEND_IDLE;
+}
+
+
+#endif /* __STM32F030_CMSIS_LEND_LIB_C */
@@ -0,0 +1,183 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-LZ-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Streaming LZ decompression with a 256 byte window
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Decompresses images made by tools/lzpack.py while they arrive, so a compressed
+//    update never has to be stored whole. The format is byte oriented (no bit stream) and
+//    back references reach at most 256 bytes, so the decoder needs one 256 byte window
+//    of RAM and no other buffers:
+//
+//      header   'L' 'Z' size:u32 (little endian, decompressed size)
+//      0LLLLLLL literal run: L + 1 bytes follow (1..128)
+//      1LLLLLLL offset:u8
+//               match: copy L + 3 bytes (3..130) starting offset + 1 bytes back
+//
+//    The window is the recent output. Decoded bytes are handed to a sink function in
+//    contiguous pieces each time the window wraps and from LZ_finish, so a flash writer
+//    sees up to 256 bytes per call. Input can be split anywhere, including inside a
+//    token or the header.
+//
+//    Usage:
+//      LZ_start( &dec, writeFlash );
+//      LZ_feed( &dec, payload, len );         // for every chunk received
+//      if( LZ_finish( &dec ) < 0 ) ...        // corrupt, truncated or wrong size
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_LZ_LIB_C
+#define __STM32F030_CMSIS_LZ_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define LZ_WINDOW       256     // Window size; positions are uint8_t and wrap by themselves
+#define LZ_MIN_MATCH    3
+#define LZ_HEADER_SIZE  6
+
+enum { LZ_HEADER, LZ_TOKEN, LZ_LITERAL, LZ_OFFSET };
+
+
+// Receives decompressed data in order
+typedef void LZ_sink_t( const uint8_t *data, uint16_t len );
+
+typedef struct
+{
+  LZ_sink_t *sink;
+  uint32_t   size;                // Decompressed size from the header
+  uint32_t   total;               // Bytes decompressed so far
+  uint8_t    window[ LZ_WINDOW ];
+  uint8_t    pos;                 // Next window position to write
+  uint8_t    flushed;             // First window position not yet given to the sink
+  uint8_t    state;
+  uint8_t    count;               // Header bytes seen, literals left or match length
+  uint8_t    error;               // Bad header, bad reference or too much data
+} LZ_decoder_t;
+
+
+//  void
+//  LZ_start( LZ_decoder_t *dec, LZ_sink_t *sink )
+//  Prepare dec to decompress one image into sink.
+void
+LZ_start( LZ_decoder_t *dec, LZ_sink_t *sink )
+{
+  dec->sink    = sink;
+  dec->size    = 0;
+  dec->total   = 0;
+  dec->pos     = 0;
+  dec->flushed = 0;
+  dec->state   = LZ_HEADER;
+  dec->count   = 0;
+  dec->error   = 0;
+}
+
+
+//  static void
+//  LZ_out( LZ_decoder_t *dec, uint8_t c )
+//  Append one decompressed byte to the window, passing the window to the sink when it
+//  wraps.
+static void
+LZ_out( LZ_decoder_t *dec, uint8_t c )
+{
+  if( dec->total >= dec->size )
+  {
+    dec->error = 1;
+    return;
+  }
+  dec->window[ dec->pos++ ] = c;
+  dec->total++;
+  if( dec->pos == 0 )
+  {
+    dec->sink( &dec->window[ dec->flushed ], LZ_WINDOW - dec->flushed );
+    dec->flushed = 0;
+  }
+}
+
+
+//  static void
+//  LZ_byte( LZ_decoder_t *dec, uint8_t b )
+//  Run one input byte through the decoder.
+static void
+LZ_byte( LZ_decoder_t *dec, uint8_t b )
+{
+  uint8_t src;
+
+  switch( dec->state )
+  {
+    case LZ_HEADER:
+      if( dec->count < 2 )
+      {
+        if( b != "LZ"[ dec->count ] )
+          dec->error = 1;
+      }
+      else
+        dec->size |= (uint32_t)b << ( 8 * ( dec->count - 2 ) );
+      if( ++dec->count == LZ_HEADER_SIZE )
+        dec->state = LZ_TOKEN;
+      break;
+
+    case LZ_TOKEN:
+      if( b & 0x80 )
+      {
+        dec->count = ( b & 0x7F ) + LZ_MIN_MATCH;
+        dec->state = LZ_OFFSET;
+      }
+      else
+      {
+        dec->count = b + 1;
+        dec->state = LZ_LITERAL;
+      }
+      break;
+
+    case LZ_LITERAL:
+      LZ_out( dec, b );
+      if( --dec->count == 0 )
+        dec->state = LZ_TOKEN;
+      break;
+
+    case LZ_OFFSET:
+      if( (uint32_t)b + 1 > dec->total )    // Reaches back before the start
+      {
+        dec->error = 1;
+        break;
+      }
+      src = dec->pos - b - 1;
+      while( dec->count-- && !dec->error )  // Overlapping copies repeat the pattern
+        LZ_out( dec, dec->window[ src++ ] );
+      dec->state = LZ_TOKEN;
+      break;
+  }
+}
+
+
+//  void
+//  LZ_feed( LZ_decoder_t *dec, const void *data, uint16_t len )
+//  Decompress len bytes of the compressed stream. Errors are latched in dec->error and
+//  the rest of the stream is ignored.
+void
+LZ_feed( LZ_decoder_t *dec, const void *data, uint16_t len )
+{
+  const uint8_t *p = data;
+
+  while( len-- && !dec->error )
+    LZ_byte( dec, *p++ );
+}
+
+
+//  int8_t
+//  LZ_finish( LZ_decoder_t *dec )
+//  Called after the last compressed byte. Passes the remaining output to the sink and
+//  returns 0, or -1 if the stream was corrupt, truncated or did not match its size.
+int8_t
+LZ_finish( LZ_decoder_t *dec )
+{
+  if( dec->error || dec->state != LZ_TOKEN || dec->total != dec->size )
+    return -1;
+  if( dec->pos != dec->flushed )
+    dec->sink( &dec->window[ dec->flushed ], dec->pos - dec->flushed );
+  dec->flushed = dec->pos;
+  return 0;
+}
+
+
+#endif /* __STM32F030_CMSIS_LZ_LIB_C */
@@ -0,0 +1,265 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-POST-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Power-on self-test: SRAM march, flash image CRC and core clock against LSI
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Three checks (four with ASM_KERNELS), all done before main() enables any output:
+//
+//      RAM     March C- over the whole SRAM, run by Reset_Handler (startup file) before
+//              the data and bss sections and the stack are in use. It works four words
+//              at a time with LDM/STM; the result is left in POST_ramFault. Skipped
+//              after a warm boot that restored the outputs (POST_WARM, no failure).
+//      Flash   CRC of the image against its header (IMG_check, DMA into the CRC unit).
+//              An image without a filled in header (flashed from the .elf or .hex) is
+//              reported as POST_NOHEADER and not checked.
+//      Clock   LSI is routed to TIM14 input capture through MCO and 8 of its periods are
+//              counted in core clock cycles. LSI is only accurate to 30..50 kHz, so this
+//              catches a wrong or dead clock (PLL misconfigured, HSE missing), not drift.
+//      Kernels Only in ASM_KERNELS builds: every Thumb-1 kernel of kernels_cortexm0.s is
+//              run next to its C twin on the same data (aligned and unaligned for the
+//              copy) and the results compared, so a broken kernel fails the self-test
+//              instead of corrupting frames. The C twins are checked against fixed
+//              vectors by the host tests (tests/test_kernels.c).
+//
+//    Reset_Handler also starts SysTick free running, so POST_run can tell how long the
+//    self-test took since reset (POST_us). Exceeding POST_BUDGET_MS is a failure too.
+//
+//      if( POST_run() < 0 ) ...                // POST_flags has the failed checks
+//      USART_init( ... ); POST_report();       // once the UART is up
+//      REC_event( REC_POST, POST_flags, POST_us );
+//
+//    POST_run must be called before SysTick_init.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_POST_LIB_C
+#define __STM32F030_CMSIS_POST_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-USART-lib.c"
+#include "STM32F030-CMSIS-IMG-lib.c"
+#ifdef ASM_KERNELS
+#include "STM32F030-CMSIS-RING-lib.c"
+#include "STM32F030-CMSIS-CRC-lib.c"
+#include "STM32F030-CMSIS-BITPACK-lib.c"
+#include "STM32F030-CMSIS-FMT-lib.c"
+#endif
+
+
+#ifndef POST_CORE_HZ
+  #define POST_CORE_HZ      8000000UL       // Core clock during the self-test
+#endif
+#ifndef POST_BUDGET_MS
+  #define POST_BUDGET_MS    20              // Reset to end of POST_run
+#endif
+
+#define POST_LSI_PERIODS    8               // Input capture prescaler
+#define POST_LSI_MIN_HZ     30000
+#define POST_LSI_MAX_HZ     50000
+#define POST_CLOCK_MIN      ( POST_LSI_PERIODS * POST_CORE_HZ / POST_LSI_MAX_HZ )
+#define POST_CLOCK_MAX      ( POST_LSI_PERIODS * POST_CORE_HZ / POST_LSI_MIN_HZ )
+
+// POST_flags
+#define POST_RAM            0x01            // March test failed at POST_ramFault
+#define POST_FLASH          0x02            // Image CRC does not match its header
+#define POST_CLOCK          0x04            // Core clock / LSI ratio out of range
+#define POST_BUDGET         0x08            // Took longer than POST_BUDGET_MS
+#define POST_NOHEADER       0x10            // No image header, flash not checked (no failure)
+#define POST_WARM           0x20            // Warm boot, RAM not tested (no failure)
+#define POST_KERNELS        0x40            // A Thumb-1 kernel differs from its C twin
+#define POST_FAILED         ( POST_RAM | POST_FLASH | POST_CLOCK | POST_BUDGET | POST_KERNELS )
+
+
+extern uint32_t POST_ramFault;        // Set by Reset_Handler
+
+uint8_t  POST_flags;
+uint16_t POST_clockTicks;             // Core cycles in POST_LSI_PERIODS LSI periods, 0 = none
+uint16_t POST_us;                     // Reset to end of POST_run, saturated
+
+
+//  static uint32_t
+//  POST_cycles( void )
+//  Core cycles since reset, from the free running SysTick started by Reset_Handler.
+static uint32_t
+POST_cycles( void )
+{
+  return ( SysTick_LOAD_RELOAD_Msk - SysTick->VAL ) & SysTick_LOAD_RELOAD_Msk;
+}
+
+
+//  static uint8_t
+//  POST_capture( uint16_t *value )
+//  Wait up to 1 ms for the next TIM14 capture. Returns 0 on timeout.
+static uint8_t
+POST_capture( uint16_t *value )
+{
+  uint32_t start = POST_cycles();
+
+  while( !( TIM14->SR & TIM_SR_CC1IF ) )
+    if( POST_cycles() - start > POST_CORE_HZ / 1000 )
+      return 0;
+  *value = TIM14->CCR1;                 // Clears CC1IF
+  return 1;
+}
+
+
+//  static uint16_t
+//  POST_clock( void )
+//  Measure POST_LSI_PERIODS LSI periods in core cycles. Returns 0 if LSI or the capture
+//  did not run.
+static uint16_t
+POST_clock( void )
+{
+  uint16_t first, second;
+  uint8_t  ok;
+
+  RCC->CSR |= RCC_CSR_LSION;
+  for( uint32_t start = POST_cycles(); !( RCC->CSR & RCC_CSR_LSIRDY ); )
+    if( POST_cycles() - start > POST_CORE_HZ / 1000 )
+      break;
+
+  RCC->CFGR    = ( RCC->CFGR & ~RCC_CFGR_MCO ) | RCC_CFGR_MCO_LSI;
+  RCC->APB1ENR |= RCC_APB1ENR_TIM14EN;
+  TIM14->OR    = TIM14_OR_TI1_RMP_0 | TIM14_OR_TI1_RMP_1;        // TI1 = MCO
+  TIM14->PSC   = 0;
+  TIM14->ARR   = 0xFFFF;
+  TIM14->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_IC1PSC;            // TI1, every 8th edge
+  TIM14->CCER  = TIM_CCER_CC1E;
+  TIM14->CR1   = TIM_CR1_CEN;
+
+  // The first capture may come from a partial period
+  ok = POST_capture( &first ) && POST_capture( &first ) && POST_capture( &second );
+
+  TIM14->CR1    = 0;
+  TIM14->CCER   = 0;
+  RCC->APB1ENR &= ~RCC_APB1ENR_TIM14EN;
+  RCC->CFGR    &= ~RCC_CFGR_MCO;
+  RCC->CSR     &= ~RCC_CSR_LSION;
+  return ok ? (uint16_t)( second - first ) : 0;
+}
+
+
+#ifdef ASM_KERNELS
+//  static uint8_t
+//  POST_kernels( void )
+//  Compare the Thumb-1 kernels with their C twins. Returns 0 if any result differs.
+static uint8_t
+POST_kernels( void )
+{
+  static const uint8_t  lengths[] = { 0, 3, 7, 21, 35 };   // Every path of the copy
+  static const uint32_t numbers[] = { 0, 0x9, 0xA, 0x100, 0x89ABCDEF, 0xFFFFFFFF };
+  static const uint32_t words[ 10 ] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                                        0xC3D2E1F0, 0x00FF00FF, 0x80000001, 0x7FFFFFFE,
+                                        0x5555AAAA, 0xDEADBEEF };
+  const uint8_t        *data = (const uint8_t *)words;
+  uint8_t               a[ 44 ], b[ 44 ];
+  uint16_t              cha[ 16 ], chb[ 16 ];
+  uint8_t               len;
+
+  for( uint8_t l = 0; l < sizeof( lengths ); l++ )
+    for( uint8_t src = 0; src < 4; src += 3 )
+    {
+      len = lengths[ l ];
+      if( CRC16_update_asm( CRC16_INIT, data + src, len ) !=
+          CRC16_update_c( CRC16_INIT, data + src, len ) )
+        return 0;
+
+      // Same alignment (word copy) and different alignment (byte copy)
+      for( uint8_t dst = src; dst <= src + 1; dst++ )
+      {
+        for( uint8_t x = 0; x < len + 8; x++ )
+          a[ x ] = b[ x ] = x;
+        RING_copy_asm( a + ( dst & 3 ), data + src, len );
+        RING_copy_c( b + ( dst & 3 ), data + src, len );
+        for( uint8_t x = 0; x < len + 8; x++ )
+          if( a[ x ] != b[ x ] )
+            return 0;
+      }
+    }
+
+  BITPACK_unpack11_asm( data, cha, 2 );
+  BITPACK_unpack11_c( data, chb, 2 );
+  for( uint8_t k = 0; k < 16; k++ )
+    if( cha[ k ] != chb[ k ] )
+      return 0;
+
+  for( uint8_t n = 0; n < sizeof( numbers ) / sizeof( numbers[ 0 ] ); n++ )
+    for( uint8_t places = 0; places <= 8; places++ )
+    {
+      if( FMT_hex_asm( (char *)a, numbers[ n ], places ) !=
+          FMT_hex_c( (char *)b, numbers[ n ], places ) )
+        return 0;
+      for( uint8_t x = 0; x < places; x++ )
+        if( a[ x ] != b[ x ] )
+          return 0;
+    }
+  return 1;
+}
+#endif /* ASM_KERNELS */
+
+
+//  int8_t
+//  POST_run( void )
+//  Evaluate the RAM test and run the other checks. Returns 0 if all passed,
+//  else -1 (see POST_flags).
+int8_t
+POST_run( void )
+{
+  uint32_t us;
+
+  POST_flags = 0;
+  if( POST_ramFault == 0xFFFFFFFF )
+    POST_flags |= POST_WARM;
+  else if( POST_ramFault )
+    POST_flags |= POST_RAM;
+
+  if( !IMG_valid( FLASH_BASE ) )
+    POST_flags |= POST_NOHEADER;
+  else if( IMG_check( FLASH_BASE ) < 0 )
+    POST_flags |= POST_FLASH;
+
+  POST_clockTicks = POST_clock();
+  if( POST_clockTicks < POST_CLOCK_MIN || POST_clockTicks > POST_CLOCK_MAX )
+    POST_flags |= POST_CLOCK;
+
+#ifdef ASM_KERNELS
+  if( !POST_kernels() )
+    POST_flags |= POST_KERNELS;
+#endif
+
+  us = POST_cycles() / ( POST_CORE_HZ / 1000000 );
+  POST_us = us > 0xFFFF ? 0xFFFF : us;
+  if( us > POST_BUDGET_MS * 1000UL )
+    POST_flags |= POST_BUDGET;
+
+  return POST_flags & POST_FAILED ? -1 : 0;
+}
+
+
+//  void
+//  POST_report( void )
+//  Print the results on the (polled) USART, e.g. "POST ok ram ok flash ok clock 1598 4210us".
+void
+POST_report( void )
+{
+  USART_puts( POST_flags & POST_FAILED ? "POST FAILED" : "POST ok" );
+  USART_puts( POST_flags & POST_WARM ? " ram skipped (warm)" :
+              POST_flags & POST_RAM ? " ram @" : " ram ok" );
+  if( POST_flags & POST_RAM )
+    USART_puth( POST_ramFault, 8 );
+  USART_puts( POST_flags & POST_NOHEADER ? " flash unchecked" :
+              POST_flags & POST_FLASH ? " flash BAD" : " flash ok" );
+  USART_puts( POST_flags & POST_CLOCK ? " clock BAD " : " clock " );
+  USART_puti( POST_clockTicks, 10 );
+  USART_putc( ' ' );
+  USART_puti( POST_us, 10 );
+#ifdef ASM_KERNELS
+  USART_puts( POST_flags & POST_KERNELS ? "us kernels BAD" : "us kernels ok" );
+  USART_puts( POST_flags & POST_BUDGET ? " (over budget)\n" : "\n" );
+#else
+  USART_puts( POST_flags & POST_BUDGET ? "us (over budget)\n" : "us\n" );
+#endif
+}
+
+
+#endif /* __STM32F030_CMSIS_POST_LIB_C */
@@ -0,0 +1,257 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-PROF-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Statistical profiler: samples the interrupted PC from TIM16 into a RAM histogram
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    The Cortex-M0 has no DWT cycle counter or trace, so time is measured by sampling:
+//    TIM16 interrupts at PROF_start( hz ) and its handler reads the PC the CPU pushed
+//    on entry. Each PC in the image counts in a bucket of 2^PROF_SHIFT bytes
+//    (IMG_MAX_LENGTH >> PROF_SHIFT u16 buckets, 400 bytes of RAM by default); anything
+//    else counts in PROF_outside. PROF_handler counts samples that interrupted another
+//    exception handler. When a bucket fills up all counts are halved (PROF_halvings).
+//
+//    TIM16 gets the highest priority and PROF_start moves every other interrupt one
+//    level down, so handlers are sampled too. The period is dithered by up to +-8 us so
+//    loops running in step with the sample rate do not alias.
+//
+//    Host side (tools/prof.py) over DMX_TYPE_PROF frames:
+//
+//      request  0x00               stop (the histogram is kept)
+//               0x01 hz:u16        clear and start sampling at hz (16..10000)
+//               0x02 [index:u16]   dump (pauses sampling until done)
+//      dump     index:u16 count:u16 x up to PROF_PER_FRAME, from bucket index
+//      end      0xFFFF base:u32 shift:u8 buckets:u16 outside:u32 handler:u32
+//               halvings:u8 hz:u16
+//
+//    Call PROF_run() from the main loop to send the dump.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_PROF_LIB_C
+#define __STM32F030_CMSIS_PROF_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-IMG-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+
+
+#ifndef PROF_SHIFT
+  #define PROF_SHIFT      7               // 128 byte buckets
+#endif
+#define PROF_BUCKETS      ( IMG_MAX_LENGTH >> PROF_SHIFT )
+#define PROF_PER_FRAME    24              // Counts per dump frame
+#define PROF_TICK_HZ      1000000UL       // TIM16 counts microseconds
+
+enum { PROF_STOP, PROF_START, PROF_DUMP };
+
+
+uint16_t          PROF_counts[ PROF_BUCKETS ];
+uint32_t          PROF_outside;           // Samples outside the image (RAM, system memory)
+uint32_t          PROF_handler;           // Samples taken in handler mode
+uint8_t           PROF_halvings;
+uint16_t          PROF_hz;                // Sample rate of the histogram
+uint16_t          PROF_period;            // Timer ticks between samples
+uint16_t          PROF_lfsr = 0xACE1;     // Dither
+volatile uint8_t  PROF_paused;            // Dump in progress
+uint8_t           PROF_sending;
+uint16_t          PROF_sendIndex;
+
+
+//  void
+//  PROF_sample( const uint32_t *frame )
+//  Count one sample. frame is the exception stack frame of the interrupted code (r0-r3,
+//  r12, lr, pc, xpsr). Called by TIM16_IRQHandler.
+void
+PROF_sample( const uint32_t *frame )
+{
+  uint32_t offset = frame[ 6 ] - FLASH_BASE;
+  uint16_t *count;
+
+  TIM16->SR &= ~TIM_SR_UIF;
+  PROF_lfsr = ( PROF_lfsr >> 1 ) ^ ( -( PROF_lfsr & 1 ) & 0xB400 );
+  TIM16->ARR = PROF_period - 8 + ( PROF_lfsr & 15 );
+  if( PROF_paused )
+    return;
+
+  if( frame[ 7 ] & 0x3F )                 // IPSR: an exception handler was interrupted
+    PROF_handler++;
+  if( offset >= IMG_MAX_LENGTH )
+  {
+    PROF_outside++;
+    return;
+  }
+  count = &PROF_counts[ offset >> PROF_SHIFT ];
+  if( ++*count == 0xFFFF )
+  {
+    for( uint16_t x = 0; x < PROF_BUCKETS; x++ )
+      PROF_counts[ x ] >>= 1;
+    PROF_outside >>= 1;
+    PROF_handler >>= 1;
+    PROF_halvings++;
+  }
+}
+
+
+//  void
+//  TIM16_IRQHandler( void )
+//  Hand the stack frame of the interrupted code (main or process stack, from
+//  EXC_RETURN) to PROF_sample. PROF_sample returns straight to the interrupted code.
+__attribute__(( naked, no_instrument_function )) void
+TIM16_IRQHandler( void )
+{
+  __asm volatile(
+    "  movs  r0, #4           \n"
+    "  mov   r1, lr           \n"
+    "  tst   r0, r1           \n"
+    "  mrs   r0, msp          \n"
+    "  beq   1f               \n"
+    "  mrs   r0, psp          \n"
+    "1:                       \n"
+    "  ldr   r1, 2f           \n"
+    "  bx    r1               \n"
+    "  .align 2               \n"
+    "2: .word PROF_sample     \n" );
+}
+
+
+//  void
+//  PROF_stop( void )
+//  Stop sampling. The histogram is kept for a dump.
+void
+PROF_stop( void )
+{
+  TIM16->CR1 = 0;
+}
+
+
+//  int8_t
+//  PROF_start( uint16_t hz )
+//  Clear the histogram and sample hz times per second. Returns -1 if hz is not 16..10000.
+int8_t
+PROF_start( uint16_t hz )
+{
+  if( hz < 16 || hz > 10000 )
+    return -1;
+  PROF_stop();
+  for( uint16_t x = 0; x < PROF_BUCKETS; x++ )
+    PROF_counts[ x ] = 0;
+  PROF_outside  = 0;
+  PROF_handler  = 0;
+  PROF_halvings = 0;
+  PROF_paused   = 0;
+
+  // Profiler above everything else
+  for( uint8_t x = 0; x < 32; x++ )
+    NVIC_SetPriority( (IRQn_Type)x, 1 );
+  NVIC_SetPriority( SysTick_IRQn, 1 );
+  NVIC_SetPriority( TIM16_IRQn, 0 );
+
+  PROF_hz     = hz;
+  PROF_period = PROF_TICK_HZ / hz;
+  RCC->APB2ENR |= RCC_APB2ENR_TIM16EN;
+  TIM16->PSC  = CLOCK_hz / PROF_TICK_HZ - 1;
+  TIM16->ARR  = PROF_period;
+  TIM16->CNT  = 0;
+  TIM16->EGR  = TIM_EGR_UG;               // Load PSC
+  TIM16->SR   = 0;
+  TIM16->DIER = TIM_DIER_UIE;
+  TIM16->CR1  = TIM_CR1_CEN;
+  NVIC_EnableIRQ( TIM16_IRQn );
+  return 0;
+}
+
+
+//  void
+//  PROF_retime( void )
+//  Keep TIM16 counting microseconds after a change of CLOCK_hz. The new prescaler is
+//  taken at the next sample.
+void
+PROF_retime( void )
+{
+  TIM16->PSC = CLOCK_hz / PROF_TICK_HZ - 1;
+}
+
+
+//  void
+//  PROF_request( const uint8_t *payload, uint8_t len )
+//  Handle a DMX_TYPE_PROF frame.
+void
+PROF_request( const uint8_t *payload, uint8_t len )
+{
+  if( !len )
+    return;
+  switch( payload[ 0 ] )
+  {
+    case PROF_STOP:
+      PROF_stop();
+      break;
+    case PROF_START:
+      if( len >= 3 )
+        PROF_start( payload[ 1 ] | ( payload[ 2 ] << 8 ) );
+      break;
+    case PROF_DUMP:
+      PROF_sendIndex = len >= 3 ? payload[ 1 ] | ( payload[ 2 ] << 8 ) : 0;
+      PROF_paused    = 1;
+      PROF_sending   = 1;
+      break;
+  }
+}
+
+
+//  static void
+//  PROF_put32( uint8_t *buf, uint32_t value )
+//  Store a little endian u32 (buf may be unaligned).
+static void
+PROF_put32( uint8_t *buf, uint32_t value )
+{
+  for( uint8_t x = 0; x < 4; x++ )
+    buf[ x ] = value >> ( 8 * x );
+}
+
+
+//  void
+//  PROF_run( void )
+//  Call from the main loop: sends the next dump frame when the bulk queue has room.
+void
+PROF_run( void )
+{
+  uint8_t payload[ 2 + 2 * PROF_PER_FRAME ];
+  uint8_t n = 0;
+
+  if( !PROF_sending || TXQ_bulkFree() < DMX_FRAME_SIZE )
+    return;
+
+  if( PROF_sendIndex >= PROF_BUCKETS )
+  {
+    payload[ 0 ] = payload[ 1 ] = 0xFF;
+    PROF_put32( payload + 2, FLASH_BASE );
+    payload[ 6 ] = PROF_SHIFT;
+    payload[ 7 ] = PROF_BUCKETS & 0xFF;
+    payload[ 8 ] = PROF_BUCKETS >> 8;
+    PROF_put32( payload + 9, PROF_outside );
+    PROF_put32( payload + 13, PROF_handler );
+    payload[ 17 ] = PROF_halvings;
+    payload[ 18 ] = PROF_hz & 0xFF;
+    payload[ 19 ] = PROF_hz >> 8;
+    if( DMX_sendBulk( DMX_TYPE_PROF, payload, 20 ) )
+    {
+      PROF_sending = 0;
+      PROF_paused  = 0;
+    }
+    return;
+  }
+
+  payload[ 0 ] = PROF_sendIndex & 0xFF;
+  payload[ 1 ] = PROF_sendIndex >> 8;
+  for( ; n < PROF_PER_FRAME && PROF_sendIndex + n < PROF_BUCKETS; n++ )
+  {
+    payload[ 2 + 2 * n ]     = PROF_counts[ PROF_sendIndex + n ] & 0xFF;
+    payload[ 2 + 2 * n + 1 ] = PROF_counts[ PROF_sendIndex + n ] >> 8;
+  }
+  if( DMX_sendBulk( DMX_TYPE_PROF, payload, 2 + 2 * n ) )
+    PROF_sendIndex += n;
+}
+
+
+#endif /* __STM32F030_CMSIS_PROF_LIB_C */
@@ -0,0 +1,480 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-REC-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Black-box recorder: circular event log in spare flash pages
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Records are 8 bytes (time, type, two values) and are kept in the RECORD region of
+//    the linker script (_srecord.._erecord, whole 1K pages). Each page starts with a
+//    header holding a sequence number; the page with the highest number is the newest,
+//    the one after it (circularly) the oldest. When the newest page is full the oldest
+//    one is reused, so the log always holds the most recent ( pages - 2 ) * REC_PER_PAGE
+//    records or more.
+//
+//      page:    magic:u32 seq:u32 | record 0 | record 1 | ... | record 126
+//      record:  time:u32 (ms) type:u8 arg:u8 value:u16    (type 0xFF = unused)
+//
+//    Records are collected in RAM and written REC_BATCH at a time (or after REC_FLUSH_MS,
+//    or at once for REC_FAILSAFE) as one run of half-words through the flash driver. A
+//    record cut short by a power failure is skipped when reading back.
+//
+//    A page erase stops the CPU for 20..40 ms (STM32F030-CMSIS-FLASH-lib.c), so it is
+//    never done on the way: once the newest page is half full, the oldest one is erased
+//    in advance, the next time the link has been idle (nothing received, TX queue
+//    empty) for REC_QUIET_MS. A request that arrives during the erase waits in the RXF
+//    ring. Should the newest page fill up first, records wait in RAM, and are counted in
+//    REC_dropped once REC_BATCH are waiting.
+//
+//    Sources are sampled at their own rates by REC_run(); events are logged directly:
+//
+//      REC_addSource( REC_LINK, 1000, sampleLink );
+//      REC_event( REC_FAILSAFE, 1, 0 );
+//
+//    Download: a DMX_TYPE_REC frame (payload: first record index, u16, optional) starts
+//    streaming the log from oldest to newest as bulk frames of index:u16 + up to
+//    REC_PER_FRAME records. An empty frame (index only) ends the download. tools/recdump.py
+//    is the host side. Pages are not recycled while a download runs.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_REC_LIB_C
+#define __STM32F030_CMSIS_REC_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-FLASH-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+
+
+#define REC_MAGIC         0x31434552UL    // "REC1"
+#define REC_PER_PAGE      ( ( FLASH_PAGE_SIZE - 8 ) / sizeof( REC_record_t ) )
+#define REC_BATCH         8               // Records written per flash operation
+#define REC_FLUSH_MS      5000            // Longest time a record waits in RAM
+#define REC_MAX_SOURCES   4
+#define REC_PER_FRAME     6               // Records per download frame
+#define REC_QUIET_MS      50              // Link idle time before a page erase
+
+// Record types. Keep in sync with tools/recdump.py.
+#define REC_RESET         0x01            // arg = RCC_CSR reset flags (bits 31..24)
+#define REC_FAILSAFE      0x02            // arg = 1 entered, 0 left
+#define REC_LINK          0x03            // Link statistics, application defined
+#define REC_VOLTAGE       0x04            // value = supply in mV
+#define REC_POST          0x05            // arg = POST_flags, value = self-test time in us
+#define REC_SCRUB         0x06            // Image CRC mismatch in IMG_scrub, value = passes
+#define REC_CLOCK         0x07            // arg = CLOCK_failed, value = CLOCK_hz in kHz
+#define REC_TLM           0x08            // Stream not admitted at full rate: arg = TLM_add
+                                          //   result (255 = rejected), value = period in ms
+#define REC_FREE          0xFF
+
+
+typedef struct
+{
+  uint32_t time;
+  uint8_t  type;
+  uint8_t  arg;
+  uint16_t value;
+} REC_record_t;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t seq;
+} REC_page_t;
+
+// Fills in arg and value of a sampled record
+typedef void REC_sample_t( REC_record_t *rec );
+
+typedef struct
+{
+  REC_sample_t *sample;
+  uint16_t      periodMs;
+  uint8_t       type;
+  uint32_t      due;
+} REC_source_t;
+
+
+extern const uint8_t _srecord[], _erecord[];    // From the linker script
+
+REC_source_t     REC_sources[ REC_MAX_SOURCES ];
+uint8_t          REC_sourceCount;
+
+REC_record_t     REC_batch[ REC_BATCH ];          // Collecting
+REC_record_t     REC_writing[ REC_BATCH ];        // Being programmed
+uint8_t          REC_batchLen;
+uint32_t         REC_batchTime;                   // When the first record was added
+volatile uint8_t REC_busy;                        // Flash operations of a flush pending
+uint8_t          REC_urgent;                      // Flush as soon as possible
+
+uint8_t          REC_pages;
+uint8_t          REC_page;                        // Newest page
+uint16_t         REC_slot;                        // Next free record in it
+REC_page_t       REC_header;                      // Header of a page being started
+uint8_t          REC_spare;                       // The page after the newest is erased
+
+uint16_t         REC_rxSeen;                      // RXF_head at the last check
+uint32_t         REC_linkTime;                    // When the link was last seen busy
+
+uint16_t         REC_dropped;                     // Records lost (batch full)
+uint16_t         REC_errors;                      // Failed flash operations
+
+uint8_t          REC_sending;                     // Download in progress
+uint16_t         REC_sendIndex;                   // Index of the next record sent
+uint16_t         REC_sendSkip;                    // Records still to skip (start index)
+uint8_t          REC_sendPage;                    // Pages read so far, oldest first
+uint16_t         REC_sendSlot;
+
+
+//  static const REC_page_t *
+//  REC_pageAt( uint8_t page )
+//  Header of a page of the record region.
+static const REC_page_t *
+REC_pageAt( uint8_t page )
+{
+  return (const REC_page_t *)( _srecord + page * FLASH_PAGE_SIZE );
+}
+
+
+//  static const REC_record_t *
+//  REC_slotAt( uint8_t page, uint16_t slot )
+//  A record slot of a page.
+static const REC_record_t *
+REC_slotAt( uint8_t page, uint16_t slot )
+{
+  return (const REC_record_t *)( _srecord + page * FLASH_PAGE_SIZE +
+                                 sizeof( REC_page_t ) ) + slot;
+}
+
+
+//  static uint8_t
+//  REC_blank( const REC_record_t *rec )
+//  Returns 1 if the slot was never written.
+static uint8_t
+REC_blank( const REC_record_t *rec )
+{
+  const uint32_t *w = (const uint32_t *)rec;
+
+  return w[ 0 ] == 0xFFFFFFFF && w[ 1 ] == 0xFFFFFFFF;
+}
+
+
+//  static void
+//  REC_flushed( int8_t status )
+//  Flash callback of the last operation of a flush.
+static void
+REC_flushed( int8_t status )
+{
+  if( status < 0 )
+    REC_errors++;
+  REC_busy = 0;
+}
+
+
+//  static void
+//  REC_erased( int8_t status )
+//  Flash callback of the erase of the next page.
+static void
+REC_erased( int8_t status )
+{
+  if( status < 0 )
+    REC_errors++;
+  else
+    REC_spare = 1;
+  REC_busy = 0;
+}
+
+
+//  static uint8_t
+//  REC_blankPage( uint8_t page )
+//  Returns 1 if the page is erased.
+static uint8_t
+REC_blankPage( uint8_t page )
+{
+  const uint32_t *w = (const uint32_t *)REC_pageAt( page );
+
+  for( uint16_t x = 0; x < FLASH_PAGE_SIZE / 4; x++ )
+    if( w[ x ] != 0xFFFFFFFF )
+      return 0;
+  return 1;
+}
+
+
+//  static uint8_t
+//  REC_quiet( uint32_t now )
+//  Returns 1 if nothing was received and nothing was sent for REC_QUIET_MS. Call it
+//  often, it only notices activity while it is called.
+static uint8_t
+REC_quiet( uint32_t now )
+{
+  RXF_poll();
+  if( RXF_head != REC_rxSeen || !TXQ_idle() )
+  {
+    REC_rxSeen   = RXF_head;
+    REC_linkTime = now;
+  }
+  return now - REC_linkTime >= REC_QUIET_MS;
+}
+
+
+//  static void
+//  REC_counted( int8_t status )
+//  Flash callback of the other operations of a flush.
+static void
+REC_counted( int8_t status )
+{
+  if( status < 0 )
+    REC_errors++;
+}
+
+
+//  static void
+//  REC_flush( void )
+//  Hand the batch to the flash driver: the records that fit the newest page, and if it
+//  fills up and the next page is erased, the header of that page and the remaining
+//  records.
+static void
+REC_flush( void )
+{
+  uint8_t first, rest, count;
+
+  if( REC_busy || !REC_batchLen || FLASH_QUEUE_SIZE - FLASH_pending() < 3 )
+    return;
+
+  first = REC_PER_PAGE - REC_slot < REC_batchLen ? REC_PER_PAGE - REC_slot : REC_batchLen;
+  rest  = REC_spare && !REC_sending ? REC_batchLen - first : 0;   // Pages stay put while
+                                                                   //   a download runs
+  count = first + rest;
+  if( !count )
+    return;
+
+  for( uint8_t x = 0; x < REC_batchLen; x++ )
+    if( x < count )
+      REC_writing[ x ] = REC_batch[ x ];
+    else
+      REC_batch[ x - count ] = REC_batch[ x ];
+  REC_batchLen -= count;
+  REC_batchTime = SysTick_millis();
+  REC_busy      = 1;
+
+  if( first )
+    FLASH_program( (uint32_t)REC_slotAt( REC_page, REC_slot ), REC_writing,
+                   first * sizeof( REC_record_t ), rest ? REC_counted : REC_flushed );
+  REC_slot += first;
+  if( rest )
+  {
+    REC_header.magic = REC_MAGIC;
+    REC_header.seq   = REC_pageAt( REC_page )->seq + 1;
+    REC_page  = ( REC_page + 1 ) % REC_pages;
+    REC_slot  = rest;
+    REC_spare = 0;
+    FLASH_program( (uint32_t)REC_pageAt( REC_page ), &REC_header, sizeof( REC_header ),
+                   REC_counted );
+    FLASH_program( (uint32_t)REC_slotAt( REC_page, 0 ), &REC_writing[ first ],
+                   rest * sizeof( REC_record_t ), REC_flushed );
+  }
+}
+
+
+//  void
+//  REC_event( uint8_t type, uint8_t arg, uint16_t value )
+//  Log a record now. REC_FAILSAFE records are written to flash as soon as possible.
+void
+REC_event( uint8_t type, uint8_t arg, uint16_t value )
+{
+  REC_record_t *rec;
+
+  if( REC_batchLen == REC_BATCH )
+  {
+    REC_flush();
+    if( REC_batchLen == REC_BATCH )
+    {
+      REC_dropped++;
+      return;
+    }
+  }
+  if( !REC_batchLen )
+    REC_batchTime = SysTick_millis();
+  rec = &REC_batch[ REC_batchLen++ ];
+  rec->time  = SysTick_millis();
+  rec->type  = type;
+  rec->arg   = arg;
+  rec->value = value;
+  if( type == REC_FAILSAFE )
+    REC_urgent = 1;
+}
+
+
+//  int8_t
+//  REC_addSource( uint8_t type, uint16_t periodMs, REC_sample_t *sample )
+//  Sample a record of the given type every periodMs. Returns -1 if there is no room.
+int8_t
+REC_addSource( uint8_t type, uint16_t periodMs, REC_sample_t *sample )
+{
+  REC_source_t *src;
+
+  if( REC_sourceCount == REC_MAX_SOURCES || !periodMs )
+    return -1;
+  src = &REC_sources[ REC_sourceCount++ ];
+  src->sample   = sample;
+  src->periodMs = periodMs;
+  src->type     = type;
+  src->due      = SysTick_millis() + periodMs;
+  return 0;
+}
+
+
+//  void
+//  REC_init( void )
+//  Find the newest page and the first free slot in it, or start the log on an empty
+//  region, and log the reset cause. SysTick_init and FLASH_init must have been called.
+//  Call it before the link is started: on an empty region it erases the first page.
+void
+REC_init( void )
+{
+  uint8_t  found = 0;
+  uint32_t seq = 0;
+
+  REC_pages = ( _erecord - _srecord ) / FLASH_PAGE_SIZE;
+  REC_page  = 0;
+  for( uint8_t x = 0; x < REC_pages; x++ )
+    if( REC_pageAt( x )->magic == REC_MAGIC && ( !found || REC_pageAt( x )->seq > seq ) )
+    {
+      found    = 1;
+      seq      = REC_pageAt( x )->seq;
+      REC_page = x;
+    }
+
+  REC_spare = 0;
+  if( found )
+  {
+    REC_slot = REC_PER_PAGE;
+    while( REC_slot && REC_blank( REC_slotAt( REC_page, REC_slot - 1 ) ) )
+      REC_slot--;
+    REC_spare = REC_blankPage( ( REC_page + 1 ) % REC_pages );
+  }
+  else                                            // Empty region: start at page 0
+  {
+    REC_header.magic = REC_MAGIC;
+    REC_header.seq   = 1;
+    REC_slot         = 0;
+    REC_busy         = 1;
+    FLASH_erase( (uint32_t)REC_pageAt( 0 ), REC_counted );
+    FLASH_program( (uint32_t)REC_pageAt( 0 ), &REC_header, sizeof( REC_header ),
+                   REC_flushed );
+  }
+
+  REC_linkTime = SysTick_millis();
+  REC_event( REC_RESET, RCC->CSR >> 24, 0 );
+  RCC->CSR |= RCC_CSR_RMVF;
+}
+
+
+//  static void
+//  REC_send( void )
+//  Queue the next download frame if the bulk queue has room for it.
+static void
+REC_send( void )
+{
+  uint8_t        payload[ 2 + REC_PER_FRAME * sizeof( REC_record_t ) ];
+  uint8_t        n = 0;
+  uint8_t        page;
+  const uint8_t *rec;
+
+  if( TXQ_bulkFree() < DMX_FRAME_SIZE )
+    return;
+
+  while( n < REC_PER_FRAME && REC_sendPage < REC_pages )
+  {
+    page = ( REC_page + 1 + REC_sendPage ) % REC_pages;
+    if( REC_pageAt( page )->magic != REC_MAGIC || REC_sendSlot == REC_PER_PAGE ||
+        ( page == REC_page && REC_sendSlot >= REC_slot ) )
+    {
+      REC_sendPage++;
+      REC_sendSlot = 0;
+      continue;
+    }
+    if( REC_slotAt( page, REC_sendSlot )->type != REC_FREE )
+    {
+      if( REC_sendSkip )
+        REC_sendSkip--;
+      else                                        // Byte copy: payload is unaligned
+      {
+        rec = (const uint8_t *)REC_slotAt( page, REC_sendSlot );
+        for( uint8_t x = 0; x < sizeof( REC_record_t ); x++ )
+          payload[ 2 + n * sizeof( REC_record_t ) + x ] = rec[ x ];
+        n++;
+        REC_sendIndex++;
+      }
+    }
+    REC_sendSlot++;
+  }
+
+  payload[ 0 ] = ( REC_sendIndex - n ) & 0xFF;
+  payload[ 1 ] = ( REC_sendIndex - n ) >> 8;
+  DMX_sendBulk( DMX_TYPE_REC, payload, 2 + n * sizeof( REC_record_t ) );
+  if( !n )
+    REC_sending = 0;
+}
+
+
+//  void
+//  REC_request( const uint8_t *payload, uint8_t len )
+//  Handle a DMX_TYPE_REC frame: start a download at the given record index.
+void
+REC_request( const uint8_t *payload, uint8_t len )
+{
+  REC_sendSkip  = len >= 2 ? payload[ 0 ] | ( payload[ 1 ] << 8 ) : 0;
+  REC_sendIndex = REC_sendSkip;
+  REC_sendPage  = 0;
+  REC_sendSlot  = 0;
+  REC_sending   = 1;
+  REC_urgent    = 1;                              // Include what is still in RAM
+}
+
+
+//  void
+//  REC_run( void )
+//  Call from the main loop: samples due sources, writes batches, erases the next page
+//  while the link is idle and sends download frames.
+void
+REC_run( void )
+{
+  uint32_t      now = SysTick_millis();
+  REC_source_t *src;
+  REC_record_t  rec;
+  uint8_t       quiet = REC_quiet( now );
+
+  for( uint8_t x = 0; x < REC_sourceCount; x++ )
+  {
+    src = &REC_sources[ x ];
+    if( (int32_t)( now - src->due ) >= 0 )
+    {
+      src->due += src->periodMs;
+      if( (int32_t)( now - src->due ) >= 0 )       // Fell behind: skip, don't burst
+        src->due = now + src->periodMs;
+      rec.arg   = 0;
+      rec.value = 0;
+      src->sample( &rec );
+      REC_event( src->type, rec.arg, rec.value );
+    }
+  }
+
+  if( REC_batchLen == REC_BATCH || REC_urgent ||
+      ( REC_batchLen && now - REC_batchTime >= REC_FLUSH_MS ) )
+  {
+    REC_flush();
+    if( !REC_batchLen )
+      REC_urgent = 0;
+  }
+
+  if( quiet && !REC_spare && !REC_busy && !REC_sending && REC_slot >= REC_PER_PAGE / 2 &&
+      FLASH_pending() < FLASH_QUEUE_SIZE )
+  {
+    REC_busy = 1;
+    FLASH_erase( (uint32_t)REC_pageAt( ( REC_page + 1 ) % REC_pages ), REC_erased );
+  }
+
+  if( REC_sending && !REC_busy )
+    REC_send();
+}
+
+
+#endif /* __STM32F030_CMSIS_REC_LIB_C */
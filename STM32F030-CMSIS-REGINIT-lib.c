@@ -0,0 +1,85 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-REGINIT-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Peripheral register setup as a table, applied by Reset_Handler
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    A library with fixed register settings lists them in an entry macro, one entry per
+//    register in the order they must be written:
+//
+//      #define TXQ_REGINIT( X )
+//        X( DMA1_Channel2->CPAR, REGINIT_ALL, USART1_BASE + ... )
+//        X( DMA1_Channel2->CCR,  REGINIT_ALL, DMA_CCR_MINC | DMA_CCR_DIR )
+//
+//    (one macro, continued with backslashes)
+//
+//    Each entry is ( register, mask, value ): the bits in mask are replaced by value, the
+//    others kept. A mask of REGINIT_ALL writes the register without reading it. Bits a
+//    library sets in a register that others need too (clock enables, USART control) are
+//    not entries but a bit macro, named after the library and the register:
+//
+//      #define TXQ_REGINIT_AHBENR    RCC_AHBENR_DMAEN
+//      #define TXQ_REGINIT_CR3       USART_CR3_DMAT
+//
+//    The application collects the lists of the libraries it uses in REGINIT_OPS, before
+//    including any library, with one REGINIT_BITS entry per shared register that ORs
+//    the bit macros, and emits the table after the last library:
+//
+//      #define REGINIT_OPS( X )
+//        REGINIT_BITS( X, RCC->AHBENR, USART_REGINIT_AHBENR | TXQ_REGINIT_AHBENR )
+//        USART_REGINIT( X ) TXQ_REGINIT( X )
+//        REGINIT_BITS( X, USART1->CR3, TXQ_REGINIT_CR3 )
+//      #include ...
+//      REGINIT_TABLE( REGINIT_OPS );
+//
+//    so every register is written once. REGINIT_table (12 bytes per entry) goes into
+//    the .reginit flash section.
+//    Reset_Handler runs it after the bss is cleared, before main(), with a loop of a few
+//    instructions per entry:
+//
+//      *reg = ( *reg & ~mask ) | value
+//
+//    Without REGINIT_OPS the libraries write their entries from their init functions
+//    (REGINIT_SET), with it they only do what depends on run time values (baud rate,
+//    buffer addresses, interrupts). Outputs that the power-on self-test gates must stay
+//    out of the table, it runs before POST_run. After a warm boot
+//    (STM32F030-CMSIS-WARM-lib.c) it runs on top of the restored registers, so shared
+//    registers (RCC, GPIO) need a mask.
+//
+//    tools/reginit.py lists the table of a build with register names and fails if a
+//    register is written twice (the Makefile runs it on every link).
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_REGINIT_LIB_C
+#define __STM32F030_CMSIS_REGINIT_LIB_C
+
+#include <stddef.h>
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define REGINIT_ALL       0xFFFFFFFFUL    // Mask: write the whole register
+
+typedef struct
+{
+  volatile uint32_t *reg;
+  uint32_t           mask;
+  uint32_t           value;
+} REGINIT_t;
+
+
+#define REGINIT_ENTRY( reg, mask, value )   { &(reg), (mask), (value) },
+
+// One entry setting bits (the bit macros of several libraries ORed) in a shared register
+#define REGINIT_BITS( X, reg, bits )        X( reg, (bits), (bits) )
+
+// Write one entry at run time, the same way Reset_Handler does
+#define REGINIT_SET( reg, mask, value )                                            \
+  (reg) = (mask) == REGINIT_ALL ? (value) : ( ( (reg) & ~(mask) ) | (value) );
+
+// Emit the boot table from an entry list, once, after every library is included
+#define REGINIT_TABLE( ops )                                                       \
+  __attribute__(( section( ".reginit" ), used ))                                   \
+  const REGINIT_t REGINIT_table[] = { ops( REGINIT_ENTRY ) }
+
+
+#endif /* __STM32F030_CMSIS_REGINIT_LIB_C */
@@ -0,0 +1,234 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-RING-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Power-of-two single-producer single-consumer byte ring
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Shared queue for every buffered path (UART TX/RX, logs, events). One side (thread or
+//    interrupt) only writes, the other only reads, so no locking is needed:
+//
+//      head  free running write index, changed only by the producer
+//      tail  free running read index, changed only by the consumer
+//
+//    The capacity is a compile-time power of two (checked by RING_DEFINE), so indices wrap
+//    with a mask and head - tail is the fill level even across the 16-bit wrap. All
+//    storage is static.
+//
+//    Ordering: the producer stores the data, then publishes head; the consumer reads head,
+//    then the data. The Cortex-M0 executes in order, but the compiler may move plain
+//    loads and stores across the index update, and a DMA controller reads memory on its
+//    own, so __DMB() (a barrier for both) sits between data and index accesses.
+//
+//    Bulk access for DMA works on contiguous spans inside the buffer:
+//
+//      n = RING_writeSpan( &r, &p );  fill up to n bytes at p;  RING_commitWrite( &r, k );
+//      n = RING_readSpan( &r, &p );   send up to n bytes from p; RING_commitRead( &r, k );
+//
+//    Bulk copies go through RING_copy, which selects RING_copy_c or, when built with
+//    ASM_KERNELS, the Thumb-1 twin RING_copy_asm from kernels_cortexm0.s.
+//
+//    Usage:
+//      RING_DEFINE( logRing, 128 );
+//      RING_put( &logRing, 'x' );
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_RING_LIB_C
+#define __STM32F030_CMSIS_RING_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+typedef struct
+{
+  uint8_t          *buf;
+  uint16_t          mask;     // Capacity - 1
+  volatile uint16_t head;
+  volatile uint16_t tail;
+} RING_t;
+
+
+#ifdef ASM_KERNELS
+  void RING_copy_asm( uint8_t *dst, const uint8_t *src, uint32_t len );
+  #define RING_copy RING_copy_asm
+#else
+  #define RING_copy RING_copy_c
+#endif
+
+
+// Define a ring named name holding size bytes. size must be a power of two <= 32768.
+#define RING_DEFINE( name, size )                                                  \
+  _Static_assert( (size) && !( (size) & ( (size) - 1 ) ) && (size) <= 32768,       \
+                  #name ": ring size must be a power of two" );                    \
+  uint8_t name##_buf[ size ];                                                      \
+  RING_t  name = { name##_buf, (size) - 1, 0, 0 }
+
+
+//  void
+//  RING_copy_c( uint8_t *dst, const uint8_t *src, uint32_t len )
+//  Byte copy used for bulk transfers in and out of the ring.
+static inline void
+RING_copy_c( uint8_t *dst, const uint8_t *src, uint32_t len )
+{
+  while( len-- )
+    *dst++ = *src++;
+}
+
+
+//  uint16_t
+//  RING_count( RING_t *r )
+//  Returns the number of bytes in the ring.
+static inline uint16_t
+RING_count( RING_t *r )
+{
+  return (uint16_t)( r->head - r->tail );
+}
+
+
+//  uint16_t
+//  RING_free( RING_t *r )
+//  Returns the number of bytes that can still be written.
+static inline uint16_t
+RING_free( RING_t *r )
+{
+  return r->mask + 1 - RING_count( r );
+}
+
+
+//  uint8_t
+//  RING_put( RING_t *r, uint8_t c )
+//  Producer: append one byte. Returns 0 if the ring is full.
+static inline uint8_t
+RING_put( RING_t *r, uint8_t c )
+{
+  uint16_t head = r->head;
+
+  if( (uint16_t)( head - r->tail ) > r->mask )
+    return 0;
+  r->buf[ head & r->mask ] = c;
+  __DMB();
+  r->head = head + 1;
+  return 1;
+}
+
+
+//  int16_t
+//  RING_get( RING_t *r )
+//  Consumer: remove one byte. Returns the byte, or -1 if the ring is empty.
+static inline int16_t
+RING_get( RING_t *r )
+{
+  uint16_t tail = r->tail;
+  uint8_t  c;
+
+  if( tail == r->head )
+    return -1;
+  __DMB();
+  c = r->buf[ tail & r->mask ];
+  __DMB();
+  r->tail = tail + 1;
+  return c;
+}
+
+
+//  uint16_t
+//  RING_writeSpan( RING_t *r, uint8_t **data )
+//  Producer: points *data at the first free byte and returns how many free bytes follow
+//  it contiguously.
+static inline uint16_t
+RING_writeSpan( RING_t *r, uint8_t **data )
+{
+  uint16_t start = r->head & r->mask;
+  uint16_t count = RING_free( r );
+
+  if( count > r->mask + 1 - start )
+    count = r->mask + 1 - start;
+  *data = &r->buf[ start ];
+  return count;
+}
+
+
+//  void
+//  RING_commitWrite( RING_t *r, uint16_t count )
+//  Producer: publish count bytes written through RING_writeSpan.
+static inline void
+RING_commitWrite( RING_t *r, uint16_t count )
+{
+  __DMB();
+  r->head += count;
+}
+
+
+//  uint16_t
+//  RING_readSpan( RING_t *r, const uint8_t **data )
+//  Consumer: points *data at the oldest byte and returns how many bytes follow it
+//  contiguously.
+static inline uint16_t
+RING_readSpan( RING_t *r, const uint8_t **data )
+{
+  uint16_t start = r->tail & r->mask;
+  uint16_t count = RING_count( r );
+
+  __DMB();
+  if( count > r->mask + 1 - start )
+    count = r->mask + 1 - start;
+  *data = &r->buf[ start ];
+  return count;
+}
+
+
+//  void
+//  RING_commitRead( RING_t *r, uint16_t count )
+//  Consumer: release count bytes read through RING_readSpan.
+static inline void
+RING_commitRead( RING_t *r, uint16_t count )
+{
+  __DMB();
+  r->tail += count;
+}
+
+
+//  uint16_t
+//  RING_write( RING_t *r, const void *data, uint16_t len )
+//  Producer: append up to len bytes. Returns the number of bytes written.
+static inline uint16_t
+RING_write( RING_t *r, const void *data, uint16_t len )
+{
+  const uint8_t *src = data;
+  uint8_t       *dst;
+  uint16_t       done = 0, count;
+
+  while( done < len && ( count = RING_writeSpan( r, &dst ) ) )
+  {
+    if( count > len - done )
+      count = len - done;
+    RING_copy( dst, &src[ done ], count );
+    RING_commitWrite( r, count );
+    done += count;
+  }
+  return done;
+}
+
+
+//  uint16_t
+//  RING_read( RING_t *r, void *buf, uint16_t len )
+//  Consumer: remove up to len bytes into buf. Returns the number of bytes read.
+static inline uint16_t
+RING_read( RING_t *r, void *buf, uint16_t len )
+{
+  uint8_t       *dst = buf;
+  const uint8_t *src;
+  uint16_t       done = 0, count;
+
+  while( done < len && ( count = RING_readSpan( r, &src ) ) )
+  {
+    if( count > len - done )
+      count = len - done;
+    RING_copy( &dst[ done ], src, count );
+    RING_commitRead( r, count );
+    done += count;
+  }
+  return done;
+}
+
+
+#endif /* __STM32F030_CMSIS_RING_LIB_C */
@@ -0,0 +1,199 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-SWAR-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Word-at-a-time (SWAR) byte search and ASCII classification
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Received data is scanned four bytes per load instead of one. The tests work on all
+//    four bytes of a 32-bit word at once:
+//
+//      byte == 0   anywhere:  ( v - 0x01010101 ) & ~v & 0x80808080
+//      byte <  n   anywhere:  ( v - n * 0x01010101 ) & ~v & 0x80808080       ( n <= 0x80 )
+//      byte >  n   anywhere:  ( ( v + ( 0x7F - n ) * 0x01010101 ) | v ) & 0x80808080
+//
+//    Searching for byte c is searching for 0 in v ^ ( c * 0x01010101 ). Borrows and
+//    carries only travel towards the more significant bytes, so the lowest flagged byte
+//    (the first in memory, little endian) is always a true match; flags above it may be
+//    false and are ignored.
+//
+//    The Cortex-M0 faults on unaligned word loads, so every routine handles the bytes up
+//    to the first word boundary and the bytes after the last whole word one at a time.
+//    Short buffers (under 8 bytes) are not worth the setup and are scanned bytewise.
+//
+//    The Cortex-M0 has no CLZ/RBIT, so the flagged byte is located with byte tests once
+//    a word matches.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_SWAR_LIB_C
+#define __STM32F030_CMSIS_SWAR_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define SWAR_ONES   0x01010101UL
+#define SWAR_HIGHS  0x80808080UL
+
+// Word loads from byte buffers; may_alias keeps them valid under strict aliasing
+typedef uint32_t __attribute__(( may_alias )) SWAR_word_t;
+
+
+//  uint32_t
+//  SWAR_first( uint32_t flags )
+//  Returns the index (0..3) of the lowest byte whose high bit is set in flags, which must
+//  be non-zero.
+static inline uint32_t
+SWAR_first( uint32_t flags )
+{
+  if( flags & 0x000080 )
+    return 0;
+  if( flags & 0x008000 )
+    return 1;
+  if( flags & 0x800000 )
+    return 2;
+  return 3;
+}
+
+
+//  uint32_t
+//  SWAR_printableFlags( uint32_t v )
+//  Flags the bytes of v outside 0x20..0x7E (control characters, DEL and 8-bit bytes).
+static inline uint32_t
+SWAR_printableFlags( uint32_t v )
+{
+  return ( ( ( v - 0x20 * SWAR_ONES ) & ~v ) |
+           ( ( v + ( 0x7F - 0x7E ) * SWAR_ONES ) | v ) ) & SWAR_HIGHS;
+}
+
+
+//  uint32_t
+//  SWAR_lineEndFlags( uint32_t v )
+//  Flags the bytes of v equal to '\r', '\n' or 0x00.
+static inline uint32_t
+SWAR_lineEndFlags( uint32_t v )
+{
+  uint32_t cr = v ^ ( '\r' * SWAR_ONES );
+  uint32_t lf = v ^ ( '\n' * SWAR_ONES );
+
+  return ( ( ( cr - SWAR_ONES ) & ~cr ) | ( ( lf - SWAR_ONES ) & ~lf ) |
+           ( ( v - SWAR_ONES ) & ~v ) ) & SWAR_HIGHS;
+}
+
+
+//  uint16_t
+//  SWAR_findByte( const uint8_t *data, uint16_t len, uint8_t c )
+//  Returns the index of the first byte equal to c, or len if there is none.
+uint16_t
+SWAR_findByte( const uint8_t *data, uint16_t len, uint8_t c )
+{
+  const uint32_t pattern = c * SWAR_ONES;
+  uint16_t       x = 0;
+
+  if( len >= 8 )
+  {
+    for( ; (uintptr_t)&data[ x ] & 3; x++ )
+      if( data[ x ] == c )
+        return x;
+
+    for( ; x + 4 <= len; x += 4 )
+    {
+      uint32_t v = *(const SWAR_word_t *)&data[ x ] ^ pattern;
+      uint32_t flags = ( v - SWAR_ONES ) & ~v & SWAR_HIGHS;
+
+      if( flags )
+        return x + SWAR_first( flags );
+    }
+  }
+
+  for( ; x < len; x++ )
+    if( data[ x ] == c )
+      return x;
+  return len;
+}
+
+
+//  uint16_t
+//  SWAR_findLineEnd( const uint8_t *data, uint16_t len )
+//  Returns the index of the first '\r', '\n' or 0x00, or len if there is none. For line
+//  oriented input such as NMEA sentences.
+uint16_t
+SWAR_findLineEnd( const uint8_t *data, uint16_t len )
+{
+  uint16_t x = 0;
+
+  if( len >= 8 )
+  {
+    for( ; (uintptr_t)&data[ x ] & 3; x++ )
+      if( data[ x ] == '\r' || data[ x ] == '\n' || data[ x ] == 0 )
+        return x;
+
+    for( ; x + 4 <= len; x += 4 )
+    {
+      uint32_t flags = SWAR_lineEndFlags( *(const SWAR_word_t *)&data[ x ] );
+
+      if( flags )
+        return x + SWAR_first( flags );
+    }
+  }
+
+  for( ; x < len; x++ )
+    if( data[ x ] == '\r' || data[ x ] == '\n' || data[ x ] == 0 )
+      return x;
+  return len;
+}
+
+
+//  uint16_t
+//  SWAR_spanPrintable( const uint8_t *data, uint16_t len )
+//  Returns the length of the leading run of printable ASCII (0x20..0x7E). Equal to len if
+//  the whole buffer is printable.
+uint16_t
+SWAR_spanPrintable( const uint8_t *data, uint16_t len )
+{
+  uint16_t x = 0;
+
+  if( len >= 8 )
+  {
+    for( ; (uintptr_t)&data[ x ] & 3; x++ )
+      if( data[ x ] < 0x20 || data[ x ] > 0x7E )
+        return x;
+
+    for( ; x + 4 <= len; x += 4 )
+    {
+      uint32_t flags = SWAR_printableFlags( *(const SWAR_word_t *)&data[ x ] );
+
+      if( flags )
+        return x + SWAR_first( flags );
+    }
+  }
+
+  for( ; x < len; x++ )
+    if( data[ x ] < 0x20 || data[ x ] > 0x7E )
+      return x;
+  return len;
+}
+
+
+//  uint8_t
+//  SWAR_isAscii( const uint8_t *data, uint16_t len )
+//  Returns 1 if no byte has bit 7 set (7-bit clean), otherwise 0.
+uint8_t
+SWAR_isAscii( const uint8_t *data, uint16_t len )
+{
+  uint32_t acc = 0;
+  uint16_t x = 0;
+
+  if( len >= 8 )
+  {
+    for( ; (uintptr_t)&data[ x ] & 3; x++ )
+      acc |= data[ x ];
+    for( ; x + 4 <= len; x += 4 )
+      acc |= *(const SWAR_word_t *)&data[ x ];
+  }
+  for( ; x < len; x++ )
+    acc |= data[ x ];
+
+  return !( acc & SWAR_HIGHS );
+}
+
+
+#endif /* __STM32F030_CMSIS_SWAR_LIB_C */
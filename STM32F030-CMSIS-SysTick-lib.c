@@ -0,0 +1,142 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-SysTick-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Millisecond time base and cycle timestamps using the Cortex-M0 SysTick timer
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    SysTick is loaded to roll over once per millisecond and the SysTick_Handler counts the
+//    roll-overs in SysTick_ms. Finer timestamps are built from the millisecond count plus
+//    the current (down-counting) SysTick->VAL, so no extra timer peripheral is needed.
+//
+//    Reload Calculation:
+//      f(CK) = CLOCK_hz (STM32F030-CMSIS-CLOCK-lib.c), the internal RC clock: 8 MHz
+//        LOAD = f(CK) / 1000 - 1 = 7999
+//      SysTick_retime() reloads it after a clock change; the millisecond count goes on,
+//      cycle counts taken across the change do not compare.
+//
+//    A timestamp read is only coherent if SysTick_ms and SysTick->VAL belong to the same
+//    millisecond. SysTick_sample() re-reads the counter until it is stable and, when called
+//    with interrupts masked, checks the pending SysTick flag for a roll-over that the
+//    handler has not counted yet.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_SYSTICK_LIB_C
+#define __STM32F030_CMSIS_SYSTICK_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-CLOCK-lib.c"
+
+
+volatile uint32_t SysTick_ms;         // Milliseconds since SysTick_init()
+uint32_t          SysTick_cyclesMs;   // Core clock cycles per millisecond (LOAD + 1)
+uint32_t          SysTick_cyclesUs;   // And per microsecond
+
+
+//  void
+//  SysTick_retime( void )
+//  Reload for a 1 ms period at the current CLOCK_hz. The millisecond in progress restarts.
+void
+SysTick_retime( void )
+{
+  SysTick_cyclesMs = CLOCK_hz / 1000;
+  SysTick_cyclesUs = CLOCK_hz / 1000000;
+  SysTick->LOAD    = SysTick_cyclesMs - 1;
+  SysTick->VAL     = 0;
+}
+
+
+//  void
+//  SysTick_init( void )
+//  Start SysTick with a 1 ms period from the core clock and enable its interrupt.
+void
+SysTick_init( void )
+{
+  SysTick_ms    = 0;
+  SysTick_retime();
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk |
+                  SysTick_CTRL_ENABLE_Msk;
+}
+
+
+void
+SysTick_Handler( void )
+{
+  SysTick_ms++;
+}
+
+
+//  uint32_t
+//  SysTick_millis( void )
+//  Returns milliseconds since SysTick_init(). Wraps after about 49 days.
+uint32_t
+SysTick_millis( void )
+{
+  return SysTick_ms;
+}
+
+
+//  uint32_t
+//  SysTick_sample( uint32_t *ms )
+//  Reads a coherent (milliseconds, cycles into this millisecond) pair. Returns the cycles
+//  and stores the milliseconds in *ms.
+static uint32_t
+SysTick_sample( uint32_t *ms )
+{
+  uint32_t thisMs, val;
+
+  do
+  {
+    thisMs = SysTick_ms;
+    val    = SysTick->VAL;
+  } while( thisMs != SysTick_ms );
+
+  // With interrupts masked the handler cannot run, so a roll-over shows up only as a
+  // pending SysTick exception. A high count value means VAL was read after the reload.
+  if( ( SCB->ICSR & SCB_ICSR_PENDSTSET_Msk ) && val > SysTick_cyclesMs / 2 )
+    thisMs++;
+
+  *ms = thisMs;
+  return SysTick_cyclesMs - 1 - val;
+}
+
+
+//  uint32_t
+//  SysTick_cycles( void )
+//  Returns core clock cycles since SysTick_init(). Wraps after 2^32 cycles (536 s at
+//  8 MHz), so it is intended for measuring intervals with unsigned subtraction.
+uint32_t
+SysTick_cycles( void )
+{
+  uint32_t ms, cycles;
+
+  cycles = SysTick_sample( &ms );
+  return ms * SysTick_cyclesMs + cycles;
+}
+
+
+//  uint32_t
+//  SysTick_micros( void )
+//  Returns microseconds since SysTick_init(). Wraps after about 71 minutes.
+uint32_t
+SysTick_micros( void )
+{
+  uint32_t ms, cycles;
+
+  cycles = SysTick_sample( &ms );
+  return ms * 1000 + cycles / SysTick_cyclesUs;
+}
+
+
+//  void
+//  SysTick_delay( uint32_t ms )
+//  Busy-waits for at least ms milliseconds.
+void
+SysTick_delay( uint32_t ms )
+{
+  uint32_t start = SysTick_ms;
+
+  while( SysTick_ms - start < ms ) ;
+}
+
+
+#endif /* __STM32F030_CMSIS_SYSTICK_LIB_C */
@@ -0,0 +1,331 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-TLM-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Rate-monotonic telemetry scheduler for the STM32F030 USART
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Multiplexes several periodic telemetry and log streams onto one serial port. Each
+//    stream declares a release period and the worst-case number of bytes it emits per
+//    release. Streams are kept sorted by period (rate-monotonic priority: the shortest
+//    period is served first).
+//
+//    Admission (done in TLM_add, i.e. at configuration time):
+//      Link capacity   = baud / 10 bytes per second (8N1 framing)
+//      Stream demand   = maxBytes * 1000 / periodMs bytes per second
+//      Usable capacity = link capacity * Liu-Layland bound for the number of streams
+//
+//      Critical streams must fit into the usable capacity at full rate, otherwise TLM_add
+//      rejects them. Other streams are admitted in priority order into what is left and
+//      get a decimation factor (emit every Nth release) if they do not fit at full rate,
+//      or are parked (decimation 0) if not even 1/255 of their rate fits.
+//
+//    Run time (TLM_run from the main loop):
+//      A token bucket refilled at the link byte rate tracks how much the port can take.
+//      It holds TLM_BURST_MS of link time, but at least TLM_MAX_RECORD bytes, so any
+//      record TLM_add accepts fits at any baud rate. A due release is emitted only if
+//      the bucket holds the stream's worst-case byte count. Otherwise the link is
+//      saturated and the release is dropped and counted instead of delaying higher
+//      priority streams.
+//
+//      Everything written to the port has to be reported with TLM_account, the records
+//      of the streams included. With the TX queue that is one hook, which sees every
+//      byte queued by anyone:
+//
+//        TXQ_onQueued = TLM_account;
+//        TLM_setWriter( TXQ_bulk );
+//
+//      With the blocking USART_putc (no writer) TLM_run counts its own records.
+//      Traffic outside the scheduler can overdraw the bucket by up to TLM_DEBT_MS of link
+//      time; the streams pause until the link has caught up.
+//
+//    All arithmetic is integer. Bounds are kept in per-mille.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_TLM_LIB_C
+#define __STM32F030_CMSIS_TLM_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-USART-lib.c"
+#include "STM32F030-CMSIS-SysTick-lib.c"
+
+
+#define TLM_MAX_STREAMS   8     // Number of stream slots
+#define TLM_MAX_RECORD    48    // Largest record a stream may emit per release
+#define TLM_BURST_MS      10    // Token bucket depth in milliseconds of link time (or
+                                //   TLM_MAX_RECORD bytes on slow links)
+#define TLM_DEBT_MS       250   // Largest overdraw in milliseconds of link time
+
+
+// uint8_t
+// TLM_fill_t( char *buf, uint8_t maxLen )
+// Stream producer. Writes one record of at most maxLen bytes into buf and returns its
+// length, or 0 if there is nothing to send for this release.
+typedef uint8_t (*TLM_fill_t)( char *buf, uint8_t maxLen );
+
+// uint16_t
+// TLM_write_t( const void *data, uint16_t len )
+// Output path, e.g. TXQ_bulk. Returns the number of bytes accepted.
+typedef uint16_t (*TLM_write_t)( const void *data, uint16_t len );
+
+typedef struct
+{
+  TLM_fill_t fill;        // Record producer
+  uint16_t   periodMs;    // Release period, defines the priority
+  uint8_t    maxBytes;    // Worst-case record length (byte budget per release)
+  uint8_t    critical;    // Non-zero: must run at full rate, admission fails otherwise
+  uint8_t    decim;       // Emit every decim-th release, 0 = parked
+  uint8_t    phase;       // Releases since the last emitted one
+  uint16_t   dropped;     // Releases lost to link saturation or overrun
+  uint32_t   release;     // Next release time in SysTick_ms
+} TLM_stream_t;
+
+
+TLM_stream_t TLM_streams[ TLM_MAX_STREAMS ];
+uint8_t      TLM_count;       // Registered streams
+uint32_t     TLM_linkBps;     // Link capacity in bytes per second
+int32_t      TLM_tokens;      // Token bucket level in bytes, negative when overdrawn
+uint32_t     TLM_tokenFrac;   // Sub-byte remainder of the refill, in 1/1000 byte
+uint32_t     TLM_lastMs;      // Last refill time
+TLM_write_t  TLM_write;       // Output path, 0 = blocking USART_putc
+volatile uint32_t TLM_sent;   // Bytes reported by TLM_account, not yet taken by TLM_run
+
+
+// Liu-Layland utilization bound n * ( 2^(1/n) - 1 ) in per-mille for n = 1..8. Beyond
+// that the bound is close to its limit ln(2).
+static const uint16_t TLM_bound[ TLM_MAX_STREAMS ] =
+  { 1000, 828, 779, 756, 743, 734, 728, 724 };
+
+
+//  static int32_t
+//  TLM_depth( void )
+//  Token bucket depth in bytes.
+static int32_t
+TLM_depth( void )
+{
+  uint32_t depth = TLM_linkBps * TLM_BURST_MS / 1000;
+
+  return depth < TLM_MAX_RECORD ? TLM_MAX_RECORD : depth;
+}
+
+
+//  void
+//  TLM_init( uint32_t baudrate )
+//  Reset the scheduler for a port running at baudrate with 8N1 framing. SysTick must be
+//  running (SysTick_init) before TLM_run is called.
+void
+TLM_init( uint32_t baudrate )
+{
+  TLM_count     = 0;
+  TLM_write     = 0;
+  TLM_linkBps   = baudrate / 10;
+  TLM_tokens    = TLM_depth();
+  TLM_tokenFrac = 0;
+  TLM_sent      = 0;
+  TLM_lastMs    = SysTick_millis();
+}
+
+
+//  uint8_t
+//  TLM_admit( void )
+//  Recompute the decimation factor of every stream from the current stream set. Returns 0
+//  if the critical streams alone exceed the usable capacity, otherwise 1.
+static uint8_t
+TLM_admit( void )
+{
+  uint32_t capacity, used = 0, demand, left;
+
+  capacity = TLM_linkBps * TLM_bound[ TLM_count - 1 ] / 1000;
+
+  for( uint8_t x = 0; x < TLM_count; x++ )
+    if( TLM_streams[ x ].critical )
+    {
+      used += (uint32_t)TLM_streams[ x ].maxBytes * 1000 / TLM_streams[ x ].periodMs;
+      TLM_streams[ x ].decim = 1;
+    }
+  if( used > capacity )
+    return 0;
+
+  for( uint8_t x = 0; x < TLM_count; x++ )      // Priority order, critical ones skipped
+  {
+    TLM_stream_t *s = &TLM_streams[ x ];
+
+    if( s->critical )
+      continue;
+
+    demand = (uint32_t)s->maxBytes * 1000 / s->periodMs;
+    if( demand == 0 )
+      demand = 1;
+    left = capacity - used;
+
+    if( demand <= left )
+      s->decim = 1;
+    else if( left == 0 || ( demand + left - 1 ) / left > 255 )
+      s->decim = 0;                              // Park, not even 1/255 of it fits
+    else
+      s->decim = ( demand + left - 1 ) / left;
+
+    if( s->decim )
+      used += demand / s->decim;
+  }
+  return 1;
+}
+
+
+//  int8_t
+//  TLM_add( TLM_fill_t fill, uint16_t periodMs, uint8_t maxBytes, uint8_t critical )
+//  Register a stream. Returns the decimation factor it was admitted with (1 = full rate,
+//  N = every Nth release, 0 = parked because the link is full) or -1 if the stream table
+//  is full, the arguments are invalid, or a critical stream would make the critical set
+//  unschedulable. The admission of previously added non-critical streams may change.
+int8_t
+TLM_add( TLM_fill_t fill, uint16_t periodMs, uint8_t maxBytes, uint8_t critical )
+{
+  uint8_t pos;
+
+  if( TLM_count >= TLM_MAX_STREAMS || !fill || !periodMs || !maxBytes ||
+      maxBytes > TLM_MAX_RECORD )
+    return -1;
+
+  // Insert after all streams with a shorter or equal period (rate-monotonic order)
+  for( pos = TLM_count; pos > 0 && TLM_streams[ pos - 1 ].periodMs > periodMs; pos-- )
+    TLM_streams[ pos ] = TLM_streams[ pos - 1 ];
+
+  TLM_streams[ pos ].fill     = fill;
+  TLM_streams[ pos ].periodMs = periodMs;
+  TLM_streams[ pos ].maxBytes = maxBytes;
+  TLM_streams[ pos ].critical = critical;
+  TLM_streams[ pos ].phase    = 0;
+  TLM_streams[ pos ].dropped  = 0;
+  TLM_streams[ pos ].release  = SysTick_millis() + periodMs;
+  TLM_count++;
+
+  if( !TLM_admit() )
+  {
+    // Undo the insertion and restore the previous admission
+    TLM_count--;
+    for( ; pos < TLM_count; pos++ )
+      TLM_streams[ pos ] = TLM_streams[ pos + 1 ];
+    if( TLM_count )
+      TLM_admit();
+    return -1;
+  }
+  return TLM_streams[ pos ].decim;
+}
+
+
+//  void
+//  TLM_setWriter( TLM_write_t write )
+//  Send records through write (e.g. TXQ_bulk) instead of the blocking USART_putc. A record
+//  the writer does not fully accept counts as dropped. The bytes it queues must reach
+//  TLM_account from the output path (TXQ_onQueued).
+void
+TLM_setWriter( TLM_write_t write )
+{
+  TLM_write = write;
+}
+
+
+//  void
+//  TLM_account( uint16_t bytes )
+//  Report bytes written to the port so they count against the link budget. May be
+//  called from interrupt handlers.
+void
+TLM_account( uint16_t bytes )
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  TLM_sent += bytes;
+  __set_PRIMASK( primask );
+}
+
+
+//  void
+//  TLM_charge( void )
+//  Take the bytes reported since the last call out of the token bucket.
+static void
+TLM_charge( void )
+{
+  int32_t  debt = TLM_linkBps * TLM_DEBT_MS / 1000;
+  uint32_t primask, sent;
+
+  primask  = __get_PRIMASK();
+  __disable_irq();
+  sent     = TLM_sent;
+  TLM_sent = 0;
+  __set_PRIMASK( primask );
+
+  TLM_tokens -= sent;
+  if( TLM_tokens < -debt )
+    TLM_tokens = -debt;
+}
+
+
+//  void
+//  TLM_run( void )
+//  Emit every due release in priority order. Call this from the main loop as often as
+//  possible. A release that finds the link saturated is dropped, not postponed.
+void
+TLM_run( void )
+{
+  char     record[ TLM_MAX_RECORD ];
+  uint32_t now = SysTick_millis();
+  uint32_t elapsed = now - TLM_lastMs;
+  int32_t  burst = TLM_depth();
+  uint32_t fillMs = TLM_linkBps ? burst * 1000 / TLM_linkBps + 1 : 0;
+
+  // Refill the token bucket with the bytes the link could have sent since the last call.
+  // Anything beyond the bucket depth is discarded anyway, so long gaps are clipped.
+  if( elapsed > fillMs )
+    elapsed = fillMs;
+  TLM_tokenFrac += elapsed * TLM_linkBps;
+  TLM_lastMs     = now;
+  TLM_tokens    += TLM_tokenFrac / 1000;
+  TLM_tokenFrac %= 1000;
+  if( TLM_tokens > burst )
+    TLM_tokens = burst;
+  TLM_charge();
+
+  for( uint8_t x = 0; x < TLM_count; x++ )
+  {
+    TLM_stream_t *s = &TLM_streams[ x ];
+    uint8_t       len;
+
+    if( (int32_t)( now - s->release ) < 0 )
+      continue;
+
+    s->release += s->periodMs;
+    if( (int32_t)( now - s->release ) >= 0 )   // Missed whole periods, resynchronize
+    {
+      s->dropped += ( now - s->release ) / s->periodMs + 1;
+      s->release  = now + s->periodMs;
+    }
+
+    if( !s->decim || ++s->phase < s->decim )
+      continue;
+    s->phase = 0;
+
+    TLM_charge();                              // Includes the records sent so far
+    if( TLM_tokens < s->maxBytes )
+    {
+      s->dropped++;
+      continue;
+    }
+
+    len = s->fill( record, s->maxBytes );
+    if( TLM_write )
+    {
+      if( TLM_write( record, len ) < len )
+        s->dropped++;
+    }
+    else
+    {
+      for( uint8_t y = 0; y < len; y++ )
+        USART_putc( record[ y ] );
+      TLM_account( len );
+    }
+  }
+}
+
+
+#endif /* __STM32F030_CMSIS_TLM_LIB_C */
@@ -0,0 +1,147 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-TSYNC-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Host/device clock synchronization over the shared frame port
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    NTP-style exchange that lets the host map device timestamps (SysTick_micros) onto
+//    host time. For every exchange four timestamps are collected:
+//
+//      t1  host    request written
+//      t2  device  request received: USART character match interrupt on the closing 0x00
+//                  frame marker
+//      t3  device  reply sent: TX complete interrupt after the reply's last byte
+//      t4  host    reply read
+//
+//      offset = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2     (device clock minus host clock)
+//      delay  = ( t4 - t1 ) - ( t3 - t2 )
+//
+//    t3 is only known once the reply is on the wire, so each reply carries t2 of its own
+//    request and t3 of the previous reply (two-step, like PTP follow-up messages):
+//
+//      Request  DMX_TYPE_TSYNC  seq:u16
+//      Reply    DMX_TYPE_TSYNC  seq:u16  t2:u32  prevSeq:u16  prevT3:u32   (little endian)
+//
+//    The host (tools/tsync.py) keeps the low delay exchanges and fits offset and drift.
+//
+//    The character match fires on every 0x00, i.e. on both markers of every frame. t2 is
+//    the last match before the request is dispatched, which holds as long as the host
+//    waits for each reply before sending the next frame.
+//
+//    The application has to forward the USART interrupt:
+//
+//      void USART1_IRQHandler( void ) { TXQ_usartIsr(); TSYNC_usartIsr(); }
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_TSYNC_LIB_C
+#define __STM32F030_CMSIS_TSYNC_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+
+
+// Character match on the frame marker, ( register, mask, value ) entries for the boot
+// table (STM32F030-CMSIS-REGINIT-lib.c) or TSYNC_init, and the bit set in the shared
+// USART1->CR1. ADD may only change while UE = 0.
+#define TSYNC_REGINIT_CR1     USART_CR1_CMIE
+#define TSYNC_REGINIT( X )                                                                 \
+  X( USART1->CR2, USART_CR2_ADD_Msk, DMX_MARKER << USART_CR2_ADD_Pos )
+
+
+volatile uint32_t TSYNC_rxStamp;    // Time of the last 0x00 received
+volatile uint32_t TSYNC_txStamp;    // Time the last reply finished sending
+volatile uint16_t TSYNC_txSeq;      // Sequence number of that reply
+uint16_t          TSYNC_pendingSeq; // Sequence number of the reply being sent
+
+
+//  void
+//  TSYNC_init( void )
+//  Enable the character match interrupt on the frame marker. USART_init must have been
+//  called first.
+void
+TSYNC_init( void )
+{
+  TSYNC_txStamp = TSYNC_txSeq = 0;
+
+#ifndef REGINIT_OPS                     // Else they come from the boot table
+  USART_USART->CR1 &= ~USART_CR1_UE;
+  TSYNC_REGINIT( REGINIT_SET )
+  REGINIT_BITS( REGINIT_SET, USART1->CR1, TSYNC_REGINIT_CR1 )
+  USART_USART->CR1 |= USART_CR1_UE;
+#endif
+
+  NVIC_EnableIRQ( USART1_IRQn );
+}
+
+
+//  void
+//  TSYNC_usartIsr( void )
+//  USART1 interrupt service: timestamp the frame marker.
+void
+TSYNC_usartIsr( void )
+{
+  if( USART_USART->ISR & USART_ISR_CMF )
+  {
+    TSYNC_rxStamp    = SysTick_micros();
+    USART_USART->ICR = USART_ICR_CMCF;
+  }
+}
+
+
+//  void
+//  TSYNC_sent( void )
+//  Called by the TX queue when the reply's last stop bit is out.
+static void
+TSYNC_sent( void )
+{
+  TSYNC_txStamp    = SysTick_micros();
+  TSYNC_txSeq      = TSYNC_pendingSeq;
+  TXQ_onUrgentSent = 0;
+}
+
+
+static void
+TSYNC_put16( uint8_t *p, uint16_t v )
+{
+  p[ 0 ] = v;
+  p[ 1 ] = v >> 8;
+}
+
+
+static void
+TSYNC_put32( uint8_t *p, uint32_t v )
+{
+  TSYNC_put16( p, v );
+  TSYNC_put16( p + 2, v >> 16 );
+}
+
+
+//  void
+//  TSYNC_request( const uint8_t *payload, uint8_t len )
+//  Answer a DMX_TYPE_TSYNC request. Call from the frame handler.
+void
+TSYNC_request( const uint8_t *payload, uint8_t len )
+{
+  uint8_t  reply[ 12 ];
+  uint32_t t2 = TSYNC_rxStamp;
+
+  if( len < 2 || TXQ_onUrgentSent )     // Malformed, or previous reply still going out
+    return;
+
+  reply[ 0 ] = payload[ 0 ];
+  reply[ 1 ] = payload[ 1 ];
+  TSYNC_put32( &reply[ 2 ], t2 );
+  __disable_irq();
+  TSYNC_put16( &reply[ 6 ], TSYNC_txSeq );
+  TSYNC_put32( &reply[ 8 ], TSYNC_txStamp );
+  __enable_irq();
+
+  // The reply takes far longer to send than it takes to arm the callback after queuing
+  TSYNC_pendingSeq = payload[ 0 ] | ( payload[ 1 ] << 8 );
+  if( DMX_sendFrame( DMX_TYPE_TSYNC, reply, sizeof( reply ) ) )
+    TXQ_onUrgentSent = TSYNC_sent;
+}
+
+
+#endif /* __STM32F030_CMSIS_TSYNC_LIB_C */
@@ -0,0 +1,251 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-USART-RXF-lib.c
+//  ------------------------------------------------------------------------------------------
+//  USART1 receive ring with fan-out to several independent readers
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    DMA1 Channel 3 writes every received byte into RXF_buf in circular mode. The bytes
+//    are stored once; each consumer (CLI, protocol parser, sniffer/recorder, ...) owns an
+//    RXF_reader_t holding its own read cursor over the same buffer.
+//
+//    The producer position is derived from the channel's CNDTR by RXF_poll(). RXF_poll()
+//    runs from every reader call and from the DMA half/full transfer interrupts, so the
+//    DMA can never lap the producer position unnoticed. After each update the producer
+//    checks the backlog of every reader: a reader that fell more than RXF_SIZE bytes
+//    behind has lost data, gets its overrun counter incremented and is moved to the
+//    newest byte. RXF_maxBacklog keeps the worst backlog of the slowest reader seen so
+//    far, which is the number to size RXF_SIZE by.
+//
+//    Readers can consume without copying: RXF_span() returns a pointer to the contiguous
+//    unread bytes in the ring and RXF_consume() retires them.
+//
+//    The application has to forward the DMA interrupt:
+//
+//      void DMA1_Channel2_3_IRQHandler( void ) { RXF_dmaIsr(); }
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_USART_RXF_LIB_C
+#define __STM32F030_CMSIS_USART_RXF_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-USART-lib.c"
+
+
+#define RXF_SIZE          256   // Ring size, must be a power of two
+#define RXF_MAX_READERS   4
+
+#define RXF_MASK          ( RXF_SIZE - 1 )
+
+// Fixed setup of the receive DMA channel, ( register, mask, value ) entries for the boot
+// table (STM32F030-CMSIS-REGINIT-lib.c) or RXF_init. OVRDIS keeps the USART receiving if
+// a byte is ever missed; it may only change while UE = 0. The bits set in shared registers
+// are listed separately.
+#define RXF_REGINIT_AHBENR    RCC_AHBENR_DMAEN
+#define RXF_REGINIT_CR3       ( USART_CR3_OVRDIS | USART_CR3_DMAR )
+#define RXF_REGINIT( X )                                                                   \
+  X( DMA1_Channel3->CPAR, REGINIT_ALL, USART1_BASE + offsetof( USART_TypeDef, RDR ) )
+
+
+typedef struct
+{
+  volatile uint16_t tail;       // Free running index of the next unread byte
+  volatile uint16_t overruns;   // Times this reader lost data
+} RXF_reader_t;
+
+
+uint8_t           RXF_buf[ RXF_SIZE ];
+volatile uint16_t RXF_head;                 // Free running index of the next byte to arrive
+uint16_t          RXF_dmaPos;               // DMA buffer position at the last poll
+uint16_t          RXF_maxBacklog;           // Largest backlog of the slowest reader
+RXF_reader_t     *RXF_readers[ RXF_MAX_READERS ];
+uint8_t           RXF_readerCount;
+
+
+//  void
+//  RXF_init( void )
+//  Start circular DMA reception from USART1 into the ring. USART_init must have been
+//  called first.
+void
+RXF_init( void )
+{
+  RXF_head = RXF_dmaPos = RXF_maxBacklog = 0;
+  RXF_readerCount = 0;
+
+  DMA1_Channel3->CCR   = 0;
+#ifndef REGINIT_OPS                     // Else they come from the boot table
+  USART_USART->CR1 &= ~USART_CR1_UE;
+  REGINIT_BITS( REGINIT_SET, RCC->AHBENR, RXF_REGINIT_AHBENR )
+  RXF_REGINIT( REGINIT_SET )
+  REGINIT_BITS( REGINIT_SET, USART1->CR3, RXF_REGINIT_CR3 )
+  USART_USART->CR1 |= USART_CR1_UE;
+#endif
+  DMA1_Channel3->CMAR  = (uint32_t)RXF_buf;
+  DMA1_Channel3->CNDTR = RXF_SIZE;
+  DMA1->IFCR           = DMA_IFCR_CGIF3;
+  DMA1_Channel3->CCR   = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE |
+                         DMA_CCR_EN;
+
+  NVIC_EnableIRQ( DMA1_Channel2_3_IRQn );
+}
+
+
+//  void
+//  RXF_poll( void )
+//  Advance the producer position to the DMA's current position and resynchronize readers
+//  that were overrun. Safe to call from thread and interrupt context.
+void
+RXF_poll( void )
+{
+  uint16_t pos, backlog, slowest = 0;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  pos         = ( RXF_SIZE - DMA1_Channel3->CNDTR ) & RXF_MASK;
+  RXF_head   += ( pos - RXF_dmaPos ) & RXF_MASK;
+  RXF_dmaPos  = pos;
+
+  for( uint8_t x = 0; x < RXF_readerCount; x++ )
+  {
+    backlog = RXF_head - RXF_readers[ x ]->tail;
+    if( backlog > RXF_SIZE )
+    {
+      RXF_readers[ x ]->overruns++;
+      RXF_readers[ x ]->tail = RXF_head;
+    }
+    else if( backlog > slowest )
+      slowest = backlog;
+  }
+  if( slowest > RXF_maxBacklog )
+    RXF_maxBacklog = slowest;
+
+  __set_PRIMASK( primask );
+}
+
+
+//  void
+//  RXF_dmaIsr( void )
+//  DMA1 Channel 3 interrupt service: polls at every half buffer so the DMA cannot wrap
+//  around the producer position between polls.
+void
+RXF_dmaIsr( void )
+{
+  if( !( DMA1->ISR & ( DMA_ISR_HTIF3 | DMA_ISR_TCIF3 ) ) )
+    return;
+
+  DMA1->IFCR = DMA_IFCR_CGIF3;
+  RXF_poll();
+}
+
+
+//  uint8_t
+//  RXF_attach( RXF_reader_t *reader )
+//  Register a reader. It starts at the newest byte, older data is not visible to it.
+//  Returns 1 on success, 0 if all reader slots are taken.
+uint8_t
+RXF_attach( RXF_reader_t *reader )
+{
+  uint32_t primask;
+
+  if( RXF_readerCount >= RXF_MAX_READERS )
+    return 0;
+
+  RXF_poll();
+  reader->tail     = RXF_head;
+  reader->overruns = 0;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  RXF_readers[ RXF_readerCount++ ] = reader;
+  __set_PRIMASK( primask );
+
+  return 1;
+}
+
+
+//  uint16_t
+//  RXF_available( RXF_reader_t *reader )
+//  Returns the number of unread bytes for this reader.
+uint16_t
+RXF_available( RXF_reader_t *reader )
+{
+  RXF_poll();
+  return RXF_head - reader->tail;
+}
+
+
+//  uint16_t
+//  RXF_span( RXF_reader_t *reader, const uint8_t **data )
+//  Points *data at the reader's oldest unread byte inside the ring and returns how many
+//  unread bytes follow it contiguously (up to the end of the buffer). The bytes stay
+//  valid until RXF_SIZE more bytes arrive.
+uint16_t
+RXF_span( RXF_reader_t *reader, const uint8_t **data )
+{
+  uint16_t count, start;
+
+  count = RXF_available( reader );
+  start = reader->tail & RXF_MASK;
+  if( count > RXF_SIZE - start )
+    count = RXF_SIZE - start;
+
+  *data = &RXF_buf[ start ];
+  return count;
+}
+
+
+//  void
+//  RXF_consume( RXF_reader_t *reader, uint16_t count )
+//  Retire count bytes previously returned by RXF_span. May be called from interrupt
+//  handlers.
+void
+RXF_consume( RXF_reader_t *reader, uint16_t count )
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  reader->tail += count;
+  __set_PRIMASK( primask );
+}
+
+
+//  int16_t
+//  RXF_getc( RXF_reader_t *reader )
+//  Returns the next unread byte, or -1 if there is none.
+int16_t
+RXF_getc( RXF_reader_t *reader )
+{
+  uint8_t c;
+
+  if( !RXF_available( reader ) )
+    return -1;
+
+  c = RXF_buf[ reader->tail & RXF_MASK ];
+  RXF_consume( reader, 1 );
+  return c;
+}
+
+
+//  uint16_t
+//  RXF_read( RXF_reader_t *reader, uint8_t *buf, uint16_t len )
+//  Copies up to len unread bytes into buf. Returns the number of bytes copied.
+uint16_t
+RXF_read( RXF_reader_t *reader, uint8_t *buf, uint16_t len )
+{
+  const uint8_t *data;
+  uint16_t       count, done = 0;
+
+  while( done < len && ( count = RXF_span( reader, &data ) ) )
+  {
+    if( count > len - done )
+      count = len - done;
+    for( uint16_t x = 0; x < count; x++ )
+      buf[ done++ ] = data[ x ];
+    RXF_consume( reader, count );
+  }
+  return done;
+}
+
+
+#endif /* __STM32F030_CMSIS_USART_RXF_LIB_C */
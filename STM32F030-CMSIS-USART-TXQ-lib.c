@@ -0,0 +1,282 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-USART-TXQ-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Two-level priority transmit queue for USART1: urgent frames preempt bulk output
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Output is queued instead of sent with the blocking USART_putc. Two queues feed the
+//    port:
+//
+//      Bulk   (log text, dumps)        -> DMA1 Channel 2, one contiguous chunk at a time
+//      Urgent (iBUS/SBUS/CRSF frames)  -> TXE interrupt, byte by byte
+//
+//    Queuing an urgent frame pauses the bulk DMA transfer by clearing the channel enable
+//    bit. The bytes already moved are read back from CNDTR and retired from the bulk
+//    queue, so the urgent frame goes out at the next byte boundary. Once the urgent queue
+//    is empty the TXE interrupt is switched off and the bulk DMA restarts from the first
+//    unsent byte.
+//
+//    Urgent frames are queued all-or-nothing so a frame is never split by bulk output.
+//    Bulk writes queue as much as fits and return the count.
+//
+//    After TXQ_init() all output must go through these routines; USART_putc would race
+//    with the DMA for the data register. The application has to forward the interrupts:
+//
+//      void USART1_IRQHandler( void )          { TXQ_usartIsr(); }
+//      void DMA1_Channel2_3_IRQHandler( void ) { TXQ_dmaIsr(); }
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_USART_TXQ_LIB_C
+#define __STM32F030_CMSIS_USART_TXQ_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-USART-lib.c"
+#include "STM32F030-CMSIS-RING-lib.c"
+
+
+#define TXQ_BULK_SIZE     256   // Bulk queue size, must be a power of two
+#define TXQ_URGENT_SIZE   64    // Urgent queue size, must be a power of two and <= 255
+
+// Fixed setup of the bulk DMA channel, ( register, mask, value ) entries for the boot table
+// (STM32F030-CMSIS-REGINIT-lib.c) or TXQ_init, and the bits set in shared registers
+#define TXQ_REGINIT_AHBENR    RCC_AHBENR_DMAEN
+#define TXQ_REGINIT_CR3       USART_CR3_DMAT
+#define TXQ_REGINIT( X )                                                                   \
+  X( DMA1_Channel2->CPAR, REGINIT_ALL, USART1_BASE + offsetof( USART_TypeDef, TDR ) )      \
+  X( DMA1_Channel2->CCR,  REGINIT_ALL, DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE )
+
+
+RING_DEFINE( TXQ_bulkRing, TXQ_BULK_SIZE );
+volatile uint16_t TXQ_bulkChunk;    // Bytes handed to the DMA, 0 = DMA idle
+
+RING_DEFINE( TXQ_urgRing, TXQ_URGENT_SIZE );
+volatile uint8_t  TXQ_urgActive;    // TXE interrupt owns the data register
+
+uint16_t          TXQ_bulkDropped;  // Bulk bytes that did not fit
+uint16_t          TXQ_urgDropped;   // Urgent frames that did not fit
+
+// Called from the USART interrupt when the urgent queue has drained and its last byte is
+// completely on the wire. Leave at 0 unless that moment is needed (e.g. timestamps).
+void (*volatile TXQ_onUrgentSent)( void );
+
+// Called with the number of bytes each TXQ_bulk / TXQ_urgent call queued, from whatever
+// context made the call, e.g. TLM_account so the telemetry budget sees all output.
+void (*volatile TXQ_onQueued)( uint16_t len );
+
+
+//  void
+//  TXQ_init( void )
+//  Set up DMA1 Channel 2 for USART1 transmission and enable the interrupts. USART_init
+//  must have been called first.
+void
+TXQ_init( void )
+{
+  TXQ_bulkRing.head = TXQ_bulkRing.tail = TXQ_bulkChunk = 0;
+  TXQ_urgRing.head  = TXQ_urgRing.tail  = TXQ_urgActive = 0;
+
+#ifndef REGINIT_OPS                     // Else they come from the boot table
+  DMA1_Channel2->CCR = 0;
+  REGINIT_BITS( REGINIT_SET, RCC->AHBENR, TXQ_REGINIT_AHBENR )
+  TXQ_REGINIT( REGINIT_SET )
+  REGINIT_BITS( REGINIT_SET, USART1->CR3, TXQ_REGINIT_CR3 )
+#endif
+  DMA1->IFCR = DMA_IFCR_CGIF2;
+
+  NVIC_EnableIRQ( DMA1_Channel2_3_IRQn );
+  NVIC_EnableIRQ( USART1_IRQn );
+}
+
+
+//  void
+//  TXQ_startBulk( void )
+//  Hand the next contiguous run of bulk bytes to the DMA, unless the DMA is busy or an
+//  urgent frame is being sent. Called with interrupts masked or from an ISR.
+static void
+TXQ_startBulk( void )
+{
+  const uint8_t *data;
+  uint16_t       count;
+
+  if( TXQ_bulkChunk || TXQ_urgActive )
+    return;
+
+  count = RING_readSpan( &TXQ_bulkRing, &data );    // Stops at the end of the buffer
+  if( !count )
+    return;
+
+  TXQ_bulkChunk        = count;
+  DMA1_Channel2->CMAR  = (uint32_t)data;
+  DMA1_Channel2->CNDTR = count;
+  DMA1_Channel2->CCR  |= DMA_CCR_EN;
+}
+
+
+//  void
+//  TXQ_pauseBulk( void )
+//  Stop the bulk DMA and retire the bytes it already moved. Called with interrupts masked.
+static void
+TXQ_pauseBulk( void )
+{
+  if( !TXQ_bulkChunk )
+    return;
+
+  DMA1_Channel2->CCR &= ~DMA_CCR_EN;
+  RING_commitRead( &TXQ_bulkRing, TXQ_bulkChunk - DMA1_Channel2->CNDTR );
+  TXQ_bulkChunk = 0;
+  DMA1->IFCR    = DMA_IFCR_CGIF2;      // A completion that raced the pause is accounted
+}
+
+
+//  uint16_t
+//  TXQ_bulk( const void *data, uint16_t len )
+//  Queue len bytes of bulk output. Returns the number of bytes queued, which is less than
+//  len if the queue is full.
+uint16_t
+TXQ_bulk( const void *data, uint16_t len )
+{
+  uint16_t done;
+  uint32_t primask;
+
+  done = RING_write( &TXQ_bulkRing, data, len );
+  TXQ_bulkDropped += len - done;
+  if( TXQ_onQueued && done )
+    TXQ_onQueued( done );
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  TXQ_startBulk();
+  __set_PRIMASK( primask );
+
+  return done;
+}
+
+
+//  uint16_t
+//  TXQ_bulkFree( void )
+//  Returns the number of bytes TXQ_bulk can queue right now. Lets a writer queue a record
+//  in one piece or not at all.
+uint16_t
+TXQ_bulkFree( void )
+{
+  return RING_free( &TXQ_bulkRing );
+}
+
+
+//  uint16_t
+//  TXQ_puts( char *s )
+//  Queue a null terminated string as bulk output. Returns the number of bytes queued.
+uint16_t
+TXQ_puts( char *s )
+{
+  uint16_t len = 0;
+
+  while( s[ len ] )
+    len++;
+  return TXQ_bulk( s, len );
+}
+
+
+//  uint8_t
+//  TXQ_urgent( const void *frame, uint8_t len )
+//  Queue a complete frame ahead of all bulk output. The frame is queued entirely or not at
+//  all. Returns 1 if queued, 0 if the urgent queue is full.
+uint8_t
+TXQ_urgent( const void *frame, uint8_t len )
+{
+  uint32_t primask;
+
+  if( len > RING_free( &TXQ_urgRing ) )
+  {
+    TXQ_urgDropped++;
+    return 0;
+  }
+  RING_write( &TXQ_urgRing, frame, len );
+  if( TXQ_onQueued )
+    TXQ_onQueued( len );
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if( !TXQ_urgActive )
+  {
+    TXQ_urgActive = 1;
+    TXQ_pauseBulk();
+    USART_USART->CR1 |= USART_CR1_TXEIE;
+  }
+  __set_PRIMASK( primask );
+
+  return 1;
+}
+
+
+//  uint8_t
+//  TXQ_idle( void )
+//  Returns 1 when both queues are empty and the DMA is done. The last byte may still be
+//  in the shift register; wait for USART_ISR_TC if the line has to be quiet.
+uint8_t
+TXQ_idle( void )
+{
+  return !TXQ_urgActive && !TXQ_bulkChunk && !RING_count( &TXQ_bulkRing );
+}
+
+
+//  void
+//  TXQ_usartIsr( void )
+//  USART1 interrupt service: feeds the urgent queue into the data register and resumes the
+//  bulk DMA once the urgent queue has drained. If TXQ_onUrgentSent is set, the bulk DMA
+//  is held until the last urgent byte has left the shift register (TC) and the callback
+//  runs at that moment.
+void
+TXQ_usartIsr( void )
+{
+  uint32_t isr = USART_USART->ISR;
+  uint32_t cr1 = USART_USART->CR1;
+  int16_t  c;
+
+  if( ( cr1 & USART_CR1_TXEIE ) && ( isr & USART_ISR_TXE ) )
+  {
+    if( ( c = RING_get( &TXQ_urgRing ) ) >= 0 )
+      USART_USART->TDR = c;
+    else if( TXQ_onUrgentSent )
+      USART_USART->CR1 = ( cr1 & ~USART_CR1_TXEIE ) | USART_CR1_TCIE;
+    else
+    {
+      USART_USART->CR1 = cr1 & ~USART_CR1_TXEIE;
+      TXQ_urgActive = 0;
+      TXQ_startBulk();
+    }
+  }
+
+  if( ( cr1 & USART_CR1_TCIE ) && ( isr & USART_ISR_TC ) )
+  {
+    USART_USART->CR1 &= ~USART_CR1_TCIE;
+    if( TXQ_onUrgentSent )
+      TXQ_onUrgentSent();
+    if( RING_count( &TXQ_urgRing ) )          // Queued while waiting for TC
+      USART_USART->CR1 |= USART_CR1_TXEIE;
+    else
+    {
+      TXQ_urgActive = 0;
+      TXQ_startBulk();
+    }
+  }
+}
+
+
+//  void
+//  TXQ_dmaIsr( void )
+//  DMA1 Channel 2 interrupt service: retires the finished chunk and starts the next one.
+void
+TXQ_dmaIsr( void )
+{
+  if( !( DMA1->ISR & DMA_ISR_TCIF2 ) )
+    return;
+
+  DMA1->IFCR          = DMA_IFCR_CGIF2;
+  DMA1_Channel2->CCR &= ~DMA_CCR_EN;
+  RING_commitRead( &TXQ_bulkRing, TXQ_bulkChunk );
+  TXQ_bulkChunk       = 0;
+  TXQ_startBulk();
+}
+
+
+#endif /* __STM32F030_CMSIS_USART_TXQ_LIB_C */
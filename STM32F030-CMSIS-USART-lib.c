@@ -7,6 +7,13 @@
 //  Released under the MIT License
 //  Copyright (c) 2023
 //  Mike Shegedin, EZdenki.com
+//    Version 1.8   18 Oct 2026   Steps 1 to 4 and TE/RE listed once in USART_REGINIT, for the
+//                                boot table or USART_init.
+//    Version 1.7   18 Oct 2026   Pin and clock setup left to a REGINIT_OPS boot table if
+//                                the application has one.
+//    Version 1.6   18 Oct 2026   Baud rate from CLOCK_hz instead of a fixed 8 MHz.
+//    Version 1.5   18 Oct 2026   Added USART_setBaud to change the baud rate of the open port.
+//    Version 1.4   18 Oct 2026   Added busy-wait accounting per call site (USART_SPIN_STATS).
 //    Version 1.3   11 Oct 2023   Had putc wait until character is actually sent before
 //                                returning to the calling routine.
 //    Version 1.2   28 Aug 2023   Ported USART_puti, USART_puth, USART_pollc from
@@ -28,7 +35,7 @@
 //    USART1_Rx = PA3 (pin 9), Alternate Function 1
 //
 //    Baudrate Calculation:
-//      Assuming the internal RC clock: f(CK) = 8 MHz
+//      f(CK) = CLOCK_hz (STM32F030-CMSIS-CLOCK-lib.c), the internal RC clock: 8 MHz
 //        Mantissa = whole part of f(CK) / (16 * Baud)
 //        Fraction = remainder of above * 16
 //          f(CK)    Baud     Mantissa   Fraction
@@ -50,6 +57,18 @@
 //      4. Enable USART1 peripheral via RCC->APB2ENR
 //      5. Set Baudrate via USART1->BRR
 //      6. Enable (turn on) Tx, Rx, and USART via USART1->CR1
+//
+//    Steps 1 to 4 and the Tx and Rx enables are the entry list USART_REGINIT (see
+//    STM32F030-CMSIS-REGINIT-lib.c). USART_init writes them, unless the application has
+//    them in its REGINIT_OPS boot table.
+//
+//    Busy-wait accounting (build with -DUSART_SPIN_STATS):
+//      Every routine here waits by polling a status flag. With USART_SPIN_STATS the cycles
+//      spent in those loops are added up per call site, the return address of the
+//      outermost USART_ call (so a USART_puts from main counts its USART_putc waits for
+//      main). USART_SPIN_SITES sites are kept; waits at further sites go to
+//      USART_spinLost. Cycles are taken from SysTick_cycles() and only counted once
+//      SysTick_init has run. USART_spinLine formats the table for output.
 //  ==========================================================================================
 
 #ifndef __STM32F030_CMSIS_USART_LIB_C
@@ -57,9 +76,174 @@
 
 #include <stdlib.h>
 #include "stm32f030x6.h"  // Primary CMSIS header file
+#include "STM32F030-CMSIS-CLOCK-lib.c"
+#include "STM32F030-CMSIS-REGINIT-lib.c"
+
+
+// Fixed setup of USART1 and its pins, ( register, mask, value ) entries, and the bits
+// set in the shared RCC->AHBENR and USART1->CR1 (written first and last)
+#define USART_REGINIT_AHBENR  RCC_AHBENR_GPIOAEN
+#define USART_REGINIT_CR1     ( USART_CR1_TE | USART_CR1_RE )
+#define USART_REGINIT( X )                                                                 \
+  X( GPIOA->MODER,    GPIO_MODER_MODER2 | GPIO_MODER_MODER3,                               \
+                      ( 0b10 << GPIO_MODER_MODER2_Pos ) |   /* USART1_TX/PA2/AF1/Pin8 */   \
+                      ( 0b10 << GPIO_MODER_MODER3_Pos ) )   /* USART1_RX/PA3/AF1/Pin9 */   \
+  X( GPIOA->AFR[ 0 ], GPIO_AFRL_AFRL2 | GPIO_AFRL_AFRL3,                                   \
+                      ( 0b0001 << GPIO_AFRL_AFRL2_Pos ) |                                  \
+                      ( 0b0001 << GPIO_AFRL_AFRL3_Pos ) )                                  \
+  X( RCC->APB2ENR,    RCC_APB2ENR_USART1EN, RCC_APB2ENR_USART1EN )
+
+#ifdef USART_SPIN_STATS
+#include "STM32F030-CMSIS-SysTick-lib.c"
+
+#define USART_SPIN_SITES  16
+
+typedef struct
+{
+  uint32_t site;        // Return address of the outermost USART_ call
+  uint32_t calls;
+  uint32_t txCycles;    // Waiting for TXE / TC
+  uint32_t rxCycles;    // Waiting for RXNE
+} USART_spin_t;
+
+USART_spin_t  USART_spins[ USART_SPIN_SITES ];
+USART_spin_t *USART_spinCurrent;      // Site of the call in progress, 0 = none
+uint32_t      USART_spinLost;         // Cycles of sites that did not fit
+
+
+//  uint8_t
+//  USART_spinEnter( uint32_t site )
+//  Called on entry of every blocking routine. Returns 1 for the outermost one, which
+//  selects (or claims) the slot of its call site.
+uint8_t
+USART_spinEnter( uint32_t site )
+{
+  if( USART_spinCurrent )
+    return 0;
+  for( uint8_t x = 0; x < USART_SPIN_SITES; x++ )
+    if( USART_spins[ x ].site == site || !USART_spins[ x ].site )
+    {
+      USART_spinCurrent = &USART_spins[ x ];
+      USART_spinCurrent->site = site;
+      USART_spinCurrent->calls++;
+      return 1;
+    }
+  USART_spinCurrent = 0;
+  return 1;
+}
+
+
+//  uint32_t
+//  USART_spinStart( void )
+//  Timestamp before a wait.
+uint32_t
+USART_spinStart( void )
+{
+  return SysTick_cycles();
+}
+
+
+//  void
+//  USART_spinAdd( uint32_t start, uint8_t rx )
+//  Add the cycles since start to the current site.
+void
+USART_spinAdd( uint32_t start, uint8_t rx )
+{
+  uint32_t cycles;
+
+  if( !( SysTick->CTRL & SysTick_CTRL_TICKINT_Msk ) )   // SysTick_init not run yet
+    return;
+  cycles = SysTick_cycles() - start;
+  if( !USART_spinCurrent )
+    USART_spinLost += cycles;
+  else if( rx )
+    USART_spinCurrent->rxCycles += cycles;
+  else
+    USART_spinCurrent->txCycles += cycles;
+}
+
+
+//  uint8_t
+//  USART_spinLine( uint8_t index, char *buf )
+//  Format slot index as "S <site> <calls> <tx cycles> <rx cycles>\n" into buf (at least
+//  48 chars). index USART_SPIN_SITES gives "SPIN end <lost cycles>\n" and clears the
+//  table. Returns the length, 0 for an unused slot.
+uint8_t
+USART_spinLine( uint8_t index, char *buf )
+{
+  const USART_spin_t *spin = &USART_spins[ index ];
+  uint32_t            values[ 4 ];
+  uint8_t             count, n = 0;
+  char                hex[] = "0123456789ABCDEF";
+
+  if( index >= USART_SPIN_SITES )
+  {
+    for( const char *s = "SPIN end"; *s; s++ )
+      buf[ n++ ] = *s;
+    values[ 0 ] = USART_spinLost;
+    count = 1;
+    for( uint8_t x = 0; x < USART_SPIN_SITES; x++ )
+      USART_spins[ x ].site = USART_spins[ x ].calls = USART_spins[ x ].txCycles =
+        USART_spins[ x ].rxCycles = 0;
+    USART_spinLost = 0;
+  }
+  else
+  {
+    if( !spin->site )
+      return 0;
+    buf[ n++ ] = 'S';
+    buf[ n++ ] = ' ';
+    for( int8_t x = 28; x >= 0; x -= 4 )
+      buf[ n++ ] = hex[ ( spin->site >> x ) & 0xF ];
+    values[ 0 ] = spin->calls;
+    values[ 1 ] = spin->txCycles;
+    values[ 2 ] = spin->rxCycles;
+    count = 3;
+  }
+  for( uint8_t x = 0; x < count; x++ )
+  {
+    buf[ n++ ] = ' ';
+    utoa( values[ x ], buf + n, 10 );
+    while( buf[ n ] )
+      n++;
+  }
+  buf[ n++ ] = '\n';
+  return n;
+}
+
+
+#define USART_SPIN_ENTER()  uint8_t spinOuter = \
+                              USART_spinEnter( (uint32_t)__builtin_return_address( 0 ) )
+#define USART_SPIN_LEAVE()  if( spinOuter ) USART_spinCurrent = 0
+#define USART_SPIN( cond, rx )  { uint32_t spinStart = USART_spinStart(); \
+                                  while( cond ) ; \
+                                  USART_spinAdd( spinStart, rx ); }
+#else
+#define USART_SPIN_ENTER()
+#define USART_SPIN_LEAVE()
+#define USART_SPIN( cond, rx )  while( cond ) ;
+#endif /* USART_SPIN_STATS */
 
 
 USART_TypeDef *USART_USART; // Global USART_USART varible to point to desired USART port
+uint32_t       USART_baud;  // Baud rate set by USART_init or USART_setBaud
+
+
+//  static uint32_t
+//  USART_brr( uint32_t baudrate )
+//  Returns the BRR value for baudrate (see Baudrate Calculation above).
+static uint32_t
+USART_brr( uint32_t baudrate )
+{
+  uint32_t speedMant, speedFrac;
+
+  // Calculate the mantissa (speedMant) and fraction (speedFrac) values for the core clock
+  speedMant  = CLOCK_hz / baudrate / 16;
+  speedFrac = ( CLOCK_hz - baudrate * speedMant * 16 ) / baudrate;
+
+  return ( speedMant << USART_BRR_DIV_MANTISSA_Pos ) |
+         ( speedFrac << USART_BRR_DIV_FRACTION_Pos );
+}
 
 
 //  void
@@ -73,14 +257,6 @@ USART_TypeDef *USART_USART; // Global USART_USART varible to point to desired US
 void
 USART_init( USART_TypeDef *thisUSART, uint32_t baudrate )
 {
-  uint32_t speedMant, speedFrac;
-    
-  // Calculate the mantissa (speedMant) and fraction (speedFrac) values for an 8 MHz CPU
-  // Note that the 8E6 constants are cast as uint32_t, otherwise gcc will consider them
-  // to be floating constants with much more overhead.
-  speedMant  = (uint32_t)8E6 / baudrate / 16;
-  speedFrac = ( (uint32_t)8E6 - baudrate * speedMant * 16 ) / baudrate;
-
   USART_USART = thisUSART;    // Set global USART_USART varible to point to the desired port
 
   if( 1 ) // For parts with more than one USART, change this line to:
@@ -88,45 +264,60 @@ USART_init( USART_TypeDef *thisUSART, uint32_t baudrate )
           //   ...
           // and add setup code for other USART ports as needed.
   {
-    // Enable GPIO Port A
-    RCC->AHBENR |= RCC_AHBENR_GPIOAEN;
-
-    // Set PA2 and PA3 as Alternate Functions
-    GPIOA->MODER |= (0b10 << GPIO_MODER_MODER2_Pos); // USART1_TX/PA2/AF1/Pin8
-    GPIOA->MODER |= (0b10 << GPIO_MODER_MODER3_Pos); // USART1_RX/PA3/AF1/Pin9
-  
-    // Set PA2 and PA3 as Alternate Function 1
-    GPIOA->AFR[0] |= (0b0001 << GPIO_AFRL_AFRL2_Pos);
-    GPIOA->AFR[0] |= (0b0001 << GPIO_AFRL_AFRL3_Pos);
-  
-    // Enable USART1 peripheral
-    RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+#ifndef REGINIT_OPS // Else they come from the boot table
+    // Steps 1 to 4, Tx and Rx enable
+    REGINIT_BITS( REGINIT_SET, RCC->AHBENR, USART_REGINIT_AHBENR )
+    USART_REGINIT( REGINIT_SET )
+    REGINIT_BITS( REGINIT_SET, USART1->CR1, USART_REGINIT_CR1 )
+#endif
   
     // Set Baudrate by loading the baudrate Mantissa and Fractional part as described above
-    USART_USART->BRR = ( speedMant << USART_BRR_DIV_MANTISSA_Pos ) |
-                       ( speedFrac << USART_BRR_DIV_FRACTION_Pos );
+    USART_USART->BRR = USART_brr( baudrate );
+    USART_baud       = baudrate;
   
-    // Enable (turn on) Tx, Rx, and USART
-    USART_USART->CR1 = (USART_CR1_TE | USART_CR1_RE | USART_CR1_UE) ;
+    // Enable (turn on) the USART
+    USART_USART->CR1 |= USART_CR1_UE;
   }
   // End per-port setup
 }
 
 
+//  void
+//  USART_setBaud( uint32_t baudrate )
+//  Change the baud rate of the port opened by USART_init. Waits until the character being
+//  sent is out, then briefly disables the USART, as BRR may only be written with UE = 0.
+//  The DMA and interrupt settings are kept.
+void
+USART_setBaud( uint32_t baudrate )
+{
+  USART_SPIN_ENTER();
+  USART_SPIN( !( USART_USART->ISR & USART_ISR_TC ), 0 );
+  USART_USART->CR1 &= ~USART_CR1_UE;
+  USART_USART->BRR  = USART_brr( baudrate );
+  USART_USART->CR1 |= USART_CR1_UE;
+  USART_baud        = baudrate;
+  USART_SPIN_LEAVE();
+}
+
+
 // void
 // USART_putc
 // Output a single character to the USART Tx pin (PA2)
 void
 USART_putc( char c )
 {
+    USART_SPIN_ENTER();
+
     // Wait until the transmit data register is empty
-    while( !(USART_USART->ISR & USART_ISR_TXE ) ) ;
+    USART_SPIN( !(USART_USART->ISR & USART_ISR_TXE ), 0 );
     
     // Put character into the data register
     USART_USART->TDR = c; 
 
     // Wait until character is actually sent
-    while( !(USART_USART->ISR & USART_ISR_TC) ) ;
+    USART_SPIN( !(USART_USART->ISR & USART_ISR_TC), 0 );
+
+    USART_SPIN_LEAVE();
 }
 
 
@@ -136,8 +327,10 @@ USART_putc( char c )
 void
 USART_puts( char *s )
 {
+    USART_SPIN_ENTER();
     while( *s )
         USART_putc( *s++ );
+    USART_SPIN_LEAVE();
 }
 
 
@@ -149,8 +342,10 @@ void
 USART_puti( int data, uint8_t base )
 {
   char myString[10];
+  USART_SPIN_ENTER();
   itoa( data, myString, base );
   USART_puts( myString );
+  USART_SPIN_LEAVE();
 }
 
 
@@ -161,8 +356,13 @@ USART_puti( int data, uint8_t base )
 char
 USART_getc( void )
 {
-    while( !( USART_USART->ISR & USART_ISR_RXNE ) ) ;
-    return USART_USART->RDR;
+    char c;
+
+    USART_SPIN_ENTER();
+    USART_SPIN( !( USART_USART->ISR & USART_ISR_RXNE ), 1 );
+    c = USART_USART->RDR;
+    USART_SPIN_LEAVE();
+    return c;
 }
 
 
@@ -176,6 +376,7 @@ USART_puth( uint32_t number, uint8_t places )
 {
   uint8_t  thisDigit;
   uint32_t oob;     // 1 if out of number has more hex digits than "places", 0 if okay
+  USART_SPIN_ENTER();
 
   oob =  number >> ( places *4 ) ;
   for( int32_t x = (places - 1) * 4; x >=0; x -= 4 )
@@ -193,6 +394,7 @@ USART_puth( uint32_t number, uint8_t places )
       USART_putc( thisDigit );
     }
   }
+  USART_SPIN_LEAVE();
 }
 
 
@@ -224,6 +426,7 @@ USART_gets( char *inStr, uint32_t strLen )
 {
   uint32_t strPos = 0;    // Track position in string
   uint8_t  oneChar;       // Hold currently entered character for processing
+  USART_SPIN_ENTER();
   
   oneChar = USART_getc();                 // Get the first character
   
@@ -246,6 +449,7 @@ USART_gets( char *inStr, uint32_t strLen )
     oneChar = USART_getc();               // Get next character
   }
   inStr[ strPos ] = 0x00;                 // Terminate string with null character
+  USART_SPIN_LEAVE();
   return strPos;                          // Return the length of the string not including
 }                                         // the end-of-string character
 
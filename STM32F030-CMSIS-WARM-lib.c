@@ -0,0 +1,171 @@
+//  ==========================================================================================
+//  STM32F030-CMSIS-WARM-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Warm reset: outputs keep their state across software and watchdog resets
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    A reset puts every pin back to input until main() has configured it again, which
+//    takes milliseconds (self-test, flash, clocks). After a software or watchdog reset
+//    the SRAM still holds what the program left there, so the registers that define the
+//    outputs are kept in a block in the .noinit section (neither loaded nor zeroed at
+//    startup) and written back by Reset_Handler first thing, a few microseconds after
+//    the reset, before the RAM march, the data and bss setup and main().
+//
+//    The application lists the registers in the order they have to be written (clock
+//    enables first, a timer's CR1 with CEN last) and saves their values whenever an
+//    output changes:
+//
+//      WARM_init();                                    // early in main()
+//      RCC->AHBENR |= RCC_AHBENR_GPIOBEN; GPIOB->MODER |= ...;
+//      WARM_keep( &RCC->AHBENR );
+//      WARM_keep( &GPIOB->MODER );
+//      WARM_keep( &GPIOB->ODR );
+//      WARM_save();                                    // and after every output change
+//
+//    The rest of the initialization must then leave those registers as they are (set
+//    bits, do not clear the output data register). Timers should run without ARR/CCR
+//    preload, as no update event is generated on the way back.
+//
+//    Reset_Handler calls WARM_boot() with only the stack set up. It restores the block
+//    if RCC->CSR shows a software or watchdog reset without a power-on reset and the
+//    block's check word is right. The RAM march is skipped then, it would wipe the block
+//    (POST reports POST_WARM). A program that keeps resetting before it gets to WARM_save
+//    from its main loop stops being restored after WARM_MAX_BOOTS attempts.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CMSIS_WARM_LIB_C
+#define __STM32F030_CMSIS_WARM_LIB_C
+
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define WARM_REGS         12
+#define WARM_MAGIC        0x5741524D      // "WARM"
+#define WARM_MAX_BOOTS    3               // Warm boots in a row without a WARM_save
+
+#define WARM_EARLY        __attribute__(( no_instrument_function ))
+
+
+typedef struct
+{
+  uint32_t           magic;
+  uint32_t           count;
+  volatile uint32_t *reg[ WARM_REGS ];
+  uint32_t           value[ WARM_REGS ];
+  uint32_t           check;               // Of the fields above
+  uint32_t           boots;               // Warm boots since the last WARM_save
+  uint32_t           warm;                // This boot restored the outputs
+} WARM_state_t;
+
+
+__attribute__(( section( ".noinit" ) )) WARM_state_t WARM_state;
+
+
+//  static uint32_t
+//  WARM_sum( void )
+//  Check word of the register list: rotate and add, so a zeroed or random block fails.
+WARM_EARLY static uint32_t
+WARM_sum( void )
+{
+  const uint32_t *p = &WARM_state.magic;
+  uint32_t        sum = 0x5A5A5A5A;
+
+  while( p < &WARM_state.check )
+  {
+    sum = ( ( sum << 5 ) | ( sum >> 27 ) ) + *p++;
+  }
+  return sum;
+}
+
+
+//  uint32_t
+//  WARM_boot( void )
+//  Called by Reset_Handler before anything is initialized; uses no globals but the
+//  block. Restores the outputs after a software or watchdog reset. Returns 1 if it did.
+WARM_EARLY uint32_t
+WARM_boot( void )
+{
+  uint32_t csr = RCC->CSR;
+
+  WARM_state.warm = 0;
+  if( !( csr & ( RCC_CSR_SFTRSTF | RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF ) ) ||
+      ( csr & RCC_CSR_PORRSTF ) || WARM_state.magic != WARM_MAGIC ||
+      WARM_state.count > WARM_REGS || WARM_state.check != WARM_sum() ||
+      WARM_state.boots >= WARM_MAX_BOOTS )
+  {
+    WARM_state.magic = 0;
+    return 0;
+  }
+  for( uint32_t x = 0; x < WARM_state.count; x++ )
+    *WARM_state.reg[ x ] = WARM_state.value[ x ];
+  WARM_state.boots++;
+  WARM_state.warm = 1;
+  return 1;
+}
+
+
+//  uint8_t
+//  WARM_init( void )
+//  Returns 1 if this boot restored the outputs. After a cold boot the register list is
+//  emptied for WARM_keep.
+uint8_t
+WARM_init( void )
+{
+  if( WARM_state.warm )
+    return 1;
+  WARM_state.magic = WARM_MAGIC;
+  WARM_state.count = 0;
+  WARM_state.boots = 0;
+  WARM_state.check = WARM_sum();
+  return 0;
+}
+
+
+//  void
+//  WARM_forget( void )
+//  Make the next reset a cold one, e.g. when the outputs must not come back.
+void
+WARM_forget( void )
+{
+  WARM_state.magic = 0;
+  WARM_state.warm = 0;
+}
+
+
+//  uint8_t
+//  WARM_keep( volatile uint32_t *reg )
+//  Add reg to the registers restored after a warm reset (once; the list survives the
+//  reset). Returns 0 if the list is full.
+uint8_t
+WARM_keep( volatile uint32_t *reg )
+{
+  for( uint32_t x = 0; x < WARM_state.count; x++ )
+    if( WARM_state.reg[ x ] == reg )
+      return 1;
+  if( WARM_state.count >= WARM_REGS )
+    return 0;
+  WARM_state.reg[ WARM_state.count++ ] = reg;
+  return 1;
+}
+
+
+//  void
+//  WARM_save( void )
+//  Take the current values of the kept registers. Also tells WARM_boot the program got
+//  this far, which resets the count of warm boots in a row.
+void
+WARM_save( void )
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();                        // A reset now must not find half a list
+  WARM_state.check = 0;
+  for( uint32_t x = 0; x < WARM_state.count; x++ )
+    WARM_state.value[ x ] = *WARM_state.reg[ x ];
+  WARM_state.boots = 0;
+  WARM_state.check = WARM_sum();
+  __set_PRIMASK( primask );
+}
+
+
+#endif /* __STM32F030_CMSIS_WARM_LIB_C */
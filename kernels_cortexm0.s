@@ -0,0 +1,215 @@
+/**
+  ******************************************************************************
+  * @file      kernels_cortexm0.s
+  * @brief     Hand-written Thumb-1 versions of the hot loops.
+  *
+  *            Each routine has a C reference twin with the same name ending in
+  *            _c instead of _asm. Building with "make ASM_KERNELS=1" assembles
+  *            this file and defines ASM_KERNELS, which makes the public names
+  *            (RING_copy, CRC16_update, BITPACK_unpack11, FMT_hex) select these
+  *            versions.
+  *
+  *            All routines follow the AAPCS: arguments in r0-r3, result in r0,
+  *            r4-r7 preserved.
+  ******************************************************************************
+  */
+
+  .syntax unified
+  .cpu cortex-m0
+  .fpu softvfp
+  .thumb
+
+
+/* void RING_copy_asm( uint8_t *dst, const uint8_t *src, uint32_t len )
+ * Copies 16 bytes per LDM/STM pair when dst and src share their alignment,
+ * otherwise byte by byte. */
+  .section .text.RING_copy_asm,"ax",%progbits
+  .global RING_copy_asm
+  .type RING_copy_asm, %function
+RING_copy_asm:
+  push  {r4-r6, lr}
+  movs  r3, r0
+  eors  r3, r1
+  lsls  r3, r3, #30         /* Different alignment: bytes only */
+  bne   CopyBytes
+
+CopyAlign:
+  lsls  r3, r0, #30
+  beq   CopyWords16
+  cmp   r2, #0
+  beq   CopyDone
+  ldrb  r3, [r1]
+  strb  r3, [r0]
+  adds  r1, r1, #1
+  adds  r0, r0, #1
+  subs  r2, r2, #1
+  b     CopyAlign
+
+CopyWords16:
+  cmp   r2, #16
+  blo   CopyWords4
+  ldmia r1!, {r3-r6}
+  stmia r0!, {r3-r6}
+  subs  r2, r2, #16
+  b     CopyWords16
+
+CopyWords4:
+  cmp   r2, #4
+  blo   CopyBytes
+  ldmia r1!, {r3}
+  stmia r0!, {r3}
+  subs  r2, r2, #4
+  b     CopyWords4
+
+CopyBytes:
+  cmp   r2, #0
+  beq   CopyDone
+CopyByteLoop:
+  ldrb  r3, [r1]
+  strb  r3, [r0]
+  adds  r1, r1, #1
+  adds  r0, r0, #1
+  subs  r2, r2, #1
+  bne   CopyByteLoop
+
+CopyDone:
+  pop   {r4-r6, pc}
+  .size RING_copy_asm, .-RING_copy_asm
+
+
+/* uint16_t CRC16_update_asm( uint16_t crc, const void *data, uint32_t len )
+ * CRC-16/CCITT-FALSE, one nibble per table lookup. */
+  .section .text.CRC16_update_asm,"ax",%progbits
+  .global CRC16_update_asm
+  .type CRC16_update_asm, %function
+CRC16_update_asm:
+  push  {r4-r6, lr}
+  uxth  r0, r0
+  ldr   r3, =CRC16_table_asm
+  cmp   r2, #0
+  beq   CrcDone
+
+CrcLoop:
+  ldrb  r4, [r1]
+  adds  r1, r1, #1
+
+  lsrs  r5, r0, #12         /* High nibble: ( crc >> 12 ) ^ ( byte >> 4 ) */
+  lsrs  r6, r4, #4
+  eors  r5, r6
+  lsls  r5, r5, #1
+  ldrh  r5, [r3, r5]
+  lsls  r0, r0, #4
+  eors  r0, r5
+  uxth  r0, r0
+
+  lsrs  r5, r0, #12         /* Low nibble: ( crc >> 12 ) ^ ( byte & 0x0F ) */
+  lsls  r6, r4, #28
+  lsrs  r6, r6, #28
+  eors  r5, r6
+  lsls  r5, r5, #1
+  ldrh  r5, [r3, r5]
+  lsls  r0, r0, #4
+  eors  r0, r5
+  uxth  r0, r0
+
+  subs  r2, r2, #1
+  bne   CrcLoop
+
+CrcDone:
+  pop   {r4-r6, pc}
+  .align 2
+  .ltorg
+  .size CRC16_update_asm, .-CRC16_update_asm
+
+  .section .rodata.CRC16_table_asm,"a",%progbits
+  .align 1
+CRC16_table_asm:
+  .hword 0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7
+  .hword 0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+
+
+/* void BITPACK_unpack11_asm( const uint8_t *in, uint16_t *ch, uint8_t groups )
+ * Streams bytes into a bit accumulator and takes 11 bits out per channel.
+ * Reads exactly 11 bytes per group of 8 channels. */
+  .section .text.BITPACK_unpack11_asm,"ax",%progbits
+  .global BITPACK_unpack11_asm
+  .type BITPACK_unpack11_asm, %function
+BITPACK_unpack11_asm:
+  push  {r4-r6, lr}
+  uxtb  r2, r2
+  lsls  r2, r2, #3          /* Channels to extract */
+  beq   UnpackDone
+  movs  r3, #0              /* Accumulator */
+  movs  r4, #0              /* Bits in the accumulator */
+  movs  r5, #1
+  lsls  r5, r5, #11
+  subs  r5, r5, #1          /* 0x7FF */
+
+UnpackFill:
+  cmp   r4, #11
+  bhs   UnpackTake
+  ldrb  r6, [r0]
+  adds  r0, r0, #1
+  lsls  r6, r4
+  orrs  r3, r6
+  adds  r4, r4, #8
+  b     UnpackFill
+
+UnpackTake:
+  movs  r6, r3
+  ands  r6, r5
+  strh  r6, [r1]
+  adds  r1, r1, #2
+  lsrs  r3, r3, #11
+  subs  r4, r4, #11
+  subs  r2, r2, #1
+  bne   UnpackFill
+
+UnpackDone:
+  pop   {r4-r6, pc}
+  .size BITPACK_unpack11_asm, .-BITPACK_unpack11_asm
+
+
+/* uint8_t FMT_hex_asm( char *buf, uint32_t number, uint8_t places )
+ * Writes places upper case hex digits (no terminator), or '.' for every digit
+ * if number needs more than places digits. Returns places. */
+  .section .text.FMT_hex_asm,"ax",%progbits
+  .global FMT_hex_asm
+  .type FMT_hex_asm, %function
+FMT_hex_asm:
+  push  {r4, r5, lr}
+  uxtb  r2, r2
+  movs  r5, r2              /* Return value */
+  movs  r3, #0              /* Non-zero if the number does not fit */
+  cmp   r2, #8
+  bhs   HexFill
+  lsls  r3, r2, #2
+  movs  r4, r1
+  lsrs  r4, r3
+  movs  r3, r4
+
+HexFill:
+  adds  r0, r0, r2          /* Fill from the last digit backwards */
+  cmp   r2, #0
+  beq   HexDone
+HexLoop:
+  subs  r0, r0, #1
+  movs  r4, #0x2E         /* '.' */
+  cmp   r3, #0
+  bne   HexStore
+  lsls  r4, r1, #28
+  lsrs  r4, r4, #28
+  adds  r4, r4, #0x30     /* '0' */
+  cmp   r4, #0x39         /* '9' */
+  bls   HexStore
+  adds  r4, r4, #7        /* 'A' - '9' - 1 */
+HexStore:
+  strb  r4, [r0]
+  lsrs  r1, r1, #4
+  subs  r2, r2, #1
+  bne   HexLoop
+
+HexDone:
+  movs  r0, r5
+  pop   {r4, r5, pc}
+  .size FMT_hex_asm, .-FMT_hex_asm
@@ -1,24 +1,253 @@
 #include "stm32f030x6.h"
+
+// Fixed peripheral setup, written by Reset_Handler before main() runs: the entry lists of
+// the libraries and one merged entry per shared register (STM32F030-CMSIS-REGINIT-lib.c),
+// emitted after the last include. The clocks come first, the USART control bits after the
+// USART1 clock. The LED is not here, it waits for the self-test.
+#define REGINIT_OPS( X )                                                                   \
+    REGINIT_BITS( X, RCC->AHBENR,                                                          \
+                  USART_REGINIT_AHBENR | TXQ_REGINIT_AHBENR | RXF_REGINIT_AHBENR )         \
+    USART_REGINIT( X ) TXQ_REGINIT( X ) RXF_REGINIT( X ) TSYNC_REGINIT( X )                \
+    REGINIT_BITS( X, USART1->CR1, USART_REGINIT_CR1 | TSYNC_REGINIT_CR1 )                  \
+    REGINIT_BITS( X, USART1->CR3, TXQ_REGINIT_CR3 | RXF_REGINIT_CR3 )
+
+#include "STM32F030-CMSIS-CLOCK-lib.c"
 #include "STM32F030-CMSIS-USART-lib.c"
+#include "STM32F030-CMSIS-SysTick-lib.c"
+#include "STM32F030-CMSIS-TLM-lib.c"
+#include "STM32F030-CMSIS-USART-TXQ-lib.c"
+#include "STM32F030-CMSIS-USART-RXF-lib.c"
+#include "STM32F030-CMSIS-DMX-lib.c"
+#include "STM32F030-CMSIS-TSYNC-lib.c"
+#include "STM32F030-CMSIS-IMG-lib.c"
+#include "STM32F030-CMSIS-FLASH-lib.c"
+#include "STM32F030-CMSIS-REC-lib.c"
+#include "STM32F030-CMSIS-POST-lib.c"
+#include "STM32F030-CMSIS-PROF-lib.c"
+#include "STM32F030-CMSIS-BERT-lib.c"
+#include "STM32F030-CMSIS-LAT-lib.c"
+#include "STM32F030-CMSIS-WARM-lib.c"
+#include "STM32F030-CMSIS-REGINIT-lib.c"
+#ifdef INSTRUMENT
+#include "STM32F030-CMSIS-INSTR-lib.c"
+#endif
+#ifdef BENCHMARKS
+#include "STM32F030-CMSIS-BENCH-lib.c"
+#endif
 //STM32F030K6T6
 //    USART1_Tx = PA2 (pin 8)
+
+// Runtime settings ( id, type, name, default, min, max ). Never reuse an id; tools/cfg.py
+// knows the names.
+#define CFG_VERSION 1
+#define CFG_FIELDS( X )                                         \
+    X( 1, uint32_t, baud,        112500, 1200, CLOCK_hz / 16 )  \
+    X( 2, uint16_t, heartbeatMs, 500,    10,   60000 )          \
+    X( 3, uint16_t, ledMs,       500,    10,   60000 )          \
+    X( 4, uint16_t, linkLogMs,   1000,   100,  60000 )
+#include "STM32F030-CMSIS-CFG-lib.c"
+
+REGINIT_TABLE( REGINIT_OPS );
+
+uint8_t heartbeat( char *buf, uint8_t maxLen )
+{
+    const char msg[] = "Test!\n";
+
+    for( uint8_t x = 0; x < sizeof( msg ) - 1; x++ )
+        buf[ x ] = msg[ x ];
+    return sizeof( msg ) - 1;
+}
+
+#ifdef USART_SPIN_STATS
+uint8_t spinLine = USART_SPIN_SITES + 1;    // Next line of the "spin" report
+#endif
+
+void console( char *line, uint8_t len )
+{
+#ifdef USART_SPIN_STATS
+    if( len == 4 && line[0] == 's' && line[1] == 'p' && line[2] == 'i' && line[3] == 'n' )
+    {
+        spinLine = 0;
+        return;
+    }
+#endif
+#ifdef BENCHMARKS
+    if( len == 5 && line[0] == 'b' && line[1] == 'e' && line[2] == 'n' && line[3] == 'c' &&
+        line[4] == 'h' )
+    {
+        BENCH_start();
+        return;
+    }
+#endif
+#ifdef INSTRUMENT
+    if( len == 5 && line[0] == 'i' && line[1] == 'n' && line[2] == 's' && line[3] == 't' &&
+        line[4] == 'r' )
+    {
+        INSTR_report();
+        return;
+    }
+#endif
+    if( len )
+    {
+        TXQ_puts( "?\r\n" );
+    }
+}
+
+void frame( uint8_t type, const uint8_t *payload, uint8_t len )
+{
+    switch( type )
+    {
+        case DMX_TYPE_PING:
+            DMX_sendFrame( DMX_TYPE_PING, payload, len );
+            break;
+        case DMX_TYPE_TSYNC:
+            TSYNC_request( payload, len );
+            break;
+        case DMX_TYPE_REC:
+            REC_request( payload, len );
+            break;
+        case DMX_TYPE_CFG:
+            CFG_request( payload, len );
+            break;
+        case DMX_TYPE_PROF:
+            PROF_request( payload, len );
+            break;
+        case DMX_TYPE_BERT:
+            BERT_request( payload, len );
+            break;
+        case DMX_TYPE_LAT:
+            LAT_request( payload, len );
+            break;
+    }
+}
+
+void linkStats( REC_record_t *rec )
+{
+    rec->arg   = DMX_reader.overruns > 255 ? 255 : DMX_reader.overruns;
+    rec->value = DMX_badFrames;
+}
+
+void USART1_IRQHandler( void )
+{
+    TXQ_usartIsr();
+    TSYNC_usartIsr();
+    BERT_usartIsr();
+    LAT_usartIsr();
+}
+
+void DMA1_Channel2_3_IRQHandler( void )
+{
+    TXQ_dmaIsr();
+    RXF_dmaIsr();
+}
+
+// Clock security system switched clocks (NMI): new divisors for everything clocked
+// from the core
+void retime( void )
+{
+    USART_setBaud( USART_baud );
+    SysTick_retime();
+    PROF_retime();
+}
+
 int main( void )
 {
-    //LED PB0
-    RCC->AHBENR |= RCC_AHBENR_GPIOBEN; 
+    // Self-test first; outputs stay off if it fails. After a soft reset Reset_Handler
+    // has already put them back (WARM_boot), so only set bits here.
+    int8_t post = POST_run();
 
-    GPIOB->MODER |= ( 0b01 << GPIO_MODER_MODER0_Pos );
+    if( post == 0 )
+    {
+        //LED PB0
+        RCC->AHBENR |= RCC_AHBENR_GPIOBEN;
 
-    USART_init( USART1, 112500 );
+        GPIOB->MODER |= ( 0b01 << GPIO_MODER_MODER0_Pos );
 
+        WARM_init();
+        WARM_keep( &RCC->AHBENR );
+        WARM_keep( &GPIOB->MODER );
+        WARM_keep( &GPIOB->ODR );
+        WARM_save();
+    }
+    else if( WARM_state.warm )
+    {
+        GPIOB->MODER &= ~GPIO_MODER_MODER0;
+        WARM_forget();
+    }
+
+    CLOCK_init( retime );
+    FLASH_init();
+    CFG_init();
+    USART_init( USART1, CFG->baud );
     USART_putc('H');
     USART_puts("ello World!\n");
+    POST_report();
+
+    SysTick_init();
+    REC_init();                     // May erase a page: before the link is started
+    TXQ_init();
+    RXF_init();
+    DMX_init( console, frame );
+    TSYNC_init();
+    REC_event( REC_POST, POST_flags, POST_us );
+    REC_addSource( REC_LINK, CFG->linkLogMs, linkStats );
+    TLM_init( CFG->baud );
+    TXQ_onQueued = TLM_account;
+    TLM_setWriter( TXQ_bulk );
+    int8_t admitted = TLM_add( heartbeat, CFG->heartbeatMs, 6, 1 );
+    if( admitted != 1 )
+    {
+        // Too fast for the configured baud rate
+        REC_event( REC_TLM, admitted < 0 ? 255 : admitted, CFG->heartbeatMs );
+        TXQ_puts( "heartbeat not admitted\r\n" );
+    }
+#ifdef INSTRUMENT
+    INSTR_init();
+#endif
 
+    uint32_t ledTime = SysTick_millis();
+    uint32_t scrubTime = ledTime;
+    uint8_t clockLogged = 0;
     while( 1 )
     {
-        GPIOB->ODR ^= GPIO_ODR_0;
-        USART_puts("Test!\n");
-        for( uint32_t x=0; x<308e3; x++) ;
+        // A link test owns the port until it has reported
+        if( BERT_run() || LAT_run() )
+            continue;
+        DMX_poll();
+        TLM_run();
+        REC_run();
+        PROF_run();
+#ifdef INSTRUMENT
+        INSTR_run();
+#endif
+#ifdef BENCHMARKS
+        BENCH_run();
+#endif
+#ifdef USART_SPIN_STATS
+        if( spinLine <= USART_SPIN_SITES && TXQ_bulkFree() >= 48 )
+        {
+            char buf[ 48 ];
+            TXQ_bulk( buf, USART_spinLine( spinLine++, buf ) );
+        }
+#endif
+        if( CLOCK_failed != clockLogged )
+        {
+            clockLogged = CLOCK_failed;
+            REC_event( REC_CLOCK, CLOCK_failed, CLOCK_hz / 1000 );
+        }
+        if( SysTick_millis() != scrubTime )
+        {
+            // One image slice per millisecond; log the first corrupt pass only
+            scrubTime = SysTick_millis();
+            if( IMG_scrub() < 0 && IMG_scrubErrors == 1 )
+                REC_event( REC_SCRUB, 0, IMG_scrubPasses );
+        }
+        if( SysTick_millis() - ledTime >= CFG->ledMs )
+        {
+            ledTime += CFG->ledMs;
+            GPIOB->ODR ^= GPIO_ODR_0;
+            WARM_save();
+        }
     }
     return 0;
-}
\ No newline at end of file
+}
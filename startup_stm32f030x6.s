@@ -50,6 +50,30 @@ defined in linker script */
 Reset_Handler:
   ldr   r0, =_estack
   mov   sp, r0          /* set stack pointer */
+
+/* After a software or watchdog reset put the outputs back the way the program left
+   them (STM32F030-CMSIS-WARM-lib.c). Returns 1 if it did. */
+  bl    WARM_boot
+  movs  r4, r0
+
+/* Let SysTick run free from the core clock (no interrupt) to time the power-on
+   self-test. SysTick_init takes it over later. */
+  ldr   r0, =0xE000E010 /* SysTick->CTRL, LOAD at +4, VAL at +8 */
+  ldr   r1, =0x00FFFFFF
+  str   r1, [r0, #4]
+  str   r1, [r0, #8]
+  movs  r1, #5          /* CLKSOURCE | ENABLE */
+  str   r1, [r0]
+
+/* March C- over all of SRAM before anything lives there. Result in r7, kept until the
+   bss is cleared and then stored in POST_ramFault. Skipped after a warm boot, it would
+   wipe the saved outputs (r7 = 0xFFFFFFFF). */
+  movs  r7, #0
+  mvns  r7, r7
+  cmp   r4, #0
+  bne   MarchDone
+  bl    RamMarch
+MarchDone:
   
 /* Call the clock system initialization function.*/
   /* Commented out by Mike for CMSIS (non-HAL) builds on 7/2023) */
@@ -86,6 +110,30 @@ LoopFillZerobss:
   cmp r2, r4
   bcc FillZerobss
 
+  ldr r0, =POST_ramFault
+  str r7, [r0]
+
+/* Peripheral register table (STM32F030-CMSIS-REGINIT-lib.c), 12 byte entries of
+   address, mask, value: *address = ( *address & ~mask ) | value. A mask of all ones
+   writes without reading. */
+  ldr   r0, =__reginit_start
+  ldr   r1, =__reginit_end
+  b     LoopRegInit
+
+RegInit:
+  ldm   r0!, {r2-r4}
+  adds  r5, r3, #1
+  beq   RegInitStore
+  ldr   r5, [r2]
+  bics  r5, r3
+  orrs  r4, r5
+RegInitStore:
+  str   r4, [r2]
+
+LoopRegInit:
+  cmp   r0, r1
+  bcc   RegInit
+
 /* Call static constructors */
   bl __libc_init_array
 /* Call the application's entry point.*/
@@ -97,6 +145,99 @@ LoopForever:
 
 .size Reset_Handler, .-Reset_Handler
 
+/* Address of the first 16 byte block of SRAM that failed the march test, 0 = passed.
+   Read by STM32F030-CMSIS-POST-lib.c. */
+  .global POST_ramFault
+  .section .bss.POST_ramFault,"aw",%nobits
+  .align 2
+POST_ramFault:
+  .space 4
+
+/**
+ * @brief  March C- RAM test over _sram.._estack, four words at a time with LDM/STM.
+ *         Elements: up(w0) up(r0,w1) up(r1,w0) down(r0,w1) down(r1,w0) up(r0), with
+ *         all-zero and all-one words. Blocks are visited in march order, the words
+ *         inside a block always upwards. Uses no stack (it lives in the RAM under test).
+ * @param  None
+ * @retval r7 = address of the first failing block, 0 = pass. Clobbers r0-r6.
+*/
+  .section .text.RamMarch
+  .type RamMarch, %function
+
+/* Read a block, compare every word with r2, write the complement back */
+.macro MARCH_BLOCK
+  ldm   r0!, {r3-r6}
+  cmp   r3, r2
+  bne   RamMarchFail
+  cmp   r4, r2
+  bne   RamMarchFail
+  cmp   r5, r2
+  bne   RamMarchFail
+  cmp   r6, r2
+  bne   RamMarchFail
+  mvns  r3, r3
+  mvns  r4, r4
+  mvns  r5, r5
+  mvns  r6, r6
+  subs  r0, #16
+  stm   r0!, {r3-r6}
+.endm
+
+.macro MARCH_UP
+  movs  r0, r7
+1:
+  MARCH_BLOCK
+  cmp   r0, r1
+  bcc   1b
+  mvns  r2, r2
+.endm
+
+.macro MARCH_DOWN
+  movs  r0, r1
+  subs  r0, #16
+2:
+  MARCH_BLOCK
+  subs  r0, #32
+  cmp   r0, r7
+  bhs   2b
+  mvns  r2, r2
+.endm
+
+RamMarch:
+  ldr   r7, =_sram
+  ldr   r1, =_estack
+  movs  r2, #0
+  movs  r3, #0
+  movs  r4, #0
+  movs  r5, #0
+  movs  r6, #0
+  movs  r0, r7
+RamMarchW0:
+  stm   r0!, {r3-r6}
+  cmp   r0, r1
+  bcc   RamMarchW0
+  MARCH_UP
+  MARCH_UP
+  MARCH_DOWN
+  MARCH_DOWN
+  movs  r0, r7
+RamMarchR0:
+  ldm   r0!, {r3-r6}
+  orrs  r3, r4
+  orrs  r3, r5
+  orrs  r3, r6
+  bne   RamMarchFail
+  cmp   r0, r1
+  bcc   RamMarchR0
+  movs  r7, #0
+  bx    lr
+RamMarchFail:
+  subs  r0, #16
+  movs  r7, r0
+  bx    lr
+  .ltorg
+.size RamMarch, .-RamMarch
+
 /**
  * @brief  This is the code that gets called when the processor receives an
  *         unexpected interrupt.  This simply enters an infinite loop, preserving
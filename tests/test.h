@@ -0,0 +1,79 @@
+//  ==========================================================================================
+//  test.h
+//  ------------------------------------------------------------------------------------------
+//  Shared helpers of the host tests ("make test")
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    The tests compile a library file with the host gcc and check its C functions. This
+//    header comes first: it pulls in the CMSIS device header, then replaces the CMSIS
+//    intrinsics the libraries call with host equivalents (the ARM instructions behind
+//    them do not assemble on the host). The libraries include the device header again,
+//    which its include guard turns into nothing, so the replacements stay in place.
+//
+//      #include "test.h"
+//      #include "../STM32F030-CMSIS-RING-lib.c"
+//      CHECK( RING_count( &r ) == 3, "count %u", RING_count( &r ) );
+//      return TEST_done( "ring" );
+//
+//    A failed CHECK prints the file, line and message and the test goes on; TEST_done
+//    prints a summary and gives the exit code for main.
+//  ==========================================================================================
+
+#ifndef __TESTS_TEST_H
+#define __TESTS_TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "stm32f030x6.h"  // Primary CMSIS header file
+
+
+#define __DMB()           __sync_synchronize()
+
+
+uint32_t TEST_checks;
+uint32_t TEST_failed;
+
+
+#define CHECK( cond, ... )                                                         \
+  do                                                                               \
+  {                                                                                \
+    TEST_checks++;                                                                 \
+    if( !( cond ) )                                                                \
+    {                                                                              \
+      if( TEST_failed++ < 20 )                                                     \
+      {                                                                            \
+        printf( "%s:%d: ", __FILE__, __LINE__ );                                   \
+        printf( __VA_ARGS__ );                                                     \
+        printf( "\n" );                                                            \
+      }                                                                            \
+    }                                                                              \
+  } while( 0 )
+
+
+//  uint32_t
+//  TEST_random( void )
+//  Deterministic pseudo random numbers (xorshift32), so a failure repeats.
+static inline uint32_t
+TEST_random( void )
+{
+  static uint32_t x = 2463534242UL;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+
+//  int
+//  TEST_done( const char *name )
+//  Print the result line. Returns the exit code: 0 if every check passed.
+static int
+TEST_done( const char *name )
+{
+  printf( "%-10s %u checks, %u failed\n", name, TEST_checks, TEST_failed );
+  return TEST_failed ? 1 : 0;
+}
+
+
+#endif /* __TESTS_TEST_H */
@@ -0,0 +1,102 @@
+//  ==========================================================================================
+//  test_bitpack.c
+//  ------------------------------------------------------------------------------------------
+//  Host tests of STM32F030-CMSIS-BITPACK-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    For 10, 11 and 12-bit channels: the packed bytes are checked against a bit by bit
+//    reference packer (least significant bit first), and both round trips are checked,
+//    channels -> bytes -> channels and bytes -> channels -> bytes. Values above B bits
+//    must be masked when packing, and no byte past the packed groups may be written.
+//  ==========================================================================================
+
+#include <string.h>
+#include "test.h"
+#include "../STM32F030-CMSIS-BITPACK-lib.c"
+
+
+#define GROUPS      4
+#define GUARD       0xA5
+
+typedef void ( *unpack_t )( const uint8_t *in, uint16_t *ch, uint8_t groups );
+typedef void ( *pack_t )( const uint16_t *ch, uint8_t *out, uint8_t groups );
+
+
+//  static void
+//  refPack( const uint16_t *ch, uint8_t *out, uint8_t bits, uint16_t channels )
+//  Pack one bit at a time.
+static void
+refPack( const uint16_t *ch, uint8_t *out, uint8_t bits, uint16_t channels )
+{
+  memset( out, 0, channels * bits / 8 );
+  for( uint16_t k = 0; k < channels; k++ )
+    for( uint8_t b = 0; b < bits; b++ )
+      if( ch[ k ] >> b & 1 )
+        out[ ( k * bits + b ) / 8 ] |= 1 << ( ( k * bits + b ) % 8 );
+}
+
+
+//  static void
+//  testWidth( uint8_t bits, unpack_t unpack, pack_t pack )
+//  Random and corner values through both round trips, for 1..GROUPS groups.
+static void
+testWidth( uint8_t bits, unpack_t unpack, pack_t pack )
+{
+  uint16_t ch[ GROUPS * 8 + 1 ], back[ GROUPS * 8 + 1 ];
+  uint8_t  out[ GROUPS * 12 + 1 ], want[ GROUPS * 12 ], bytes[ GROUPS * 12 ];
+  uint16_t mask = BITPACK_MASK( bits );
+
+  for( uint32_t run = 0; run < 20000; run++ )
+    for( uint8_t groups = 1; groups <= GROUPS; groups++ )
+    {
+      uint16_t channels = groups * 8, size = groups * bits;
+
+      // Channels -> bytes -> channels. Some runs use all ones, a single bit, or values
+      // with bits above the width that packing has to drop.
+      for( uint16_t k = 0; k < channels; k++ )
+      {
+        uint16_t r = TEST_random();
+
+        ch[ k ] = run == 0 ? mask : run == 1 ? 1 << ( k % bits ) : run & 1 ? r : r & mask;
+      }
+      memset( out, GUARD, sizeof( out ) );
+      pack( ch, out, groups );
+      for( uint16_t k = 0; k < channels; k++ )
+        ch[ k ] &= mask;
+      refPack( ch, want, bits, channels );
+      CHECK( !memcmp( out, want, size ),
+             "pack%u run %u groups %u: differs from the reference", bits, run, groups );
+      CHECK( out[ size ] == GUARD,
+             "pack%u run %u groups %u: wrote past the end", bits, run, groups );
+
+      back[ channels ] = 0xBEEF;
+      unpack( out, back, groups );
+      for( uint16_t k = 0; k < channels; k++ )
+        CHECK( back[ k ] == ch[ k ],
+               "unpack%u run %u groups %u: channel %u is %03X, expected %03X",
+               bits, run, groups, k, back[ k ], ch[ k ] );
+      CHECK( back[ channels ] == 0xBEEF, "unpack%u run %u groups %u: wrote past the end",
+             bits, run, groups );
+
+      // Bytes -> channels -> bytes: every bit pattern is a valid stream
+      for( uint16_t x = 0; x < size; x++ )
+        bytes[ x ] = TEST_random();
+      unpack( bytes, back, groups );
+      for( uint16_t k = 0; k < channels; k++ )
+        CHECK( back[ k ] <= mask, "unpack%u run %u: channel %u is %X, over %u bits",
+               bits, run, k, back[ k ], bits );
+      pack( back, out, groups );
+      CHECK( !memcmp( out, bytes, size ),
+             "pack%u run %u groups %u: round trip of bytes differs", bits, run, groups );
+    }
+}
+
+
+int
+main( void )
+{
+  testWidth( 10, BITPACK_unpack10, BITPACK_pack10 );
+  testWidth( 11, BITPACK_unpack11_c, BITPACK_pack11 );
+  testWidth( 12, BITPACK_unpack12, BITPACK_pack12 );
+  return TEST_done( "bitpack" );
+}
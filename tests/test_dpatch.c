@@ -0,0 +1,340 @@
+//  ==========================================================================================
+//  test_dpatch.c
+//  ------------------------------------------------------------------------------------------
+//  Host tests of STM32F030-CMSIS-DPATCH-lib.c against tools/delta.py
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Old and new images get their headers from tools/imagehdr.py and the patch between
+//    them comes from tools/delta.py (run from the repository root, as "make test" does).
+//    The patch is applied to a RAM copy of the flash behind erase/program callbacks that
+//    behave like the STM32 flash: programming a halfword that is not erased fails.
+//
+//    Besides the plain and the LZ compressed patch, every run is repeated with the power
+//    failing at each flash operation in turn (the interrupted operation is left half
+//    done), followed by a second run of the whole patch that has to resume from the
+//    progress markers and produce the new image. A patch for another image is refused
+//    before flash is touched.
+//  ==========================================================================================
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "test.h"
+#include "../STM32F030-CMSIS-IMG-lib.c"
+
+// The CRC unit is not there on the host: DPATCH_finish checks the image with the same
+// CRC in software
+#define IMG_check testImgCheck
+static int8_t testImgCheck( uint32_t base );
+
+#include "../STM32F030-CMSIS-LZ-lib.c"
+#include "../STM32F030-CMSIS-DPATCH-lib.c"
+
+
+#define PAGES       32                      // Flash pages, the last one is the scratch page
+#define OLD_SIZE    9000
+
+static uint8_t  *flash;                     // Below 4 GB, the libraries use 32-bit addresses
+static uint32_t  base, scratch;
+static int32_t   powerLeft;                 // Flash operations before the power fails, -1 never
+static uint32_t  operations;                // Flash operations of the last run
+static uint8_t   misuse;                    // Programmed over data or outside the flash
+static char      dir[] = "/tmp/test_dpatchXXXXXX";
+
+
+//  static uint32_t
+//  crcWords( uint32_t crc, const uint8_t *data, uint32_t words )
+//  The CRC unit: CRC-32 polynomial 0x04C11DB7, little endian words fed MSB first.
+static uint32_t
+crcWords( uint32_t crc, const uint8_t *data, uint32_t words )
+{
+  for( uint32_t x = 0; x < words; x++, data += 4 )
+  {
+    crc ^= data[ 0 ] | ( data[ 1 ] << 8 ) | ( data[ 2 ] << 16 ) | ( (uint32_t)data[ 3 ] << 24 );
+    for( uint8_t b = 0; b < 32; b++ )
+      crc = crc & 0x80000000 ? ( crc << 1 ) ^ 0x04C11DB7 : crc << 1;
+  }
+  return crc;
+}
+
+
+static int8_t
+testImgCheck( uint32_t base )
+{
+  const uint8_t *image = (const uint8_t *)(uintptr_t)base;
+  uint32_t       crc;
+
+  if( !IMG_valid( base ) )
+    return -1;
+  crc = crcWords( 0xFFFFFFFF, image, IMG_CRC_WORD );
+  crc = crcWords( crc, image + 4 * IMG_CRC_WORD + 4, IMG_HEADER( base )->length / 4 -
+                  IMG_CRC_WORD - 1 );
+  return crc == IMG_HEADER( base )->crc ? 0 : -1;
+}
+
+
+//  static uint8_t
+//  powerOn( void )
+//  Count a flash operation. Returns 0 if the power fails during it.
+static uint8_t
+powerOn( void )
+{
+  operations++;
+  return powerLeft < 0 || powerLeft-- > 0;
+}
+
+
+static int8_t
+erase( uint32_t addr )
+{
+  uint32_t ofs = addr - base;
+
+  if( ofs % DPATCH_PAGE_SIZE || ofs >= PAGES * DPATCH_PAGE_SIZE )
+  {
+    misuse = 1;
+    return -1;
+  }
+  if( !powerOn() )
+  {
+    memset( flash + ofs, 0xFF, DPATCH_PAGE_SIZE / 2 );
+    return -1;
+  }
+  memset( flash + ofs, 0xFF, DPATCH_PAGE_SIZE );
+  return 0;
+}
+
+
+static int8_t
+program( uint32_t addr, const void *data, uint16_t len )
+{
+  uint32_t ofs = addr - base;
+
+  if( ofs % 2 || len % 2 || ofs + len > PAGES * DPATCH_PAGE_SIZE )
+  {
+    misuse = 1;
+    return -1;
+  }
+  for( uint16_t x = 0; x < len; x += 2 )
+    if( flash[ ofs + x ] != 0xFF || flash[ ofs + x + 1 ] != 0xFF )
+    {
+      misuse = 1;
+      return -1;
+    }
+  if( !powerOn() )
+  {
+    memcpy( flash + ofs, data, len / 4 * 2 );
+    return -1;
+  }
+  memcpy( flash + ofs, data, len );
+  return 0;
+}
+
+
+//  static uint32_t
+//  run( const char *cmd, const char *file, uint8_t *data, uint32_t max )
+//  Run a host tool, then read file into data. Returns its size, 0 on failure.
+static uint32_t
+run( const char *cmd, const char *file, uint8_t *data, uint32_t max )
+{
+  char  path[ 64 ];
+  FILE *f;
+  long  n;
+
+  if( system( cmd ) != 0 )
+    return 0;
+  snprintf( path, sizeof( path ), "%s/%s", dir, file );
+  if( !( f = fopen( path, "rb" ) ) )
+    return 0;
+  n = fread( data, 1, max, f );
+  fclose( f );
+  return n;
+}
+
+
+//  static uint32_t
+//  makeImage( const char *file, uint8_t *image, uint32_t len, uint32_t version )
+//  Put a blank header into image, save it and let imagehdr.py fill the header in.
+//  Returns the final length.
+static uint32_t
+makeImage( const char *file, uint8_t *image, uint32_t len, uint32_t version )
+{
+  IMG_header_t hdr = { IMG_MAGIC, version, 0xFFFFFFFF, 0xFFFFFFFF };
+  char         path[ 64 ], cmd[ 160 ];
+  FILE        *f;
+
+  memcpy( image + IMG_HEADER_OFFSET, &hdr, sizeof( hdr ) );
+  snprintf( path, sizeof( path ), "%s/%s", dir, file );
+  f = fopen( path, "wb" );
+  fwrite( image, 1, len, f );
+  fclose( f );
+  snprintf( cmd, sizeof( cmd ), "python3 tools/imagehdr.py %s > /dev/null", path );
+  return run( cmd, file, image, IMG_MAX_LENGTH );
+}
+
+
+//  static int8_t
+//  apply( const uint8_t *patch, uint32_t len, uint8_t compressed, int32_t cut )
+//  Feed the patch in random pieces, the power failing after cut flash operations
+//  (-1 = not at all). Returns what DPATCH_finish returns.
+static int8_t
+apply( const uint8_t *patch, uint32_t len, uint8_t compressed, int32_t cut )
+{
+  static LZ_decoder_t dec;
+  uint32_t            x = 0, n;
+
+  powerLeft  = cut;
+  operations = 0;
+  DPATCH_start( base, scratch, erase, program );
+  if( compressed )
+    LZ_start( &dec, DPATCH_feed );
+  while( x < len )
+  {
+    n = 1 + TEST_random() % 100;
+    if( n > len - x )
+      n = len - x;
+    if( compressed )
+      LZ_feed( &dec, patch + x, n );
+    else
+      DPATCH_feed( patch + x, n );
+    x += n;
+  }
+  if( compressed && LZ_finish( &dec ) < 0 )
+    return -1;
+  return DPATCH_finish();
+}
+
+
+//  static void
+//  testPatch( const uint8_t *old, uint32_t oldLen, const uint8_t *new, uint32_t newLen,
+//             const char *what )
+//  Patch old into new with and without compression, uninterrupted and with the power
+//  failing at every flash operation of the uncompressed run.
+static void
+testPatch( const uint8_t *old, uint32_t oldLen, const uint8_t *new, uint32_t newLen,
+           const char *what )
+{
+  static uint8_t patch[ 2 * IMG_MAX_LENGTH ];
+  char           cmd[ 200 ];
+  uint32_t       len, total;
+  int8_t         r;
+
+  for( uint8_t compressed = 0; compressed < 2; compressed++ )
+  {
+    snprintf( cmd, sizeof( cmd ), "python3 tools/delta.py %s/old.bin %s/new.bin %s/patch %s"
+              " > /dev/null", dir, dir, dir, compressed ? "-z" : "" );
+    len = run( cmd, "patch", patch, sizeof( patch ) );
+    CHECK( len, "%s: delta.py failed", what );
+    if( !len )
+      return;
+
+    memset( flash, 0xFF, PAGES * DPATCH_PAGE_SIZE );
+    memcpy( flash, old, oldLen );
+    misuse = 0;
+    r      = apply( patch, len, compressed, -1 );
+    total  = operations;
+    CHECK( r == 0 && !memcmp( flash, new, newLen ) && !misuse,
+           "%s%s: result %d, error %u", what, compressed ? " (lz)" : "", r, DPATCH_error );
+
+    // Applied again, every page is already done
+    r = apply( patch, len, compressed, -1 );
+    CHECK( r == 0 && operations == 0, "%s%s: second run %d, %u flash operations",
+           what, compressed ? " (lz)" : "", r, operations );
+
+    // Power failures, then the whole patch again
+    for( uint32_t cut = 0; cut < total; cut += compressed ? 1 + total / 16 : 1 )
+    {
+      memset( flash, 0xFF, PAGES * DPATCH_PAGE_SIZE );
+      memcpy( flash, old, oldLen );
+      misuse = 0;
+      r      = apply( patch, len, compressed, cut );
+      CHECK( r < 0 && DPATCH_error == DPATCH_EFLASH, "%s%s, cut at %u: result %d, error %u",
+             what, compressed ? " (lz)" : "", cut, r, DPATCH_error );
+      r = apply( patch, len, compressed, -1 );
+      CHECK( r == 0 && !memcmp( flash, new, newLen ) && !misuse,
+             "%s%s, cut at %u of %u: resumed with %d, error %u",
+             what, compressed ? " (lz)" : "", cut, total, r, DPATCH_error );
+    }
+  }
+
+  // Not the image the patch was made for
+  memset( flash, 0xFF, PAGES * DPATCH_PAGE_SIZE );
+  memcpy( flash, new, newLen );
+  ( (IMG_header_t *)( flash + IMG_HEADER_OFFSET ) )->crc ^= 1;
+  r = apply( patch, len, 1, -1 );
+  CHECK( r < 0 && DPATCH_error == DPATCH_EBASE && operations == 0,
+         "%s: wrong base gave %d, error %u, %u flash operations", what, r, DPATCH_error,
+         operations );
+}
+
+
+//  static uint32_t
+//  derive( const uint8_t *old, uint32_t oldLen, uint8_t *new, uint32_t at, int32_t shift )
+//  Copy old into new with shift bytes inserted (or -shift removed) at offset at and a few
+//  bytes changed, as a rebuild with some code edited would. Returns the new length.
+static uint32_t
+derive( const uint8_t *old, uint32_t oldLen, uint8_t *new, uint32_t at, int32_t shift )
+{
+  uint32_t len = oldLen + shift;
+
+  memcpy( new, old, at );
+  if( shift >= 0 )
+  {
+    for( int32_t x = 0; x < shift; x++ )
+      new[ at + x ] = TEST_random();
+    memcpy( new + at + shift, old + at, oldLen - at );
+  }
+  else
+    memcpy( new + at, old + at - shift, oldLen - at + shift );
+  for( uint8_t x = 0; x < 40; x++ )
+    new[ IMG_HEADER_OFFSET + 16 + TEST_random() % ( len - IMG_HEADER_OFFSET - 16 ) ] ^= 0x10;
+  return len;
+}
+
+
+int
+main( void )
+{
+  static uint8_t old[ IMG_MAX_LENGTH ], new[ IMG_MAX_LENGTH ];
+  uint32_t       oldLen, newLen;
+  char           cmd[ 100 ];
+
+  flash = mmap( (void *)0x10000000, PAGES * DPATCH_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( flash == MAP_FAILED || (uintptr_t)flash + PAGES * DPATCH_PAGE_SIZE > 0xFFFFFFFF ||
+      !mkdtemp( dir ) )
+  {
+    printf( "test_dpatch: no flash below 4 GB or no temporary directory\n" );
+    return 1;
+  }
+  base    = (uintptr_t)flash;
+  scratch = base + ( PAGES - 1 ) * DPATCH_PAGE_SIZE;
+
+  // Code-like old image: a small set of halfwords, so there is something to match
+  for( uint32_t x = 0; x < OLD_SIZE; x += 2 )
+  {
+    uint32_t r = TEST_random() % 64;
+
+    old[ x ]     = r * 37;
+    old[ x + 1 ] = r < 48 ? 0x20 + r / 8 : 0xF0;
+  }
+  oldLen = makeImage( "old.bin", old, OLD_SIZE, 1 );
+
+  newLen = makeImage( "new.bin", new, derive( old, oldLen, new, 0, 0 ), 2 );
+  testPatch( old, oldLen, new, newLen, "edited" );
+
+  newLen = makeImage( "new.bin", new, derive( old, oldLen, new, 3000, 300 ), 2 );
+  testPatch( old, oldLen, new, newLen, "grown" );
+
+  newLen = makeImage( "new.bin", new, derive( old, oldLen, new, 1500, -1200 ), 2 );
+  testPatch( old, oldLen, new, newLen, "shrunk" );
+
+  for( uint32_t x = 0; x < 5000; x++ )
+    new[ x ] = TEST_random();
+  newLen = makeImage( "new.bin", new, 5000, 3 );
+  testPatch( old, oldLen, new, newLen, "replaced" );
+
+  snprintf( cmd, sizeof( cmd ), "rm -rf %s", dir );
+  system( cmd );
+  return TEST_done( "dpatch" );
+}
@@ -0,0 +1,148 @@
+//  ==========================================================================================
+//  test_kernels.c
+//  ------------------------------------------------------------------------------------------
+//  Host tests of the C twins of the Thumb-1 kernels (kernels_cortexm0.s)
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    RING_copy_c, CRC16_update_c, BITPACK_unpack11_c and FMT_hex_c against fixed vectors
+//    worked out independently (the CRCs with Python's binascii.crc_hqx, the SBUS frame
+//    bit by bit). The _asm twins are compared with these on the target by POST_kernels
+//    (STM32F030-CMSIS-POST-lib.c) in ASM_KERNELS builds.
+//  ==========================================================================================
+
+#include <string.h>
+#include "test.h"
+#include "../STM32F030-CMSIS-RING-lib.c"
+#include "../STM32F030-CMSIS-CRC-lib.c"
+#include "../STM32F030-CMSIS-BITPACK-lib.c"
+#include "../STM32F030-CMSIS-FMT-lib.c"
+
+
+static void
+testCopy( void )
+{
+  static const char text[] = "The quick brown fox jumps over the lazy dog";
+  uint8_t           dst[ 64 ];
+
+  for( uint8_t ofs = 0; ofs < 4; ofs++ )
+    for( uint8_t len = 0; len <= 40; len++ )
+    {
+      memset( dst, '#', sizeof( dst ) );
+      RING_copy_c( dst + ofs, (const uint8_t *)text + 1, len );
+      CHECK( !memcmp( dst + ofs, text + 1, len ),
+             "copy ofs %u len %u: wrong data", ofs, len );
+      CHECK( ( !ofs || dst[ ofs - 1 ] == '#' ) && dst[ ofs + len ] == '#',
+             "copy ofs %u len %u: wrote outside", ofs, len );
+    }
+}
+
+
+static void
+testCrc( void )
+{
+  static const struct
+  {
+    const char *data;
+    uint32_t    len;
+    uint16_t    crc;
+  } vectors[] =
+  {
+    { "",          0, 0xFFFF },
+    { "A",         1, 0xB915 },
+    { "123456789", 9, 0x29B1 },
+    { "\0\0\0\0",  4, 0x84C0 },
+    { "\xFF\xFF\xFF\xFF", 4, 0x1D0F },
+  };
+  uint8_t  all[ 256 ];
+  uint16_t crc;
+
+  for( uint8_t x = 0; x < sizeof( vectors ) / sizeof( vectors[ 0 ] ); x++ )
+  {
+    crc = CRC16_update_c( CRC16_INIT, vectors[ x ].data, vectors[ x ].len );
+    CHECK( crc == vectors[ x ].crc,
+           "crc16 vector %u: %04X, expected %04X", x, crc, vectors[ x ].crc );
+  }
+
+  // Bytes 0..255, in one call and continued in pieces
+  for( uint16_t x = 0; x < 256; x++ )
+    all[ x ] = x;
+  crc = CRC16_update_c( CRC16_INIT, all, 256 );
+  CHECK( crc == 0x3FBD, "crc16 0..255: %04X, expected 3FBD", crc );
+  crc = CRC16_INIT;
+  for( uint16_t x = 0; x < 256; x += 37 )
+    crc = CRC16_update_c( crc, all + x, x + 37 > 256 ? 256 - x : 37 );
+  CHECK( crc == 0x3FBD, "crc16 0..255 in pieces: %04X, expected 3FBD", crc );
+}
+
+
+static void
+testUnpack11( void )
+{
+  static const uint8_t  frame[ 22 ] =
+  {
+    0x00, 0xF8, 0x7F, 0x55, 0x55, 0x15, 0x00, 0x00, 0x8E, 0xC4, 0xFF,
+    0xE8, 0x63, 0x05, 0x77, 0xA1, 0x2F, 0x97, 0x59, 0x99, 0x39, 0x13
+  };
+  static const uint16_t want[ 16 ] =
+  {
+    0x000, 0x7FF, 0x555, 0x2AA, 0x001, 0x400, 0x123, 0x7FE,
+    0x3E8, 0x0AC, 0x5DC, 0x7D0, 0x172, 0x2B3, 0x666, 0x099
+  };
+  uint16_t ch[ 17 ];
+
+  ch[ 16 ] = 0xBEEF;
+  BITPACK_unpack11_c( frame, ch, 2 );
+  for( uint8_t k = 0; k < 16; k++ )
+    CHECK( ch[ k ] == want[ k ],
+           "unpack11 channel %u: %03X, expected %03X", k, ch[ k ], want[ k ] );
+  CHECK( ch[ 16 ] == 0xBEEF, "unpack11: wrote past 16 channels" );
+  BITPACK_unpack11_c( frame, ch + 16, 0 );
+  CHECK( ch[ 16 ] == 0xBEEF, "unpack11: 0 groups wrote a channel" );
+}
+
+
+static void
+testHex( void )
+{
+  static const struct
+  {
+    uint32_t    number;
+    uint8_t     places;
+    const char *text;
+  } vectors[] =
+  {
+    { 0x89ABCDEF, 8, "89ABCDEF" },
+    { 0x0000001F, 2, "1F" },
+    { 0x0000001F, 4, "001F" },
+    { 0x00000100, 2, ".." },
+    { 0x00000000, 1, "0" },
+    { 0x0000000A, 1, "A" },
+    { 0x00000010, 1, "." },
+    { 0xFFFFFFFF, 7, "......." },
+    { 0xFFFFFFFF, 8, "FFFFFFFF" },
+    { 0x00000009, 0, "" },
+  };
+  char    buf[ 10 ];
+  uint8_t n;
+
+  for( uint8_t x = 0; x < sizeof( vectors ) / sizeof( vectors[ 0 ] ); x++ )
+  {
+    memset( buf, '#', sizeof( buf ) );
+    n = FMT_hex_c( buf, vectors[ x ].number, vectors[ x ].places );
+    CHECK( n == vectors[ x ].places && !memcmp( buf, vectors[ x ].text, n ) &&
+           buf[ n ] == '#',
+           "hex %X/%u: \"%.*s\", expected \"%s\"", vectors[ x ].number, vectors[ x ].places,
+           n, buf, vectors[ x ].text );
+  }
+}
+
+
+int
+main( void )
+{
+  testCopy();
+  testCrc();
+  testUnpack11();
+  testHex();
+  return TEST_done( "kernels" );
+}
@@ -0,0 +1,193 @@
+//  ==========================================================================================
+//  test_lz.c
+//  ------------------------------------------------------------------------------------------
+//  Host tests of STM32F030-CMSIS-LZ-lib.c against tools/lzpack.py
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Each input is compressed by the real host tool (python3 tools/lzpack.py, run from the
+//    repository root as "make test" does) and decoded here, in one piece, a byte at a time
+//    and in random pieces that split tokens and the header. The inputs cover the empty
+//    image, literal runs longer than one token, overlapping matches, references at the
+//    far end of the window and source text. Damaged streams must make LZ_finish fail.
+//  ==========================================================================================
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "../STM32F030-CMSIS-LZ-lib.c"
+
+
+#define MAX_SIZE    6000
+
+static uint8_t  output[ MAX_SIZE + 1 ];
+static uint32_t outLen;
+static uint16_t largest;                // Largest piece handed to the sink
+static char     dir[] = "/tmp/test_lzXXXXXX";
+
+
+static void
+sink( const uint8_t *data, uint16_t len )
+{
+  if( outLen + len <= sizeof( output ) )
+    memcpy( output + outLen, data, len );
+  outLen += len;
+  if( len > largest )
+    largest = len;
+}
+
+
+//  static uint32_t
+//  pack( const uint8_t *data, uint32_t size, uint8_t *packed, uint32_t max )
+//  Compress data with tools/lzpack.py. Returns the compressed size, 0 on failure.
+static uint32_t
+pack( const uint8_t *data, uint32_t size, uint8_t *packed, uint32_t max )
+{
+  char  in[ 64 ], out[ 64 ], cmd[ 200 ];
+  FILE *f;
+  long  n;
+
+  snprintf( in, sizeof( in ), "%s/in.bin", dir );
+  snprintf( out, sizeof( out ), "%s/out.lz", dir );
+  f = fopen( in, "wb" );
+  fwrite( data, 1, size, f );
+  fclose( f );
+  snprintf( cmd, sizeof( cmd ), "python3 tools/lzpack.py %s %s > /dev/null", in, out );
+  if( system( cmd ) != 0 || !( f = fopen( out, "rb" ) ) )
+    return 0;
+  n = fread( packed, 1, max, f );
+  fclose( f );
+  return n;
+}
+
+
+//  static int8_t
+//  decode( const uint8_t *packed, uint32_t len, uint8_t piece )
+//  Run packed through the decoder in pieces of 1..piece bytes (0 = all at once).
+//  Returns what LZ_finish returns.
+static int8_t
+decode( const uint8_t *packed, uint32_t len, uint8_t piece )
+{
+  static LZ_decoder_t dec;
+  uint32_t            x = 0, n;
+
+  outLen  = 0;
+  largest = 0;
+  LZ_start( &dec, sink );
+  while( x < len )
+  {
+    n = piece ? 1 + TEST_random() % piece : len;
+    if( n > len - x )
+      n = len - x;
+    LZ_feed( &dec, packed + x, n );
+    x += n;
+  }
+  return LZ_finish( &dec );
+}
+
+
+static void
+testImage( const uint8_t *data, uint32_t size, const char *what )
+{
+  static uint8_t packed[ 2 * MAX_SIZE ];
+  uint32_t       len = pack( data, size, packed, sizeof( packed ) );
+  static const uint8_t pieces[] = { 0, 1, 2, 7, 17, 200 };
+
+  CHECK( len >= LZ_HEADER_SIZE, "%s: lzpack.py failed", what );
+  if( len < LZ_HEADER_SIZE )
+    return;
+
+  for( uint8_t p = 0; p < sizeof( pieces ); p++ )
+  {
+    int8_t r = decode( packed, len, pieces[ p ] );
+
+    CHECK( r == 0 && outLen == size && !memcmp( output, data, size ),
+           "%s, pieces of %u: result %d, %u of %u bytes", what, pieces[ p ], r, outLen, size );
+    CHECK( largest <= LZ_WINDOW, "%s: sink got %u bytes at once", what, largest );
+  }
+
+  // Truncated anywhere, or with a byte too many, the image must be refused
+  for( uint32_t cut = 0; cut < len; cut += 1 + len / 50 )
+    CHECK( decode( packed, cut, 0 ) < 0, "%s: accepted after %u of %u bytes", what, cut, len );
+  if( size )
+  {
+    packed[ len ] = 0x00;
+    CHECK( decode( packed, len + 1, 0 ) < 0, "%s: accepted a trailing token", what );
+  }
+  packed[ 1 ] ^= 0x01;
+  CHECK( decode( packed, len, 0 ) < 0, "%s: accepted a bad header", what );
+}
+
+
+static void
+testDamaged( void )
+{
+  // A match 2 bytes back after 1 literal, and a size the tokens do not reach
+  static const uint8_t early[] = { 'L', 'Z', 4, 0, 0, 0, 0x00, 'a', 0x80, 0x01 };
+  static const uint8_t longer[] = { 'L', 'Z', 9, 0, 0, 0, 0x00, 'a', 0x80, 0x00 };
+  static const uint8_t shorter[] = { 'L', 'Z', 3, 0, 0, 0, 0x00, 'a', 0x80, 0x00 };
+  static const uint8_t good[] = { 'L', 'Z', 4, 0, 0, 0, 0x00, 'a', 0x80, 0x00 };
+
+  CHECK( decode( early, sizeof( early ), 0 ) < 0, "reference before the start accepted" );
+  CHECK( decode( longer, sizeof( longer ), 0 ) < 0, "short output accepted" );
+  CHECK( decode( shorter, sizeof( shorter ), 0 ) < 0, "output beyond the size accepted" );
+  CHECK( decode( good, sizeof( good ), 0 ) == 0 && outLen == 4 && !memcmp( output, "aaaa", 4 ),
+         "overlapping match: %u bytes", outLen );
+}
+
+
+int
+main( void )
+{
+  static uint8_t data[ MAX_SIZE ];
+  uint32_t       size;
+  FILE          *f;
+
+  if( !mkdtemp( dir ) )
+  {
+    printf( "test_lz: no temporary directory\n" );
+    return 1;
+  }
+
+  testImage( data, 0, "empty" );
+  data[ 0 ] = 0x5A;
+  testImage( data, 1, "one byte" );
+
+  memset( data, 0, 1000 );
+  testImage( data, 1000, "zeros" );
+
+  for( uint32_t x = 0; x < 700; x++ )
+    data[ x ] = TEST_random();
+  testImage( data, 700, "random" );
+
+  // Repeats of random length at random distances up to beyond the window
+  size = 0;
+  while( size < MAX_SIZE )
+  {
+    uint32_t r = TEST_random(), back = 1 + ( r >> 8 ) % 300, n = 1 + ( r >> 20 ) % 150;
+
+    for( ; n && size < MAX_SIZE; n--, size++ )
+      data[ size ] = r & 1 && back <= size ? data[ size - back ] : TEST_random();
+  }
+  testImage( data, size, "repeats" );
+
+  // Period 256: every match is at the largest offset
+  for( uint32_t x = 0; x < 256; x++ )
+    data[ x ] = TEST_random();
+  for( uint32_t x = 256; x < 2048; x++ )
+    data[ x ] = data[ x - 256 ];
+  testImage( data, 2048, "period 256" );
+
+  f    = fopen( "STM32F030-CMSIS-LZ-lib.c", "rb" );
+  size = f ? fread( data, 1, MAX_SIZE, f ) : 0;
+  if( f )
+    fclose( f );
+  CHECK( size, "cannot read STM32F030-CMSIS-LZ-lib.c (run from the repository root)" );
+  testImage( data, size, "source text" );
+
+  testDamaged();
+
+  snprintf( (char *)data, MAX_SIZE, "rm -rf %s", dir );
+  system( (char *)data );
+  return TEST_done( "lz" );
+}
@@ -0,0 +1,154 @@
+//  ==========================================================================================
+//  test_ring.c
+//  ------------------------------------------------------------------------------------------
+//  Host tests of STM32F030-CMSIS-RING-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Fill level and free space across the 16-bit wrap of head and tail, the contiguous
+//    spans at every position and fill level (split at the end of the buffer), and
+//    RING_write / RING_read against a plain reference queue with random lengths.
+//  ==========================================================================================
+
+#include <string.h>
+#include "test.h"
+#include "../STM32F030-CMSIS-RING-lib.c"
+
+
+RING_DEFINE( ring1, 1 );
+RING_DEFINE( ring8, 8 );
+RING_DEFINE( ring64, 64 );
+RING_DEFINE( ring256, 256 );
+
+RING_t *rings[] = { &ring1, &ring8, &ring64, &ring256 };
+
+
+//  static void
+//  testWrap( RING_t *r )
+//  Fill and empty the ring byte by byte from start indices around 0xFFFF.
+static void
+testWrap( RING_t *r )
+{
+  uint16_t size = r->mask + 1;
+
+  for( uint32_t start = 0xFFFF - size - 2; start <= 0xFFFF + size + 2; start++ )
+  {
+    r->head = r->tail = (uint16_t)start;
+    for( uint16_t n = 0; n < size; n++ )
+    {
+      CHECK( RING_count( r ) == n, "size %u start %X: count %u, expected %u",
+             size, start, RING_count( r ), n );
+      CHECK( RING_free( r ) == size - n, "size %u start %X: free %u, expected %u",
+             size, start, RING_free( r ), size - n );
+      CHECK( RING_put( r, (uint8_t)( start + n ) ), "size %u start %X: put %u refused",
+             size, start, n );
+    }
+    CHECK( RING_free( r ) == 0 && !RING_put( r, 0 ), "size %u start %X: full ring took a byte",
+           size, start );
+    for( uint16_t n = 0; n < size; n++ )
+    {
+      int16_t c = RING_get( r );
+
+      CHECK( c == (uint8_t)( start + n ), "size %u start %X: got %d, expected %u",
+             size, start, c, (uint8_t)( start + n ) );
+    }
+    CHECK( RING_count( r ) == 0 && RING_get( r ) == -1, "size %u start %X: not empty",
+           size, start );
+  }
+}
+
+
+//  static void
+//  testSpans( RING_t *r )
+//  Every start position and fill level, with the indices just below and across the wrap.
+static void
+testSpans( RING_t *r )
+{
+  static const uint16_t bases[] = { 0, 0xFFFF - 300 };
+  uint16_t              size = r->mask + 1;
+  const uint8_t        *rp;
+  uint8_t              *wp;
+
+  for( uint8_t b = 0; b < sizeof( bases ) / sizeof( bases[ 0 ] ); b++ )
+    for( uint16_t pos = 0; pos < 2 * size; pos++ )
+      for( uint16_t fill = 0; fill <= size; fill++ )
+      {
+        uint16_t tail  = bases[ b ] + pos + 256;
+        uint16_t head  = tail + fill;
+        uint16_t rpos  = tail & r->mask, wpos = head & r->mask;
+        uint16_t rwant = fill < size - rpos ? fill : size - rpos;
+        uint16_t wwant = size - fill < size - wpos ? size - fill : size - wpos;
+        uint16_t n;
+
+        r->tail = tail;
+        r->head = head;
+        n = RING_readSpan( r, &rp );
+        CHECK( n == rwant && rp == r->buf + rpos, "size %u tail %X fill %u: read span %u at %d",
+               size, tail, fill, n, (int)( rp - r->buf ) );
+        n = RING_writeSpan( r, &wp );
+        CHECK( n == wwant && wp == r->buf + wpos, "size %u tail %X fill %u: write span %u at %d",
+               size, tail, fill, n, (int)( wp - r->buf ) );
+
+        // The rest of the free space comes as a second span from the buffer start
+        RING_commitWrite( r, n );
+        n = RING_writeSpan( r, &wp );
+        CHECK( n == size - fill - wwant && ( !n || wp == r->buf ),
+               "size %u tail %X fill %u: second write span %u", size, tail, fill, n );
+        CHECK( RING_count( r ) == fill + wwant, "size %u tail %X fill %u: count %u after commit",
+               size, tail, fill, RING_count( r ) );
+      }
+}
+
+
+//  static void
+//  testQueue( RING_t *r )
+//  Random writes and reads of 0..size + 8 bytes, checked against a reference queue.
+static void
+testQueue( RING_t *r )
+{
+  static uint8_t ref[ 1024 ];
+  uint8_t        data[ 300 ], out[ 300 ];
+  uint16_t       size = r->mask + 1;
+  uint32_t       refHead = 0, refTail = 0;         // Unbounded, ref[] wraps at 1024
+
+  r->head = r->tail = 0xFFFF - 3 * size;
+  for( uint32_t op = 0; op < 40000; op++ )
+  {
+    uint16_t len = TEST_random() % ( size + 9 );
+    uint16_t n, want;
+
+    if( TEST_random() & 1 )
+    {
+      for( uint16_t x = 0; x < len; x++ )
+        data[ x ] = TEST_random();
+      want = len < size - ( refHead - refTail ) ? len : size - ( refHead - refTail );
+      n = RING_write( r, data, len );
+      CHECK( n == want, "size %u op %u: wrote %u of %u, expected %u", size, op, n, len, want );
+      for( uint16_t x = 0; x < n; x++ )
+        ref[ refHead++ & 1023 ] = data[ x ];
+    }
+    else
+    {
+      want = len < refHead - refTail ? len : refHead - refTail;
+      n = RING_read( r, out, len );
+      CHECK( n == want, "size %u op %u: read %u of %u, expected %u", size, op, n, len, want );
+      for( uint16_t x = 0; x < n; x++, refTail++ )
+        CHECK( out[ x ] == ref[ refTail & 1023 ], "size %u op %u: byte %u is %02X, expected %02X",
+               size, op, x, out[ x ], ref[ refTail & 1023 ] );
+    }
+    CHECK( RING_count( r ) == refHead - refTail, "size %u op %u: count %u, expected %u",
+           size, op, RING_count( r ), refHead - refTail );
+  }
+}
+
+
+int
+main( void )
+{
+  for( uint8_t x = 0; x < sizeof( rings ) / sizeof( rings[ 0 ] ); x++ )
+  {
+    testWrap( rings[ x ] );
+    testSpans( rings[ x ] );
+    testQueue( rings[ x ] );
+  }
+  return TEST_done( "ring" );
+}
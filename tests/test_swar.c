@@ -0,0 +1,150 @@
+//  ==========================================================================================
+//  test_swar.c
+//  ------------------------------------------------------------------------------------------
+//  Host tests of STM32F030-CMSIS-SWAR-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Summary:
+//    Each word-at-a-time routine is compared with a byte loop at every alignment of the
+//    buffer and every length up to 64. The data mixes random bytes with the values next
+//    to the ones searched for (where a wrong borrow or carry would show), a single match
+//    moved through every position, and matches right after the end of the buffer, which
+//    must not be found.
+//  ==========================================================================================
+
+#include "test.h"
+#include "../STM32F030-CMSIS-SWAR-lib.c"
+
+
+#define MAX_LEN     64
+
+static const uint8_t edges[] = { 0x00, 0x01, 0x02, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x1F,
+                                 0x20, 0x21, 0x40, 0x41, 0x7E, 0x7F, 0x80, 0x81, 0x8A, 0x8D,
+                                 0xA0, 0xFE, 0xFF };
+static const uint8_t targets[] = { 0x00, 0x0A, 0x0D, 0x41, 0x7F, 0x80, 0xFF };
+
+static uint8_t       block[ MAX_LEN + 16 ] __attribute__(( aligned( 4 ) ));
+
+
+static uint16_t
+refFindByte( const uint8_t *data, uint16_t len, uint8_t c )
+{
+  uint16_t x = 0;
+
+  while( x < len && data[ x ] != c )
+    x++;
+  return x;
+}
+
+
+static uint16_t
+refFindLineEnd( const uint8_t *data, uint16_t len )
+{
+  uint16_t x = 0;
+
+  while( x < len && data[ x ] != '\r' && data[ x ] != '\n' && data[ x ] != 0 )
+    x++;
+  return x;
+}
+
+
+static uint16_t
+refSpanPrintable( const uint8_t *data, uint16_t len )
+{
+  uint16_t x = 0;
+
+  while( x < len && data[ x ] >= 0x20 && data[ x ] <= 0x7E )
+    x++;
+  return x;
+}
+
+
+static uint8_t
+refIsAscii( const uint8_t *data, uint16_t len )
+{
+  for( uint16_t x = 0; x < len; x++ )
+    if( data[ x ] & 0x80 )
+      return 0;
+  return 1;
+}
+
+
+//  static void
+//  compare( const uint8_t *data, uint16_t len, const char *what )
+//  Run all four routines on data and check them against the byte loops.
+static void
+compare( const uint8_t *data, uint16_t len, const char *what )
+{
+  uint32_t align = (uintptr_t)data & 7;
+  uint16_t got, want;
+
+  for( uint8_t t = 0; t < sizeof( targets ); t++ )
+  {
+    got  = SWAR_findByte( data, len, targets[ t ] );
+    want = refFindByte( data, len, targets[ t ] );
+    CHECK( got == want, "findByte %02X, %s, align %u len %u: %u, expected %u",
+           targets[ t ], what, align, len, got, want );
+  }
+  got  = SWAR_findLineEnd( data, len );
+  want = refFindLineEnd( data, len );
+  CHECK( got == want, "findLineEnd, %s, align %u len %u: %u, expected %u",
+         what, align, len, got, want );
+  got  = SWAR_spanPrintable( data, len );
+  want = refSpanPrintable( data, len );
+  CHECK( got == want, "spanPrintable, %s, align %u len %u: %u, expected %u",
+         what, align, len, got, want );
+  got  = SWAR_isAscii( data, len );
+  want = refIsAscii( data, len );
+  CHECK( got == want, "isAscii, %s, align %u len %u: %u, expected %u",
+         what, align, len, got, want );
+}
+
+
+//  static void
+//  fillAfter( uint8_t *data, uint16_t len, uint8_t value )
+//  Put value in every byte of block after data[ len - 1 ].
+static void
+fillAfter( uint8_t *data, uint16_t len, uint8_t value )
+{
+  for( uint8_t *p = data + len; p < block + sizeof( block ); p++ )
+    *p = value;
+}
+
+
+int
+main( void )
+{
+  for( uint8_t align = 0; align < 8; align++ )
+    for( uint16_t len = 0; len <= MAX_LEN; len++ )
+    {
+      uint8_t *data = block + align;
+
+      // Random bytes, mostly the edge values
+      for( uint16_t run = 0; run < 200; run++ )
+      {
+        for( uint16_t x = 0; x < len; x++ )
+        {
+          uint32_t r = TEST_random();
+
+          data[ x ] = r & 0x300 ? edges[ ( r >> 16 ) % sizeof( edges ) ] : (uint8_t)r;
+        }
+        fillAfter( data, len, edges[ run % sizeof( edges ) ] );
+        compare( data, len, "random" );
+      }
+
+      // Every pair of edge values: one as the background, the other at each position
+      for( uint8_t b = 0; b < sizeof( edges ); b++ )
+        for( uint8_t t = 0; t < sizeof( edges ); t++ )
+        {
+          for( uint16_t pos = 0; pos <= len; pos++ )
+          {
+            for( uint16_t x = 0; x < len; x++ )
+              data[ x ] = edges[ b ];
+            if( pos < len )
+              data[ pos ] = edges[ t ];
+            fillAfter( data, len, edges[ t ] );
+            compare( data, len, "single" );
+          }
+        }
+    }
+  return TEST_done( "swar" );
+}
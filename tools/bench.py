@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Run the on-target micro-benchmarks of a "make BENCHMARKS=1" build
+# (STM32F030-CMSIS-BENCH-lib.c) and compare them with a stored baseline.
+#
+#   ./bench.py /dev/ttyUSB0                           print min / median / max cycles
+#   ./bench.py /dev/ttyUSB0 --save base.json          also store the results as a baseline
+#   ./bench.py /dev/ttyUSB0 --compare base.json [pct] compare medians, default tolerance 5%
+#
+# Cycles are core clock cycles with the timing overhead removed. With --compare the exit
+# status is 1 if any median grew by more than the tolerance or a baseline benchmark is
+# missing, so the script can gate a build.
+
+import json
+import sys
+
+import dmx
+import instr
+
+
+def run( link ):
+    results = {}
+    for line in instr.fetch( link, "bench", "BENCH end" ):
+        parts = line.split()
+        if line.startswith( "BENCH" ):
+            print( line )
+        elif len( parts ) == 5 and parts[ 0 ] == "B":
+            results[ parts[ 1 ] ] = dict( zip( ( "min", "median", "max" ), ( int( p ) for p in parts[ 2: ] ) ) )
+    return results
+
+
+def compare( results, baseline, tolerance ):
+    failed = False
+    print( "%-24s %10s %10s %8s" % ( "benchmark", "baseline", "median", "change" ) )
+    for name in sorted( set( baseline ) | set( results ) ):
+        if name not in results:
+            print( "%-24s %10d %10s %8s  MISSING" % ( name, baseline[ name ][ "median" ], "-", "" ) )
+            failed = True
+            continue
+        now = results[ name ][ "median" ]
+        if name not in baseline:
+            print( "%-24s %10s %10d %8s  new" % ( name, "-", now, "" ) )
+            continue
+        base = baseline[ name ][ "median" ]
+        change = 100.0 * ( now - base ) / base if base else ( 0.0 if now == base else 100.0 )
+        slower = change > tolerance
+        failed |= slower
+        print( "%-24s %10d %10d %+7.1f%%%s" % ( name, base, now, change, "  SLOWER" if slower else "" ) )
+    return failed
+
+
+def main():
+    args = sys.argv[ 1: ]
+    if not args or ( len( args ) > 1 and args[ 1 ] not in ( "--save", "--compare" ) ) or len( args ) == 2:
+        sys.exit( "usage: bench.py PORT [--save FILE | --compare FILE [PCT]]" )
+    results = run( dmx.Link( args[ 0 ] ) )
+    if len( args ) == 1:
+        print( "%-24s %10s %10s %10s" % ( "benchmark", "min", "median", "max" ) )
+        for name, r in sorted( results.items() ):
+            print( "%-24s %10d %10d %10d" % ( name, r[ "min" ], r[ "median" ], r[ "max" ] ) )
+    elif args[ 1 ] == "--save":
+        with open( args[ 2 ], "w" ) as f:
+            json.dump( results, f, indent=1, sort_keys=True )
+        print( "%d benchmarks saved to %s" % ( len( results ), args[ 2 ] ) )
+    else:
+        with open( args[ 2 ] ) as f:
+            baseline = json.load( f )
+        if compare( results, baseline, float( args[ 3 ] ) if len( args ) > 3 else 5.0 ):
+            sys.exit( 1 )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# Bit error rate test of the serial link against STM32F030-CMSIS-BERT-lib.c.
+#
+#   ./bert.py /dev/ttyUSB0 [--prbs 7|15|31] [--baud B] [--seconds S] [--dir both|down|up]
+#             [--link BAUD]
+#
+# down: the device sends the pattern and this script checks it; up: this script sends and
+# the device checks; both (default): at the same time. The test runs at --baud (default
+# the link rate), the request and the result travel at --link (default 112500). The
+# pattern and the checker (hunt, verify, compare, resync on a bad block) are the same on
+# both ends.
+
+import argparse
+import struct
+import sys
+import time
+
+import dmx
+
+SEND, CHECK = 0x01, 0x02
+SETTLE = 0.1                    # LEND_SETTLE_MS
+VERIFY, BLOCK, LOSS_BITS = 4, 64, 64
+
+
+class Prbs:
+    """x^n + x^m + 1 generator holding the last n bits, oldest in bit 0."""
+
+    def __init__( self, order ):
+        self.order = order
+        self.tap = 3 if order == 31 else 1
+        self.step = 4 if order == 7 else 8
+        self.state = ( 1 << order ) - 1
+
+    def shift( self, data=None ):
+        """Next 8 bits, first in bit 0; with data, load them instead."""
+        r, mask, out = self.state, ( 1 << self.step ) - 1, 0
+        for x in range( 0, 8, self.step ):
+            bits = ( data >> x ) & mask if data is not None else ( r ^ ( r >> self.tap ) ) & mask
+            r = ( r >> self.step ) | ( bits << ( self.order - self.step ) )
+            out |= bits << x
+        self.state = r
+        return out
+
+    def block( self, count ):
+        return bytes( self.shift() for _ in range( count ) )
+
+
+class Checker:
+    def __init__( self, order ):
+        self.prbs = Prbs( order )
+        self.need = ( order + 7 ) // 8
+        self.loaded = 0
+        self.locked = False
+        self.synced = False
+        self.checked = self.bit_errors = self.byte_errors = self.resyncs = 0
+        self.block_bytes = self.block_bits = 0
+
+    def feed( self, data ):
+        for c in data:
+            if not self.locked:
+                if self.loaded < self.need:
+                    self.prbs.shift( c )
+                    self.loaded += 1
+                elif self.prbs.shift() != c or not self.prbs.state:
+                    self.prbs.shift( c )
+                    self.loaded = 1
+                else:
+                    self.loaded += 1
+                    if self.loaded >= self.need + VERIFY:
+                        self.resyncs += self.synced
+                        self.synced = self.locked = True
+                        self.block_bytes = self.block_bits = 0
+                continue
+            diff = c ^ self.prbs.shift()
+            self.checked += 1
+            if diff:
+                errors = bin( diff ).count( "1" )
+                self.bit_errors += errors
+                self.byte_errors += 1
+                self.block_bits += errors
+            self.block_bytes += 1
+            if self.block_bytes >= BLOCK:
+                if self.block_bits > LOSS_BITS:
+                    self.locked = False
+                    self.loaded = 0
+                self.block_bytes = self.block_bits = 0
+
+
+def ber( bits, checked ):
+    return "%.2e" % ( bits / ( 8.0 * checked ) ) if checked else "-"
+
+
+def wait_bert( link, first, tries=40 ):
+    for _ in range( tries ):
+        payload = link.wait_frame( dmx.TYPE_BERT, 1 )
+        if payload and payload[ 0 ] in ( first, 0x00 ):
+            return payload
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser( description="serial link bit error rate test" )
+    ap.add_argument( "port" )
+    ap.add_argument( "--prbs", type=int, choices=( 7, 15, 31 ), default=15 )
+    ap.add_argument( "--baud", type=int )
+    ap.add_argument( "--seconds", type=int, default=10 )
+    ap.add_argument( "--dir", choices=( "both", "down", "up" ), default="both" )
+    ap.add_argument( "--link", type=int, default=112500 )
+    args = ap.parse_args()
+    baud = args.baud or args.link
+    mode = { "both": SEND | CHECK, "down": SEND, "up": CHECK }[ args.dir ]
+
+    link = dmx.Link( args.port, args.link )
+    link.send( dmx.TYPE_BERT, struct.pack( "<BBBIH", 0x01, args.prbs, mode, baud, args.seconds ) )
+    reply = wait_bert( link, 0x01 )
+    if not reply or reply[ 0 ] != 0x01:
+        sys.exit( "request rejected" if reply else "no reply" )
+
+    link.port.baudrate = baud
+    tx, rx = Prbs( args.prbs ), Checker( args.prbs )
+    start = time.monotonic()
+    sent, chunk = 0, max( 16, baud // 200 )         # About 50 ms of data per write
+    while True:
+        now = time.monotonic() - start
+        if now >= SETTLE + args.seconds:
+            break
+        if mode & CHECK and SETTLE / 2 <= now < SETTLE + args.seconds - SETTLE:
+            link.port.write( tx.block( chunk ) )
+            sent += chunk
+        data = link.port.read( link.port.in_waiting or 1 )
+        if mode & SEND and now >= SETTLE:
+            rx.feed( data )
+    link.port.baudrate = args.link
+    link.port.reset_input_buffer()
+
+    result = wait_bert( link, 0x02 )
+    if not result:
+        link.send( dmx.TYPE_BERT, bytes( [ 0x02 ] ) )
+        result = wait_bert( link, 0x02 )
+    if not result or len( result ) < 30:
+        sys.exit( "no result from the device" )
+    d_sent, d_checked, d_bits, d_bytes, framing, noise, resyncs, lost, synced = \
+        struct.unpack_from( "<IIIIIIHHB", result, 1 )
+
+    print( "PRBS-%d at %d baud for %d s" % ( args.prbs, baud, args.seconds ) )
+    if mode & SEND:
+        print( "device -> host: %d sent, %d checked, %d bit errors (BER %s), %d byte errors, "
+               "%d resyncs%s" % ( d_sent, rx.checked, rx.bit_errors, ber( rx.bit_errors, rx.checked ),
+                                  rx.byte_errors, rx.resyncs, "" if rx.synced else ", NEVER SYNCED" ) )
+    if mode & CHECK:
+        print( "host -> device: %d sent, %d checked, %d bit errors (BER %s), %d byte errors, "
+               "%d resyncs, %d framing, %d noise, %d overruns%s" %
+               ( sent, d_checked, d_bits, ber( d_bits, d_checked ), d_bytes, resyncs, framing, noise,
+                 lost, "" if synced else ", NEVER SYNCED" ) )
+    failed = ( mode & SEND and ( not rx.synced or rx.bit_errors or rx.resyncs ) ) or \
+             ( mode & CHECK and ( not synced or d_bits or resyncs or framing or lost ) )
+    sys.exit( 1 if failed else 0 )
+
+
+if __name__ == "__main__":
+    main()
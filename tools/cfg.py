@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+#
+# Read and change the runtime settings of STM32F030-CMSIS-CFG-lib.c.
+#
+#   ./cfg.py /dev/ttyUSB0                       print all known fields
+#   ./cfg.py /dev/ttyUSB0 ledMs                 print one field
+#   ./cfg.py /dev/ttyUSB0 ledMs=250 [name=v]    store new values (most apply after reset)
+#
+# Fields are addressed by id in DMX_TYPE_CFG frames; the reply is id + value, or the id
+# alone if the device does not know the field, the value is outside the field's min..max
+# (CFG_FIELDS in main.c, e.g. baud 1200 .. core clock / 16) or could not be stored. Changing baud also
+# changes the baud rate to talk to the device with after its next reset.
+
+import struct
+import sys
+
+import dmx
+
+# id: ( name, struct format ). Keep in sync with CFG_FIELDS in main.c.
+FIELDS = { 1: ( "baud", "<I" ), 2: ( "heartbeatMs", "<H" ), 3: ( "ledMs", "<H" ),
+           4: ( "linkLogMs", "<H" ) }
+
+BY_NAME = { name: fid for fid, ( name, _ ) in FIELDS.items() }
+
+
+def request( link, fid, value=None ):
+    fmt = FIELDS[ fid ][ 1 ]
+    payload = bytes( [ fid ] ) + ( struct.pack( fmt, value ) if value is not None else b"" )
+    for _ in range( 3 ):
+        link.send( dmx.TYPE_CFG, payload )
+        reply = link.wait_frame( dmx.TYPE_CFG, tries=40 )     # A write takes ~100 ms
+        if reply and reply[ 0 ] == fid:
+            if len( reply ) == 1 + struct.calcsize( fmt ):
+                return struct.unpack( fmt, reply[ 1: ] )[ 0 ]
+            return None
+    sys.exit( "no reply for field %s" % FIELDS[ fid ][ 0 ] )
+
+
+def main():
+    if len( sys.argv ) < 2:
+        sys.exit( "usage: cfg.py PORT [NAME | NAME=VALUE ...]" )
+    link = dmx.Link( sys.argv[ 1 ] )
+    args = sys.argv[ 2: ] or [ name for name, _ in FIELDS.values() ]
+    for arg in args:
+        name, _, value = arg.partition( "=" )
+        if name not in BY_NAME:
+            sys.exit( "unknown field %s (known: %s)" % ( name, ", ".join( BY_NAME ) ) )
+        result = request( link, BY_NAME[ name ], int( value, 0 ) if value else None )
+        print( "%s = %s" % ( name, "(rejected)" if result is None else result ) )
+
+
+if __name__ == "__main__":
+    main()
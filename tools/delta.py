@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# Make a delta patch from the image on a device to a new build, for the in-place patcher
+# in STM32F030-CMSIS-DPATCH-lib.c.
+#
+#   ./delta.py old.bin new.bin patch.bin [-z]
+#
+# Both images must have their header filled in by imagehdr.py; the device checks the old
+# CRC before patching. -z compresses the patch with lzpack (feed it through LZ_feed with
+# DPATCH_feed as the sink).
+#
+# Like bsdiff, new data is described as old data plus a byte-wise difference, which is
+# mostly zero when code only moved a little. Each new page may only use old pages that
+# have not been overwritten when it is built, so both page orders are tried and the
+# smaller patch is kept.
+
+import binascii
+import struct
+import sys
+
+import imagehdr
+import lzpack
+
+PAGE = 1024
+GRAM = 4            # Bytes that must match exactly to start an ADD
+MIN_ADD = 8         # Shorter matches are cheaper as inserted data
+MISS_RUN = 8        # An ADD ends after this many different bytes in a row
+MAX_CANDIDATES = 32
+OP_ADD = 0x01
+OP_INSERT = 0x02
+REVERSE = 0x01
+
+
+def crc16( data ):
+    return binascii.crc_hqx( data, 0xFFFF )
+
+
+def index( old ):
+    grams = {}
+    for pos in range( len( old ) - GRAM + 1 ):
+        grams.setdefault( old[ pos:pos + GRAM ], [] ).append( pos )
+    return grams
+
+
+def extend( old, new, src, dst, lo, hi ):
+    """Approximate match of new[ dst: ] against old[ src: ] inside [ lo, hi ).
+       Returns ( length, equal bytes ), trimmed to end on an equal byte."""
+    length = equal = best_len = best_equal = misses = 0
+    while dst + length < len( new ) and src + length < hi and misses < MISS_RUN:
+        if old[ src + length ] == new[ dst + length ]:
+            equal += 1
+            misses = 0
+            best_len, best_equal = length + 1, equal
+        else:
+            misses += 1
+        length += 1
+    return best_len, best_equal
+
+
+def page_ops( old, grams, new, lo, hi, base ):
+    """Operations producing new (one page, at image offset base) from old[ lo:hi ]."""
+    ops = bytearray()
+    inserted = bytearray()
+    last = None                 # Continue the previous ADD at the same distance first
+
+    def flush():
+        if inserted:
+            ops.extend( struct.pack( "<BH", OP_INSERT, len( inserted ) ) + inserted )
+            inserted.clear()
+
+    pos = 0
+    while pos < len( new ):
+        # Old data usually sits at or near its new address, so try the closest copies
+        candidates = sorted( ( s for s in grams.get( new[ pos:pos + GRAM ], () ) if lo <= s < hi ),
+                             key=lambda s: abs( s - base - pos ) )[ :MAX_CANDIDATES ]
+        candidates = set( candidates )
+        if last is not None:
+            candidates.add( last + pos )
+        best = ( 0, 0, 0 )
+        for src in candidates:
+            if lo <= src < hi:
+                length, equal = extend( old, new, src, pos, lo, hi )
+                if equal > best[ 1 ]:
+                    best = ( length, equal, src )
+        length, equal, src = best
+        if equal < MIN_ADD:
+            inserted.append( new[ pos ] )
+            pos += 1
+            continue
+        flush()
+        diff = bytes( ( n - o ) & 0xFF for n, o in zip( new[ pos:pos + length ], old[ src:src + length ] ) )
+        ops.extend( struct.pack( "<BHH", OP_ADD, length, src ) + diff )
+        last = src - pos
+        pos += length
+    flush()
+    return ops
+
+
+def make_patch( old, new, reverse ):
+    _, _, old_len, old_crc = imagehdr.header( old )
+    _, _, new_len, new_crc = imagehdr.header( new )
+    old = old[ :old_len ]
+    pages = ( new_len + PAGE - 1 ) // PAGE
+    padded = new + b"\xFF" * ( pages * PAGE - len( new ) )
+    grams = index( old )
+
+    out = bytearray( b"DP" + struct.pack( "<BBIIII", pages, REVERSE if reverse else 0,
+                                          old_len, old_crc, new_len, new_crc ) )
+    for page in range( pages ):
+        out += struct.pack( "<H", crc16( padded[ page * PAGE:( page + 1 ) * PAGE ] ) )
+    for page in ( reversed( range( pages ) ) if reverse else range( pages ) ):
+        lo, hi = ( 0, min( ( page + 1 ) * PAGE, old_len ) ) if reverse else ( page * PAGE, old_len )
+        out += page_ops( old, grams, padded[ page * PAGE:( page + 1 ) * PAGE ], lo, hi, page * PAGE )
+    return bytes( out )
+
+
+def apply( old, patch ):
+    """Reference implementation of the device side, for checking."""
+    pages, flags, old_len, old_crc, new_len, new_crc = struct.unpack_from( "<BBIIII", patch, 2 )
+    flash = bytearray( old + b"\xFF" * ( max( pages * PAGE, len( old ) ) - len( old ) ) )
+    pos = 20 + 2 * pages
+    for page in ( reversed( range( pages ) ) if flags & REVERSE else range( pages ) ):
+        built = bytearray()
+        while len( built ) < PAGE:
+            op, length = struct.unpack_from( "<BH", patch, pos )
+            pos += 3
+            if op == OP_ADD:
+                src, = struct.unpack_from( "<H", patch, pos )
+                pos += 2
+                built += bytes( ( flash[ src + k ] + patch[ pos + k ] ) & 0xFF for k in range( length ) )
+            else:
+                built += patch[ pos:pos + length ]
+            pos += length
+        flash[ page * PAGE:( page + 1 ) * PAGE ] = built
+    return bytes( flash[ :new_len ] )
+
+
+def main():
+    args = [ a for a in sys.argv[ 1: ] if a != "-z" ]
+    if len( args ) != 3:
+        sys.exit( "usage: delta.py OLD.bin NEW.bin PATCH [-z]" )
+    images = []
+    for name in args[ :2 ]:
+        with open( name, "rb" ) as f:
+            image = f.read()
+        if imagehdr.header( image )[ 0 ] != imagehdr.MAGIC or imagehdr.image_crc( image ) != imagehdr.header( image )[ 3 ]:
+            sys.exit( "%s: header missing or not filled in (run imagehdr.py)" % name )
+        images.append( image )
+    old, new = images
+
+    patch = min( ( make_patch( old, new, reverse ) for reverse in ( False, True ) ), key=len )
+    if apply( old, patch ) != new:
+        sys.exit( "internal error: patch does not reproduce the new image" )
+    if "-z" in sys.argv:
+        patch = lzpack.compress( patch )
+    with open( args[ 2 ], "wb" ) as f:
+        f.write( patch )
+    print( "%d byte image, %d byte patch (%.1f%%)" % ( len( new ), len( patch ), 100.0 * len( patch ) / len( new ) ) )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+# Host side of the shared text console / binary frame port (STM32F030-CMSIS-DMX-lib.c).
+#
+# Frame on the wire:  00 | COBS( type, payload..., CRC16 high, CRC16 low ) | 00
+# CRC is CRC-16/CCITT-FALSE over type and payload. Everything outside frames is console
+# text.
+#
+# As a module:  link = Link( "/dev/ttyUSB0", 112500 ); link.send( TYPE_PING, b"hi" )
+# As a script:  ./dmx.py /dev/ttyUSB0 [baud]   prints console text and decoded frames
+
+import binascii
+import struct
+import sys
+
+import serial   # pyserial
+
+MARKER = 0x00
+
+# Frame types. Keep in sync with STM32F030-CMSIS-DMX-lib.c.
+TYPE_PING = 0x01
+TYPE_TSYNC = 0x02
+TYPE_REC = 0x03
+TYPE_CFG = 0x04
+TYPE_PROF = 0x05
+TYPE_BERT = 0x06
+TYPE_LAT = 0x07
+
+
+def crc16( data ):
+    return binascii.crc_hqx( data, 0xFFFF )
+
+
+def cobs_encode( data ):
+    out = bytearray( [ 0 ] )
+    code_pos, code = 0, 1
+    for b in data:
+        if b == 0:
+            out[ code_pos ] = code
+            code_pos, code = len( out ), 1
+            out.append( 0 )
+        else:
+            out.append( b )
+            code += 1
+            if code == 0xFF:
+                out[ code_pos ] = code
+                code_pos, code = len( out ), 1
+                out.append( 0 )
+    out[ code_pos ] = code
+    return bytes( out )
+
+
+def cobs_decode( data ):
+    out = bytearray()
+    pos = 0
+    while pos < len( data ):
+        code = data[ pos ]
+        if code == 0 or pos + code > len( data ):
+            raise ValueError( "bad COBS block" )
+        out += data[ pos + 1 : pos + code ]
+        pos += code
+        if code != 0xFF and pos < len( data ):
+            out.append( 0 )
+    return bytes( out )
+
+
+def encode_frame( ftype, payload=b"" ):
+    raw = bytes( [ ftype ] ) + bytes( payload )
+    raw += struct.pack( ">H", crc16( raw ) )
+    return bytes( [ MARKER ] ) + cobs_encode( raw ) + bytes( [ MARKER ] )
+
+
+def decode_frame( body ):
+    """Decode the bytes between two markers. Returns (type, payload) or None if damaged."""
+    try:
+        raw = cobs_decode( body )
+    except ValueError:
+        return None
+    if len( raw ) < 3 or struct.unpack( ">H", raw[ -2: ] )[ 0 ] != crc16( raw[ :-2 ] ):
+        return None
+    return raw[ 0 ], raw[ 1:-2 ]
+
+
+class Link:
+    """Splits the byte stream from the device into console text and frames."""
+
+    def __init__( self, port, baud=112500, timeout=0.1 ):
+        self.port = serial.Serial( port, baud, timeout=timeout )
+        self.in_frame = False
+        self.body = bytearray()
+        self.bad_frames = 0
+
+    def send( self, ftype, payload=b"" ):
+        self.port.write( encode_frame( ftype, payload ) )
+
+    def write_text( self, text ):
+        self.port.write( text.encode( "ascii" ) )
+
+    def feed( self, data ):
+        """Yields ("text", bytes) and ("frame", type, payload) items for received data."""
+        text = bytearray()
+        for b in data:
+            if self.in_frame:
+                if b != MARKER:
+                    self.body.append( b )
+                elif self.body:
+                    frame = decode_frame( bytes( self.body ) )
+                    self.in_frame = False
+                    if frame is None:
+                        self.bad_frames += 1
+                    else:
+                        yield ( "frame", ) + frame
+            elif b == MARKER:
+                if text:
+                    yield ( "text", bytes( text ) )
+                    text = bytearray()
+                self.in_frame = True
+                self.body = bytearray()
+            else:
+                text.append( b )
+        if text:
+            yield ( "text", bytes( text ) )
+
+    def read( self, size=256 ):
+        return list( self.feed( self.port.read( size ) ) )
+
+    def wait_frame( self, ftype, tries=20 ):
+        """Returns the payload of the next frame of type ftype, or None."""
+        for _ in range( tries ):
+            for item in self.read():
+                if item[ 0 ] == "frame" and item[ 1 ] == ftype:
+                    return item[ 2 ]
+        return None
+
+
+def main():
+    if len( sys.argv ) < 2:
+        sys.exit( "usage: dmx.py PORT [BAUD]" )
+    link = Link( sys.argv[ 1 ], int( sys.argv[ 2 ] ) if len( sys.argv ) > 2 else 112500 )
+    while True:
+        for item in link.read():
+            if item[ 0 ] == "text":
+                sys.stdout.write( item[ 1 ].decode( "ascii", "replace" ) )
+            else:
+                sys.stdout.write( "\n[frame 0x%02X] %s\n" % ( item[ 1 ], item[ 2 ].hex() ) )
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
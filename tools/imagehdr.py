@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Fill in the image header (STM32F030-CMSIS-IMG-lib.c) of a linked binary.
+#
+#   ./imagehdr.py output.bin
+#
+# Pads the file to a multiple of 4 bytes, then writes length and CRC into the header at
+# offset 0xC0. The CRC is what the STM32 CRC unit computes: CRC-32 polynomial 0x04C11DB7,
+# initial value 0xFFFFFFFF, little endian 32-bit words fed MSB first, no final XOR, over
+# the whole image except the crc word. Also used as a module by delta.py.
+
+import struct
+import sys
+
+MAGIC = 0x31474D49
+HEADER_OFFSET = 0xC0
+CRC_OFFSET = HEADER_OFFSET + 12
+
+
+def _table():
+    table = []
+    for byte in range( 256 ):
+        crc = byte << 24
+        for _ in range( 8 ):
+            crc = ( ( crc << 1 ) ^ 0x04C11DB7 if crc & 0x80000000 else crc << 1 ) & 0xFFFFFFFF
+        table.append( crc )
+    return table
+
+
+TABLE = _table()
+
+
+def crc32_words( data, crc=0xFFFFFFFF ):
+    """CRC unit over data (length a multiple of 4), continuing from crc."""
+    for ( word, ) in struct.iter_unpack( "<I", data ):
+        for shift in ( 24, 16, 8, 0 ):
+            crc = ( ( crc << 8 ) & 0xFFFFFFFF ) ^ TABLE[ ( crc >> 24 ) ^ ( ( word >> shift ) & 0xFF ) ]
+    return crc
+
+
+def header( image ):
+    """( magic, version, length, crc ) of an image."""
+    return struct.unpack_from( "<IIII", image, HEADER_OFFSET )
+
+
+def image_crc( image ):
+    return crc32_words( image[ CRC_OFFSET + 4: ], crc32_words( image[ :CRC_OFFSET ] ) )
+
+
+def patch( image ):
+    """Returns the image padded and with length and crc filled in."""
+    image = bytearray( image )
+    if len( image ) < HEADER_OFFSET + 16 or header( image )[ 0 ] != MAGIC:
+        raise ValueError( "no image header at offset 0x%X" % HEADER_OFFSET )
+    image += b"\xFF" * ( -len( image ) % 4 )
+    struct.pack_into( "<I", image, HEADER_OFFSET + 8, len( image ) )
+    struct.pack_into( "<I", image, CRC_OFFSET, image_crc( image ) )
+    return bytes( image )
+
+
+def main():
+    if len( sys.argv ) != 2:
+        sys.exit( "usage: imagehdr.py IMAGE.bin" )
+    with open( sys.argv[ 1 ], "rb" ) as f:
+        image = patch( f.read() )
+    with open( sys.argv[ 1 ], "wb" ) as f:
+        f.write( image )
+    _, version, length, crc = header( image )
+    print( "image version %d, %d bytes, crc %08X" % ( version, length, crc ) )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+#
+# Fetch and symbolize the per-function cycle table of an instrumented build
+# ("make INSTRUMENT=1", STM32F030-CMSIS-INSTR-lib.c), or with --spin the busy-wait
+# table of "make USART_SPIN_STATS=1" (STM32F030-CMSIS-USART-lib.c).
+#
+#   ./instr.py [--spin] /dev/ttyUSB0 output.elf [baud]
+#
+# Sends the console command ("instr" or "spin"), collects the report lines and prints
+# calls, inclusive and exclusive cycles per function (most exclusive cycles first), or
+# cycles spent polling the USART per call site (function+offset of the caller). Cycles
+# are core clock cycles (8 MHz); the instrumentation overhead is already removed.
+
+import sys
+
+import dmx
+import prof
+
+
+def fetch( link, command, last, tries=50 ):
+    text = b""
+    link.write_text( command + "\r" )
+    for _ in range( tries ):
+        for item in link.read():
+            if item[ 0 ] == "text":
+                text += item[ 1 ]
+        end = text.find( last.encode() )
+        if end >= 0 and b"\n" in text[ end: ]:
+            break
+    lines = text.decode( "ascii", "replace" ).splitlines()
+    if not any( l.startswith( last ) for l in lines ):
+        sys.exit( "no complete report received" )
+    return lines
+
+
+def site_name( funcs, addr ):
+    addr &= ~1
+    for start, end, name in funcs:
+        if start <= addr < end:
+            return "%s+0x%x" % ( name, addr - start )
+    return "0x%08X" % addr
+
+
+def spin( link, funcs ):
+    rows = []
+    for line in fetch( link, "spin", "SPIN end" ):
+        parts = line.split()
+        if line.startswith( "SPIN" ):
+            print( line )
+        elif len( parts ) == 5 and parts[ 0 ] == "S":
+            calls, tx, rx = ( int( p ) for p in parts[ 2: ] )
+            rows.append( ( tx + rx, calls, tx, rx, site_name( funcs, int( parts[ 1 ], 16 ) ) ) )
+    print( "%10s %12s %12s %10s  %s" % ( "calls", "tx cycles", "rx cycles", "per call", "call site" ) )
+    for total, calls, tx, rx, name in sorted( rows, reverse=True ):
+        print( "%10d %12d %12d %10.1f  %s" % ( calls, tx, rx, total / calls, name ) )
+
+
+def main():
+    args = [ a for a in sys.argv[ 1: ] if a != "--spin" ]
+    if len( args ) < 2:
+        sys.exit( "usage: instr.py [--spin] PORT ELF [BAUD]" )
+    link = dmx.Link( args[ 0 ], int( args[ 2 ] ) if len( args ) > 2 else 112500 )
+    funcs = prof.symbols( args[ 1 ] )
+    if "--spin" in sys.argv:
+        return spin( link, funcs )
+    names = { start: name for start, _, name in funcs }
+    rows = []
+    for line in fetch( link, "instr", "INSTR end" ):
+        parts = line.split()
+        if line.startswith( "INSTR" ):
+            print( line )
+        elif len( parts ) == 5 and parts[ 0 ] == "I":
+            fn = int( parts[ 1 ], 16 ) & ~1
+            calls, incl, excl = ( int( p ) for p in parts[ 2: ] )
+            rows.append( ( excl, incl, calls, names.get( fn, "0x%08X" % fn ) ) )
+    print( "%10s %12s %12s %10s  %s" % ( "calls", "incl", "excl", "excl/call", "function" ) )
+    for excl, incl, calls, name in sorted( rows, reverse=True ):
+        print( "%10d %12d %12d %10.1f  %s" % ( calls, incl, excl, excl / calls, name ) )
+
+
+if __name__ == "__main__":
+    main()
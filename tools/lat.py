@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+#
+# Round-trip latency and throughput of the serial drivers (STM32F030-CMSIS-LAT-lib.c).
+#
+#   ./lat.py /dev/ttyUSB0 echo|tx|rx [--driver all|blocking,irq,dma,idle] [--baud B[,B...]]
+#            [--seconds S] [--frame N] [--link BAUD] [--hist]
+#
+# echo  round trip of N byte frames (default 1): device side turnaround, the time on the
+#       wire and what is left, the latency of this host and its USB adapter (an FTDI
+#       latency timer shows up here, not in the device figures)
+# tx    device -> host throughput
+# rx    host -> device throughput and bytes the device lost
+#
+# Every driver and baud rate given is tested in turn, one line each. --hist also prints
+# the round trip histogram (host) and the turnaround histogram (device) of echo tests.
+
+import argparse
+import struct
+import sys
+import time
+
+import dmx
+
+TESTS = { "echo": 0, "tx": 1, "rx": 2 }
+DRIVERS = [ "blocking", "irq", "dma", "idle" ]
+SETTLE = 0.1                    # LEND_SETTLE_MS
+CORE_HZ = 8e6                   # Older firmware does not send its clock
+BUCKETS = 16
+
+
+def start( link, test, driver, baud, seconds ):
+    link.send( dmx.TYPE_LAT, struct.pack( "<BBIH", 0x01, TESTS[ test ] << 4 | DRIVERS.index( driver ), baud, seconds ) )
+    reply = wait_lat( link, 0x01 )
+    return reply is not None and reply[ 0 ] == 0x01
+
+
+def wait_lat( link, first, tries=40 ):
+    for _ in range( tries ):
+        payload = link.wait_frame( dmx.TYPE_LAT, 1 )
+        if payload and payload[ 0 ] in ( first, 0x00 ):
+            return payload
+    return None
+
+
+def result( link, link_baud ):
+    link.port.baudrate = link_baud
+    link.port.reset_input_buffer()
+    payload = wait_lat( link, 0x02 )
+    if not payload:
+        link.send( dmx.TYPE_LAT, bytes( [ 0x02 ] ) )
+        payload = wait_lat( link, 0x02 )
+    if not payload or len( payload ) < 14 + 2 * BUCKETS:
+        return None
+    rx, tx, loop_max = struct.unpack_from( "<III", payload, 2 )
+    core_hz = struct.unpack_from( "<I", payload, 14 + 2 * BUCKETS )[ 0 ] if len( payload ) >= 18 + 2 * BUCKETS else CORE_HZ
+    return dict( rx=rx, tx=tx, loop_max=loop_max, hist=struct.unpack_from( "<%dH" % BUCKETS, payload, 14 ),
+                 core_hz=core_hz )
+
+
+def hist_median( hist, core_hz ):
+    """Median of a log2 cycle histogram in microseconds (bucket midpoint)."""
+    total, seen = sum( hist ), 0
+    for b, count in enumerate( hist ):
+        seen += count
+        if total and seen * 2 >= total:
+            return 1.5 * ( 1 << b ) / core_hz * 1e6 if b else 0.0
+    return 0.0
+
+
+def percentile( values, p ):
+    return values[ min( len( values ) - 1, int( p * len( values ) ) ) ] if values else 0.0
+
+
+def log_hist( values, unit ):
+    buckets = {}
+    for v in values:
+        b = max( 0, int( v ).bit_length() - 1 )
+        buckets[ b ] = buckets.get( b, 0 ) + 1
+    for b in sorted( buckets ):
+        print( "    %8d .. %8d %s %7d" % ( 1 << b, ( 2 << b ) - 1, unit, buckets[ b ] ) )
+
+
+def echo( link, seconds, frame ):
+    rtts, timeouts, n = [], 0, 0
+    end = time.monotonic() + seconds - 2 * SETTLE
+    while time.monotonic() < end:
+        data = bytes( ( n + x ) % 255 + 1 for x in range( frame ) )     # No 0x00 (TSYNC marker)
+        n += frame
+        t0 = time.perf_counter()
+        link.port.write( data )
+        got = b""
+        while len( got ) < frame and time.perf_counter() - t0 < 0.5:
+            got += link.port.read( frame - len( got ) )
+        if len( got ) < frame:
+            timeouts += 1
+            link.port.reset_input_buffer()
+        else:
+            rtts.append( ( time.perf_counter() - t0 ) * 1e6 )
+    return sorted( rtts ), timeouts
+
+
+def one( link, args, test, driver, baud ):
+    if not start( link, test, driver, baud, args.seconds ):
+        print( "%-5s %-8s %7d  rejected" % ( test, driver, baud ) )
+        return
+    link.port.baudrate = baud
+    t_start = time.monotonic()
+    time.sleep( SETTLE + 0.02 )
+    char_us = 10e6 / baud
+
+    if test == "echo":
+        rtts, timeouts = echo( link, args.seconds, args.frame )
+    elif test == "tx":
+        count, first, last = 0, None, None
+        while time.monotonic() - t_start < SETTLE + args.seconds:
+            data = link.port.read( link.port.in_waiting or 1 )
+            if data:
+                last = time.perf_counter()
+                first = first or last
+                count += len( data )
+    else:
+        chunk, sent = max( 16, baud // 100 ), 0
+        t0 = time.perf_counter()
+        while time.monotonic() - t_start < args.seconds:
+            link.port.write( b"\x55" * chunk )
+            sent += chunk
+        link.port.flush()
+        elapsed = time.perf_counter() - t0
+
+    # The device switches back after the run, then waits 2 * SETTLE
+    time.sleep( max( 0.0, SETTLE + args.seconds - ( time.monotonic() - t_start ) ) + SETTLE )
+    dev = result( link, args.link )
+    if not dev:
+        print( "%-5s %-8s %7d  no result" % ( test, driver, baud ) )
+        return
+
+    if test == "echo":
+        wire = { "blocking": args.frame, "idle": 2 * args.frame + 1 }.get( driver, args.frame + 1 ) * char_us
+        device = hist_median( dev[ "hist" ], dev[ "core_hz" ] )
+        rtt = percentile( rtts, 0.5 )
+        print( "%-5s %-8s %7d  rtt us min %7.0f med %7.0f p99 %7.0f max %7.0f | wire %6.0f device %6.1f "
+               "host+adapter %7.0f | %d timeouts%s" %
+               ( test, driver, baud, rtts[ 0 ] if rtts else 0, rtt, percentile( rtts, 0.99 ),
+                 rtts[ -1 ] if rtts else 0, wire, device, rtt - wire - device, timeouts,
+                 ", loop max %.1f us" % ( dev[ "loop_max" ] / dev[ "core_hz" ] * 1e6 ) if driver == "dma" else "" ) )
+        if args.hist:
+            print( "  host round trip:" )
+            log_hist( rtts, "us" )
+            print( "  device turnaround:" )
+            for b, count in enumerate( dev[ "hist" ] ):
+                if count:
+                    print( "    %8d .. %8d cy %7d" % ( 1 << b if b else 0, ( 2 << b ) - 1, count ) )
+    elif test == "tx":
+        rate = ( count - 1 ) / ( last - first ) if count > 1 and last > first else 0.0
+        print( "%-5s %-8s %7d  %8.0f B/s  %5.1f%% of line  device sent %d, host got %d" %
+               ( test, driver, baud, rate, 100.0 * rate * char_us / 1e6, dev[ "tx" ], count ) )
+    else:
+        print( "%-5s %-8s %7d  %8.0f B/s  %5.1f%% of line  host sent %d, device got %d, lost %d" %
+               ( test, driver, baud, dev[ "rx" ] / elapsed, 100.0 * dev[ "rx" ] / elapsed * char_us / 1e6,
+                 sent, dev[ "rx" ], sent - dev[ "rx" ] ) )
+
+
+def main():
+    ap = argparse.ArgumentParser( description="serial path latency and throughput" )
+    ap.add_argument( "port" )
+    ap.add_argument( "test", choices=sorted( TESTS ) )
+    ap.add_argument( "--driver", default="all" )
+    ap.add_argument( "--baud" )
+    ap.add_argument( "--seconds", type=int, default=5 )
+    ap.add_argument( "--frame", type=int, default=1 )
+    ap.add_argument( "--link", type=int, default=112500 )
+    ap.add_argument( "--hist", action="store_true" )
+    args = ap.parse_args()
+    drivers = list( DRIVERS ) if args.driver == "all" else args.driver.split( "," )
+    if any( d not in DRIVERS for d in drivers ):
+        sys.exit( "drivers: " + ", ".join( DRIVERS ) )
+    if args.test == "tx" and "idle" in drivers:
+        drivers.remove( "idle" )                        # Receive side only
+    bauds = [ int( b ) for b in args.baud.split( "," ) ] if args.baud else [ args.link ]
+
+    link = dmx.Link( args.port, args.link )
+    for baud in bauds:
+        for driver in drivers:
+            one( link, args, args.test, driver, baud )
+
+
+if __name__ == "__main__":
+    main()
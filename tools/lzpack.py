@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Compress a firmware image for the streaming decoder in STM32F030-CMSIS-LZ-lib.c.
+#
+#   ./lzpack.py output.bin output.lz        compress
+#   ./lzpack.py -d output.lz output.bin     decompress (for checking)
+#
+# Format: 'L' 'Z' size:u32le, then tokens
+#   0LLLLLLL                 L + 1 literal bytes follow (1..128)
+#   1LLLLLLL offset:u8       copy L + 3 bytes (3..130) from offset + 1 bytes back
+#
+# The 256 byte window is what the device can afford in RAM. Matching is greedy with a
+# one byte lookahead, which is within a few percent of optimal parsing at this window size.
+
+import struct
+import sys
+
+WINDOW = 256
+MIN_MATCH = 3
+MAX_MATCH = 0x7F + MIN_MATCH
+MAX_LITERALS = 0x80
+
+
+def longest_match( data, pos, chains ):
+    """Longest earlier match for data[ pos: ] inside the window, as ( length, offset )."""
+    best = ( 0, 0 )
+    limit = min( MAX_MATCH, len( data ) - pos )
+    if limit < MIN_MATCH:
+        return best
+    for start in reversed( chains.get( data[ pos:pos + MIN_MATCH ], () ) ):
+        if pos - start > WINDOW:
+            break
+        n = 0
+        while n < limit and data[ start + n ] == data[ pos + n ]:
+            n += 1
+        if n > best[ 0 ]:
+            best = ( n, pos - start )
+            if n == limit:
+                break
+    return best
+
+
+def compress( data ):
+    out = bytearray( b"LZ" + struct.pack( "<I", len( data ) ) )
+    literals = bytearray()
+    chains = {}
+
+    def add( pos ):
+        key = data[ pos:pos + MIN_MATCH ]
+        chain = chains.setdefault( key, [] )
+        chain.append( pos )
+        while pos - chain[ 0 ] > WINDOW:
+            chain.pop( 0 )
+
+    def flush_literals():
+        for x in range( 0, len( literals ), MAX_LITERALS ):
+            run = literals[ x:x + MAX_LITERALS ]
+            out.append( len( run ) - 1 )
+            out.extend( run )
+        literals.clear()
+
+    pos = 0
+    while pos < len( data ):
+        length, offset = longest_match( data, pos, chains )
+        add( pos )
+        if length >= MIN_MATCH and longest_match( data, pos + 1, chains )[ 0 ] > length:
+            length = 0                      # A literal now buys a longer match next
+        if length < MIN_MATCH:
+            literals.append( data[ pos ] )
+            pos += 1
+            continue
+
+        flush_literals()
+        out.append( 0x80 | ( length - MIN_MATCH ) )
+        out.append( offset - 1 )
+        for x in range( pos + 1, pos + length ):
+            add( x )
+        pos += length
+
+    flush_literals()
+    return bytes( out )
+
+
+def decompress( data ):
+    if data[ :2 ] != b"LZ" or len( data ) < 6:
+        raise ValueError( "bad header" )
+    size, = struct.unpack_from( "<I", data, 2 )
+    out = bytearray()
+    pos = 6
+    while pos < len( data ):
+        token = data[ pos ]
+        pos += 1
+        if token & 0x80:
+            offset = data[ pos ] + 1
+            pos += 1
+            if offset > len( out ):
+                raise ValueError( "reference before start" )
+            for _ in range( ( token & 0x7F ) + MIN_MATCH ):
+                out.append( out[ -offset ] )
+        else:
+            out.extend( data[ pos:pos + token + 1 ] )
+            pos += token + 1
+    if len( out ) != size:
+        raise ValueError( "size mismatch" )
+    return bytes( out )
+
+
+def main():
+    args = sys.argv[ 1: ]
+    unpack = args[ :1 ] == [ "-d" ]
+    if unpack:
+        args = args[ 1: ]
+    if len( args ) != 2:
+        sys.exit( "usage: lzpack.py [-d] IN OUT" )
+
+    with open( args[ 0 ], "rb" ) as f:
+        data = f.read()
+    if unpack:
+        result = decompress( data )
+    else:
+        result = compress( data )
+        if decompress( result ) != data:
+            sys.exit( "internal error: round trip failed" )
+        print( "%d -> %d bytes (%.1f%%)" %
+               ( len( data ), len( result ), 100.0 * len( result ) / max( len( data ), 1 ) ) )
+    with open( args[ 1 ], "wb" ) as f:
+        f.write( result )
+
+
+if __name__ == "__main__":
+    main()
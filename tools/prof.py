@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+#
+# Host side of the sampling profiler (STM32F030-CMSIS-PROF-lib.c).
+#
+#   ./prof.py /dev/ttyUSB0 start [hz]               clear and start sampling (default 1000)
+#   ./prof.py /dev/ttyUSB0 stop
+#   ./prof.py /dev/ttyUSB0 dump output.elf [name]   per-function table, name.folded, name.svg
+#
+# The device keeps one count per 2^shift bytes of flash. Counts are spread over the
+# functions in each bucket by the bytes they cover there, so functions much smaller than
+# a bucket share its samples (build with a smaller PROF_SHIFT to separate them). Symbols
+# come from arm-none-eabi-nm (set NM to use another).
+#
+# name.folded holds one "lib;function count" line per function, the input format of
+# flamegraph.pl and speedscope; name.svg is the same drawn as a two level flame graph.
+# The lib is the name prefix before the first '_' (TXQ_bulk -> TXQ).
+
+import os
+import struct
+import subprocess
+import sys
+
+import dmx
+
+CMD_STOP, CMD_START, CMD_DUMP = 0, 1, 2
+PER_FRAME = 24
+END = 0xFFFF
+
+
+def dump( link, tries=5 ):
+    counts = []
+    for _ in range( tries ):
+        link.send( dmx.TYPE_PROF, struct.pack( "<BH", CMD_DUMP, len( counts ) ) )
+        while True:
+            payload = link.wait_frame( dmx.TYPE_PROF )
+            if payload is None:
+                break                                   # Timed out: ask again
+            index, = struct.unpack_from( "<H", payload )
+            if index == END:
+                base, shift, buckets, outside, handler, halvings, hz = \
+                    struct.unpack_from( "<IBHIIBH", payload, 2 )
+                if len( counts ) == buckets:
+                    return dict( base=base, shift=shift, counts=counts, outside=outside,
+                                 handler=handler, halvings=halvings, hz=hz )
+                break
+            if index != len( counts ):
+                break                                   # Lost a frame: ask again
+            counts += struct.unpack_from( "<%dH" % ( ( len( payload ) - 2 ) // 2 ), payload, 2 )
+    sys.exit( "dump failed after %d buckets" % len( counts ) )
+
+
+def symbols( elf ):
+    """Sorted ( start, end, name ) of the functions in elf."""
+    out = subprocess.run( [ os.environ.get( "NM", "arm-none-eabi-nm" ), "-S", "-n", "--defined-only", elf ],
+                          check=True, capture_output=True, text=True ).stdout
+    funcs = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len( parts ) == 4 and parts[ 2 ] in "tTwW":
+            start = int( parts[ 0 ], 16 ) & ~1
+            funcs.append( ( start, start + int( parts[ 1 ], 16 ), parts[ 3 ] ) )
+    return funcs
+
+
+def attribute( prof, funcs ):
+    """Samples per function name, spread over each bucket by overlap."""
+    size = 1 << prof[ "shift" ]
+    result = {}
+    for index, count in enumerate( prof[ "counts" ] ):
+        if not count:
+            continue
+        lo = prof[ "base" ] + index * size
+        hi = lo + size
+        shares = [ ( min( hi, end ) - max( lo, start ), name ) for start, end, name in funcs
+                   if start < hi and end > lo ]
+        covered = sum( s for s, _ in shares )
+        if not covered:
+            result[ "[unknown]" ] = result.get( "[unknown]", 0 ) + count
+            continue
+        for share, name in shares:
+            result[ name ] = result.get( name, 0 ) + count * share / covered
+    if prof[ "outside" ]:
+        result[ "[outside image]" ] = prof[ "outside" ]
+    return result
+
+
+def lib( name ):
+    if name.startswith( "[" ):
+        return "other"
+    prefix = name.split( "_" )[ 0 ]
+    return prefix if "_" in name and prefix else "app"
+
+
+def flame_svg( per_func, total, path, width=1200, row=18 ):
+    libs = {}
+    for name, count in per_func.items():
+        libs.setdefault( lib( name ), [] ).append( ( count, name ) )
+    rects = []
+
+    def box( x, y, w, label, count, hue ):
+        title = "%s: %.1f%%" % ( label, 100.0 * count / total )
+        text = label if w > 7 * len( label ) else ""
+        rects.append( '<g><title>%s</title><rect x="%.1f" y="%d" width="%.1f" height="%d" '
+                      'fill="hsl(%d,80%%,60%%)" stroke="white"/><text x="%.1f" y="%d">%s</text></g>'
+                      % ( title, x, y, w, row - 1, hue, x + 3, y + row - 5, text ) )
+
+    box( 0, 2 * row, width, "all", total, 0 )
+    x = 0.0
+    for n, ( name, funcs ) in enumerate( sorted( libs.items(), key=lambda item: -sum( c for c, _ in item[ 1 ] ) ) ):
+        lib_count = sum( c for c, _ in funcs )
+        box( x, row, width * lib_count / total, name, lib_count, 30 + 40 * n % 300 )
+        fx = x
+        for count, func in sorted( funcs, reverse=True ):
+            box( fx, 0, width * count / total, func, count, 40 + 40 * n % 300 )
+            fx += width * count / total
+        x += width * lib_count / total
+    with open( path, "w" ) as f:
+        f.write( '<svg xmlns="http://www.w3.org/2000/svg" width="%d" height="%d" font-family="monospace" '
+                 'font-size="11">\n%s\n</svg>\n' % ( width, 3 * row, "\n".join( rects ) ) )
+
+
+def report( prof, elf, name ):
+    per_func = attribute( prof, symbols( elf ) )
+    total = sum( per_func.values() )
+    if not total:
+        sys.exit( "no samples" )
+    print( "%d samples at %d Hz, %.1f%% in interrupt handlers%s" %
+           ( total, prof[ "hz" ], 100.0 * prof[ "handler" ] / total,
+             ", counts halved %d times" % prof[ "halvings" ] if prof[ "halvings" ] else "" ) )
+    for func, count in sorted( per_func.items(), key=lambda item: -item[ 1 ] ):
+        print( "%6.2f%%  %8.1f  %s" % ( 100.0 * count / total, count, func ) )
+    with open( name + ".folded", "w" ) as f:
+        for func, count in per_func.items():
+            f.write( "%s;%s %d\n" % ( lib( func ), func, round( count ) ) )
+    flame_svg( per_func, total, name + ".svg" )
+
+
+def main():
+    if len( sys.argv ) < 3 or sys.argv[ 2 ] not in ( "start", "stop", "dump" ) or \
+       ( sys.argv[ 2 ] == "dump" and len( sys.argv ) < 4 ):
+        sys.exit( "usage: prof.py PORT start [HZ] | stop | dump ELF [NAME]" )
+    link = dmx.Link( sys.argv[ 1 ] )
+    if sys.argv[ 2 ] == "start":
+        link.send( dmx.TYPE_PROF, struct.pack( "<BH", CMD_START, int( sys.argv[ 3 ] ) if len( sys.argv ) > 3 else 1000 ) )
+    elif sys.argv[ 2 ] == "stop":
+        link.send( dmx.TYPE_PROF, bytes( [ CMD_STOP ] ) )
+    else:
+        report( dump( link ), sys.argv[ 3 ], sys.argv[ 4 ] if len( sys.argv ) > 4 else "profile" )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+#
+# Download the flight recorder log (STM32F030-CMSIS-REC-lib.c) and print it as CSV.
+#
+#   ./recdump.py /dev/ttyUSB0 [baud] > flight.csv
+#
+# Records come oldest first as DMX_TYPE_REC frames of index:u16 + 8 byte records; an
+# empty frame ends the log. If frames are lost the download is restarted at the first
+# missing index.
+
+import struct
+import sys
+
+import dmx
+
+# Record types. Keep in sync with STM32F030-CMSIS-REC-lib.c.
+TYPES = { 0x01: "reset", 0x02: "failsafe", 0x03: "link", 0x04: "voltage", 0x05: "post",
+          0x06: "scrub", 0x07: "clock", 0x08: "tlm" }
+
+RESET_FLAGS = [ ( 0x80, "lowpower" ), ( 0x40, "wwdg" ), ( 0x20, "iwdg" ), ( 0x10, "software" ),
+                ( 0x08, "por" ), ( 0x04, "pin" ), ( 0x02, "obl" ) ]
+
+POST_FLAGS = [ ( 0x01, "ram" ), ( 0x02, "flash" ), ( 0x04, "clock" ), ( 0x08, "budget" ),
+               ( 0x10, "noheader" ), ( 0x20, "warm" ), ( 0x40, "kernels" ) ]
+
+RECORD = struct.Struct( "<IBBH" )
+
+
+def download( link, tries=5 ):
+    records = []
+    for _ in range( tries ):
+        link.send( dmx.TYPE_REC, struct.pack( "<H", len( records ) ) )
+        while True:
+            payload = link.wait_frame( dmx.TYPE_REC )
+            if payload is None:
+                break                                   # Timed out: ask again
+            index, = struct.unpack_from( "<H", payload )
+            if index != len( records ):
+                break                                   # Lost a frame: ask again
+            body = payload[ 2: ]
+            if not body:
+                return records
+            records += [ RECORD.unpack_from( body, x ) for x in range( 0, len( body ), RECORD.size ) ]
+    sys.exit( "download failed after %d records" % len( records ) )
+
+
+def describe( rtype, arg, value ):
+    if rtype == 0x01:
+        return "|".join( name for bit, name in RESET_FLAGS if arg & bit )
+    if rtype == 0x02:
+        return "enter" if arg else "leave"
+    if rtype == 0x04:
+        return "%.3f V" % ( value / 1000.0 )
+    if rtype == 0x05:
+        return "|".join( [ name for bit, name in POST_FLAGS if arg & bit ] + [ "%d us" % value ] )
+    if rtype == 0x07:
+        return "%s, %d kHz" % ( { 1: "hse no start", 2: "hse lost" }.get( arg, "?" ), value )
+    if rtype == 0x08:
+        admitted = { 255: "rejected", 0: "parked" }.get( arg, "every %d" % arg )
+        return "%d ms stream %s" % ( value, admitted )
+    return ""
+
+
+def main():
+    if len( sys.argv ) < 2:
+        sys.exit( "usage: recdump.py PORT [BAUD]" )
+    link = dmx.Link( sys.argv[ 1 ], int( sys.argv[ 2 ] ) if len( sys.argv ) > 2 else 112500 )
+    print( "time_ms,type,arg,value,note" )
+    for time, rtype, arg, value in download( link ):
+        print( "%d,%s,%d,%d,%s" % ( time, TYPES.get( rtype, "0x%02X" % rtype ), arg, value,
+                                    describe( rtype, arg, value ) ) )
+
+
+if __name__ == "__main__":
+    main()
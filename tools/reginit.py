@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+#
+# List the boot register table (REGINIT_OPS, STM32F030-CMSIS-REGINIT-lib.c) of a build.
+#
+#   ./reginit.py output.elf [--check]
+#
+# One line per entry, in the order Reset_Handler writes them: register, mask, value.
+# --check only reports problems and exits 1 if a register appears more than once (the
+# entries should have been merged, see REGINIT_BITS) or an entry sets bits outside its
+# mask. The section is extracted with arm-none-eabi-objcopy (set OBJCOPY to use another).
+
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+ALL = 0xFFFFFFFF
+
+PERIPHERALS = { 0x40021000: ( "RCC", "rcc" ), 0x40022000: ( "FLASH", "flash" ),
+                0x48000000: ( "GPIOA", "gpio" ), 0x48000400: ( "GPIOB", "gpio" ),
+                0x48000800: ( "GPIOC", "gpio" ), 0x48001400: ( "GPIOF", "gpio" ),
+                0x40013800: ( "USART1", "usart" ), 0x40020000: ( "DMA1", "dma" ),
+                0x40002000: ( "TIM14", "tim" ), 0x40014400: ( "TIM16", "tim" ),
+                0x40014800: ( "TIM17", "tim" ), 0x40012C00: ( "TIM1", "tim" ),
+                0x40000400: ( "TIM3", "tim" ), 0x40023000: ( "CRC", "crc" ) }
+
+REGISTERS = {
+    "rcc": { 0x00: "CR", 0x04: "CFGR", 0x08: "CIR", 0x0C: "APB2RSTR", 0x10: "APB1RSTR",
+             0x14: "AHBENR", 0x18: "APB2ENR", 0x1C: "APB1ENR", 0x20: "BDCR", 0x24: "CSR" },
+    "flash": { 0x00: "ACR" },
+    "gpio": { 0x00: "MODER", 0x04: "OTYPER", 0x08: "OSPEEDR", 0x0C: "PUPDR", 0x14: "ODR",
+              0x18: "BSRR", 0x20: "AFR[0]", 0x24: "AFR[1]" },
+    "usart": { 0x00: "CR1", 0x04: "CR2", 0x08: "CR3", 0x0C: "BRR", 0x10: "GTPR", 0x14: "RTOR" },
+    "tim": { 0x00: "CR1", 0x04: "CR2", 0x08: "SMCR", 0x0C: "DIER", 0x18: "CCMR1", 0x1C: "CCMR2",
+             0x20: "CCER", 0x28: "PSC", 0x2C: "ARR", 0x30: "RCR", 0x34: "CCR1", 0x38: "CCR2",
+             0x3C: "CCR3", 0x40: "CCR4", 0x44: "BDTR" },
+    "crc": { 0x08: "CR", 0x10: "INIT" },
+}
+
+DMA_CHANNEL = { 0x0: "CCR", 0x4: "CNDTR", 0x8: "CPAR", 0xC: "CMAR" }
+
+
+def name( addr ):
+    for base, ( periph, kind ) in PERIPHERALS.items():
+        offset = addr - base
+        if 0 <= offset < 0x400:
+            if kind == "dma" and offset >= 0x08:
+                return "DMA1_Channel%d->%s" % ( ( offset - 0x08 ) // 20 + 1,
+                                                DMA_CHANNEL.get( ( offset - 0x08 ) % 20, "?" ) )
+            return "%s->%s" % ( periph, REGISTERS[ kind ].get( offset, "+0x%02X" % offset ) )
+    return "0x%08X" % addr
+
+
+def table( elf ):
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join( tmp, "reginit.bin" )
+        subprocess.run( [ os.environ.get( "OBJCOPY", "arm-none-eabi-objcopy" ), "-O", "binary",
+                          "--only-section=.reginit", elf, out ], check=True )
+        data = open( out, "rb" ).read() if os.path.exists( out ) else b""
+    return [ struct.unpack_from( "<III", data, x ) for x in range( 0, len( data ) - 11, 12 ) ]
+
+
+def main():
+    args = [ a for a in sys.argv[ 1: ] if a != "--check" ]
+    if len( args ) != 1:
+        sys.exit( "usage: reginit.py ELF [--check]" )
+    check = "--check" in sys.argv
+    entries = table( args[ 0 ] )
+
+    problems, seen = 0, set()
+    for addr, mask, value in entries:
+        if not check:
+            print( "%-22s %s %08X" % ( name( addr ), "   (all)" if mask == ALL else "%08X" % mask, value ) )
+        if addr in seen:
+            print( "reginit: %s written twice, merge the entries" % name( addr ), file=sys.stderr )
+            problems += 1
+        if value & ~mask & ALL:
+            print( "reginit: %s sets %08X outside its mask" % ( name( addr ), value & ~mask ), file=sys.stderr )
+            problems += 1
+        seen.add( addr )
+    if not check:
+        print( "%d entries, %d bytes" % ( len( entries ), 12 * len( entries ) ) )
+    sys.exit( 1 if problems else 0 )
+
+
+if __name__ == "__main__":
+    main()
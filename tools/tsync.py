@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# Estimate the offset and drift of the device clock (SysTick_micros) against the host
+# clock with the exchange in STM32F030-CMSIS-TSYNC-lib.c.
+#
+#   ./tsync.py /dev/ttyUSB0 [baud] [exchanges]
+#
+# Prints the fitted mapping  host_us = device_us - ( offset_us + drift * ( device_us - d0 ) )
+# and writes it as JSON to tsync.json for converting device log timestamps later.
+#
+# USB serial adapters add milliseconds of latency (the FTDI latency timer defaults to
+# 16 ms). Only the exchanges with the lowest round trip delay are used for the fit, but
+# lowering the latency timer (/sys/bus/usb-serial/devices/*/latency_timer) helps a lot.
+
+import json
+import struct
+import sys
+import time
+
+import dmx
+
+WRAP = 1 << 32
+
+
+class Unwrapper:
+    """Extends the device's 32-bit microsecond counter to 64 bits."""
+
+    def __init__( self ):
+        self.last = None
+        self.high = 0
+
+    def __call__( self, value ):
+        if self.last is not None and value < self.last and self.last - value > WRAP // 2:
+            self.high += WRAP
+        self.last = value
+        return self.high + value
+
+
+def host_us():
+    return time.perf_counter_ns() // 1000
+
+
+def collect( link, count, interval=0.05 ):
+    """Returns a list of (t1, t2, t3, t4) tuples, host times in host_us() units."""
+    pending = {}            # seq -> ( t1, t2, t4 ) waiting for its t3
+    samples = []
+    unwrap = Unwrapper()
+
+    for seq in range( 1, count + 2 ):
+        t1 = host_us()
+        link.send( dmx.TYPE_TSYNC, struct.pack( "<H", seq & 0xFFFF ) )
+        reply = link.wait_frame( dmx.TYPE_TSYNC )
+        t4 = host_us()
+        if reply is None or len( reply ) < 12:
+            continue
+
+        rseq, t2, prev_seq, prev_t3 = struct.unpack( "<HIHI", reply[ :12 ] )
+        if rseq != seq & 0xFFFF:
+            continue
+        t2 = unwrap( t2 )
+        if prev_seq in pending:
+            p1, p2, p4 = pending.pop( prev_seq )
+            p3 = p2 + ( ( prev_t3 - p2 ) % WRAP )     # t3 follows t2 closely
+            samples.append( ( p1, p2, p3, p4 ) )
+        pending[ seq & 0xFFFF ] = ( t1, t2, t4 )
+        time.sleep( interval )
+
+    return samples
+
+
+def fit( samples, keep=0.25 ):
+    """Least squares line through the offsets of the lowest delay exchanges."""
+    rows = []
+    for t1, t2, t3, t4 in samples:
+        offset = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2
+        delay = ( t4 - t1 ) - ( t3 - t2 )
+        rows.append( ( delay, t2, offset ) )
+    rows.sort()
+    rows = rows[ : max( 2, int( len( rows ) * keep ) ) ]
+
+    d0 = min( r[ 1 ] for r in rows )
+    xs = [ r[ 1 ] - d0 for r in rows ]
+    ys = [ r[ 2 ] for r in rows ]
+    n = len( rows )
+    mx, my = sum( xs ) / n, sum( ys ) / n
+    sxx = sum( ( x - mx ) ** 2 for x in xs )
+    drift = sum( ( x - mx ) * ( y - my ) for x, y in zip( xs, ys ) ) / sxx if sxx else 0.0
+    offset = my - drift * mx
+    resid = max( abs( y - ( offset + drift * x ) ) for x, y in zip( xs, ys ) )
+    return { "d0_us": d0, "offset_us": offset, "drift": drift, "min_delay_us": rows[ 0 ][ 0 ],
+             "max_residual_us": resid, "samples": n }
+
+
+def main():
+    if len( sys.argv ) < 2:
+        sys.exit( "usage: tsync.py PORT [BAUD] [EXCHANGES]" )
+    baud = int( sys.argv[ 2 ] ) if len( sys.argv ) > 2 else 112500
+    count = int( sys.argv[ 3 ] ) if len( sys.argv ) > 3 else 200
+
+    link = dmx.Link( sys.argv[ 1 ], baud )
+    samples = collect( link, count )
+    if len( samples ) < 2:
+        sys.exit( "not enough replies" )
+
+    result = fit( samples )
+    print( "offset %.1f us at device %d us, drift %.2f ppm" %
+           ( result[ "offset_us" ], result[ "d0_us" ], result[ "drift" ] * 1e6 ) )
+    print( "min delay %d us, max residual %.1f us over %d exchanges" %
+           ( result[ "min_delay_us" ], result[ "max_residual_us" ], result[ "samples" ] ) )
+    with open( "tsync.json", "w" ) as f:
+        json.dump( result, f, indent=2 )
+
+
+if __name__ == "__main__":
+    main()